@@ -0,0 +1,116 @@
+/** @file AppointmentBook.cpp
+ *
+ * AppointmentBook.cpp file:
+ * Time-indexed book of barber appointments
+ *
+ * Assumptions:
+ * Not thread safe; the owner serializes every call (Shop holds its mutex)
+ */
+
+#include "AppointmentBook.h"
+
+// --------------------------- Default constructor
+// post: The book is empty and has no barbers
+//
+AppointmentBook::AppointmentBook() :
+   next_id_(0)
+{
+}
+
+// --------------------------- void init(int)
+// pre: None
+// param: num_barbers  Barbers appointments can be booked with
+// post: The book is empty
+//
+void AppointmentBook::init(int num_barbers)
+{
+   by_id_.clear();
+   by_barber_.assign(num_barbers, map<uint64_t, int>());
+}
+
+// --------------------------- int book(int, uint64_t, uint64_t, uint64_t)
+// Reserves a slot if it does not overlap another slot of the barber
+//
+// pre: None
+// param: barbID    Barber to book
+// param: start_ns  Start of the slot
+// param: end_ns    End of the slot
+// param: now_ns    Current monotonic time; earlier slots are purged
+// return: ID of the new appointment, or -1 if the barber does not exist,
+//   the slot is empty, already over or overlaps another one
+//
+int AppointmentBook::book(int barbID, uint64_t start_ns, uint64_t end_ns, uint64_t now_ns)
+{
+   if (barbID < 0 || barbID >= (int)by_barber_.size() || start_ns >= end_ns || end_ns <= now_ns) {
+      return -1;
+   }
+   map<uint64_t, int>& slots = by_barber_[barbID];
+
+   while (!slots.empty() && by_id_[slots.begin()->second].end_ns <= now_ns) {
+      by_id_.erase(slots.begin()->second);                     // Nobody came: drop the old slot
+      slots.erase(slots.begin());
+   }
+
+   map<uint64_t, int>::iterator after = slots.lower_bound(start_ns);
+   if (after != slots.end() && after->first < end_ns) {        // Next slot starts too early
+      return -1;
+   }
+   if (after != slots.begin()) {
+      map<uint64_t, int>::iterator before = after;
+      --before;
+      if (by_id_[before->second].end_ns > start_ns) {          // Previous slot ends too late
+         return -1;
+      }
+   }
+
+   Appointment appt;
+   appt.id = next_id_++;
+   appt.barbID = barbID;
+   appt.start_ns = start_ns;
+   appt.end_ns = end_ns;
+   by_id_[appt.id] = appt;
+   slots.insert(after, make_pair(start_ns, appt.id));
+   return appt.id;
+}
+
+// --------------------------- bool lookup(int, Appointment*)
+// pre: None
+// param: id     Appointment ID
+// param: appt   Receives the appointment
+// return: false if there is no such appointment (anymore)
+//
+bool AppointmentBook::lookup(int id, Appointment* appt) const
+{
+   unordered_map<int, Appointment>::const_iterator it = by_id_.find(id);
+   if (it == by_id_.end()) {
+      return false;
+   }
+   *appt = it->second;
+   return true;
+}
+
+// --------------------------- bool cancel(int)
+// pre: None
+// param: id  Appointment ID
+// return: false if there was no such appointment
+// post: The slot is free again
+//
+bool AppointmentBook::cancel(int id)
+{
+   unordered_map<int, Appointment>::iterator it = by_id_.find(id);
+   if (it == by_id_.end()) {
+      return false;
+   }
+   by_barber_[it->second.barbID].erase(it->second.start_ns);
+   by_id_.erase(it);
+   return true;
+}
+
+// --------------------------- int get_count()
+// pre: None
+// return: Appointments currently booked
+//
+int AppointmentBook::get_count() const
+{
+   return (int)by_id_.size();
+}
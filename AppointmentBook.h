@@ -0,0 +1,96 @@
+/** @file AppointmentBook.h
+ *
+ * AppointmentBook.h file:
+ * Time-indexed book of barber appointments
+ * Each barber's appointments are kept in a balanced search tree ordered
+ *   by start time. A barber's time slots never overlap, so this is an
+ *   interval tree in its simplest form: a new slot only has to be checked
+ *   against its predecessor and successor, and booking, cancelling and
+ *   finding the next appointment are O(log n) in that barber's bookings,
+ *   however many barbers and days of appointments the book holds.
+ * Slots that ended without being used are purged lazily whenever the
+ *   barber books again.
+ *
+ * Assumptions:
+ * Not thread safe; the owner serializes every call (Shop holds its mutex)
+ * Times are nanoseconds on the monotonic clock (see Clock.h)
+ */
+
+#ifndef AppointmentBook_H_
+#define AppointmentBook_H_
+#include <map>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Appointment struct
+// One reserved time slot [start_ns, end_ns) with one barber
+struct Appointment
+{
+   int id;                     // Returned by book(), never reused
+   int barbID;                 // Barber the slot is reserved with
+   uint64_t start_ns;          // Slot starts (the appointment is due)
+   uint64_t end_ns;            // Slot ends; customers arriving later missed it
+};
+
+class AppointmentBook
+{
+public:
+   // --------------------------- Default constructor
+   // post: The book is empty and has no barbers
+   //
+   AppointmentBook();
+
+   // --------------------------- void init(int)
+   // pre: None
+   // param: num_barbers  Barbers appointments can be booked with
+   // post: The book is empty
+   //
+   void init(int num_barbers);
+
+   // --------------------------- int book(int, uint64_t, uint64_t, uint64_t)
+   // Reserves a slot if it does not overlap another slot of the barber
+   //
+   // pre: None
+   // param: barbID    Barber to book
+   // param: start_ns  Start of the slot
+   // param: end_ns    End of the slot
+   // param: now_ns    Current monotonic time; earlier slots are purged
+   // return: ID of the new appointment, or -1 if the barber does not exist,
+   //   the slot is empty, already over or overlaps another one
+   //
+   int book(int barbID, uint64_t start_ns, uint64_t end_ns, uint64_t now_ns);
+
+   // --------------------------- bool lookup(int, Appointment*)
+   // pre: None
+   // param: id     Appointment ID
+   // param: appt   Receives the appointment
+   // return: false if there is no such appointment (anymore)
+   //
+   bool lookup(int id, Appointment* appt) const;
+
+   // --------------------------- bool cancel(int)
+   // pre: None
+   // param: id  Appointment ID
+   // return: false if there was no such appointment
+   // post: The slot is free again
+   //
+   bool cancel(int id);
+
+   // --------------------------- int get_count()
+   // pre: None
+   // return: Appointments currently booked
+   //
+   int get_count() const;
+
+private:
+   int next_id_;                                        // ID of the next booking
+   unordered_map<int, Appointment> by_id_;              // Every booked appointment
+   vector<map<uint64_t, int> > by_barber_;              // Per barber: start_ns -> ID
+
+   AppointmentBook(const AppointmentBook&);
+   AppointmentBook& operator=(const AppointmentBook&);
+};
+#endif
@@ -0,0 +1,180 @@
+/** @file Autoscaler.cpp
+ *
+ * Autoscaler.cpp file:
+ * Hires and retires barbers of a Shop while it is open
+ *
+ * Assumptions:
+ * Only the autoscaler thread hires and retires barbers while it runs
+ */
+
+#include "Autoscaler.h"
+#include "Clock.h"
+
+// --------------------------- Parameter constructor
+// pre: shop outlives the autoscaler
+// param: shop    Shop to scale
+// param: config  When to hire and retire barbers
+// post: The autoscaler is stopped
+//
+Autoscaler::Autoscaler(Shop* shop, const AutoscalerConfig& config) :
+   shop_(shop),
+   config_(config),
+   idle_(0),
+   hired_(0),
+   retired_(0),
+   peak_(0),
+   stopping_(false),
+   running_(false)
+{
+   for (int b = 0; b < kWaitBuckets; b++) {
+      last_hist_[b] = 0;
+   }
+}
+
+// --------------------------- Destructor
+// post: The autoscaler thread is stopped and joined
+//
+Autoscaler::~Autoscaler()
+{
+   stop();
+}
+
+// --------------------------- bool start()
+// pre: The autoscaler is stopped
+// return: false if the thread could not be created
+//
+bool Autoscaler::start()
+{
+   shop_->get_wait_histogram(last_hist_);                      // Only waits from now on count
+   peak_ = shop_->get_working_barbers();
+   stopping_ = false;
+   running_ = (pthread_create(&thread_, NULL, run, this) == 0);
+   return running_;
+}
+
+// --------------------------- void stop()
+// Stops polling; hired barbers keep working until the shop closes
+//
+// pre: None
+// post: The autoscaler thread is joined
+//
+void Autoscaler::stop()
+{
+   if (!running_) {
+      return;
+   }
+   mutex_.lock();
+   stopping_ = true;
+   cond_stop_.signal();
+   mutex_.unlock();
+   pthread_join(thread_, NULL);
+   running_ = false;
+}
+
+// --------------------------- void* run(void*)
+// Thread body: polls until stop()
+//
+void* Autoscaler::run(void* arg)
+{
+   Autoscaler* scaler = (Autoscaler*)arg;
+   uint64_t next_ns = nowNanos() + scaler->config_.interval_ns;
+
+   scaler->mutex_.lock();
+   while (!scaler->stopping_) {
+      scaler->cond_stop_.wait_until(scaler->mutex_, next_ns);
+      if (scaler->stopping_ || nowNanos() < next_ns) {         // Stopped or woken early
+         continue;
+      }
+      scaler->mutex_.unlock();
+      scaler->poll();
+      next_ns += scaler->config_.interval_ns;
+      scaler->mutex_.lock();
+   }
+   scaler->mutex_.unlock();
+   return nullptr;
+}
+
+// --------------------------- void poll()
+// Hires or retires at most one barber
+//
+// pre: Called by the autoscaler thread
+//
+void Autoscaler::poll()
+{
+   int waiting = shop_->get_waiting();
+   uint64_t p99 = windowP99();
+   int working = shop_->get_working_barbers();
+
+   bool busy = waiting >= config_.high_waiting || (config_.p99_ns > 0 && p99 > config_.p99_ns);
+   if (busy) {
+      idle_ = 0;
+      if (working < config_.max_barbers) {
+         int barbID = shop_->addBarber(config_.skills);
+         if (barbID != -1) {                                   // -1: every ID is still finishing
+            config_.start(barbID, config_.context);
+            hires_.push_back(barbID);
+            hired_++;
+            working++;
+         }
+      }
+   }
+   else if (waiting == 0 && ++idle_ >= config_.idle_polls && !hires_.empty()) {
+      idle_ = 0;
+      if (shop_->retireBarber(hires_.back())) {
+         retired_++;
+         working--;
+      }
+      hires_.pop_back();
+   }
+   if (working > peak_) {
+      peak_ = working;
+   }
+}
+
+// --------------------------- uint64_t windowP99()
+// pre: Called by the autoscaler thread
+// return: Upper bound of the p99 wait since the last call, 0 if no
+//   customer was seated
+// post: last_hist_ holds the current histogram
+//
+uint64_t Autoscaler::windowP99()
+{
+   uint64_t hist[kWaitBuckets];
+   shop_->get_wait_histogram(hist);
+   uint64_t total = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      uint64_t count = hist[b] - last_hist_[b];
+      last_hist_[b] = hist[b];
+      hist[b] = count;
+      total += count;
+   }
+   if (total == 0) {
+      return 0;
+   }
+   uint64_t rank = total - total / 100;                        // Customers at or below the p99
+   uint64_t seen = 0;
+   int b = 0;
+   while ((seen += hist[b]) < rank) {
+      b++;
+   }
+   return (b == 0) ? 0 : ((uint64_t)1 << b);
+}
+
+// --------------------------- int get_hired() / get_retired() / get_peak()
+// pre: stop() was called
+// return: Barbers hired, barbers retired, most barbers working at a poll
+//
+int Autoscaler::get_hired() const
+{
+   return hired_;
+}
+
+int Autoscaler::get_retired() const
+{
+   return retired_;
+}
+
+int Autoscaler::get_peak() const
+{
+   return peak_;
+}
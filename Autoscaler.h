@@ -0,0 +1,128 @@
+/** @file Autoscaler.h
+ *
+ * Autoscaler.h file:
+ * Hires and retires barbers of a Shop while it is open
+ * A thread polls the shop every interval. If the waiting room holds at
+ *   least high_waiting customers, or the 99th percentile of the walk-in
+ *   waits since the last poll is above p99_ns, it hires a barber (see
+ *   Shop::addBarber()) and has the owner start a thread for him. After
+ *   idle_polls polls in a row with an empty waiting room it retires the
+ *   barber it hired last (see Shop::retireBarber()); barbers the shop
+ *   opened with are never retired.
+ * The p99 is read from the shop's log2 wait histogram, so it is only
+ *   accurate to a factor of two, which is plenty to tell a queue that is
+ *   building up from one that is not.
+ *
+ * Assumptions:
+ * Only the autoscaler thread hires and retires barbers while it runs
+ * The owner joins the barber threads it starts, after closeShop()
+ */
+
+#ifndef Autoscaler_H_
+#define Autoscaler_H_
+#include <stdint.h>
+#include <vector>
+#include "Shop.h"
+
+using namespace std;
+
+// --------------------------- void BarberStarter(int, void*)
+// Starts a thread that runs the helloCustomer()/byeCustomer() loop
+//
+// param: barbID   ID returned by Shop::addBarber()
+// param: context  AutoscalerConfig::context
+//
+typedef void (*BarberStarter)(int barbID, void* context);
+
+// AutoscalerConfig struct
+// When to hire and retire barbers
+struct AutoscalerConfig
+{
+   int max_barbers;            // Never more barbers working than this
+   int high_waiting;           // Hire once this many customers wait
+   uint64_t p99_ns;            // Hire once the p99 wait is above this (0: ignore waits)
+   int idle_polls;             // Retire after this many polls with nobody waiting
+   uint64_t interval_ns;       // Time between polls
+   uint32_t skills;            // Skill set of hired barbers
+   BarberStarter start;        // Starts the thread of a hired barber
+   void* context;              // Passed to start
+};
+
+class Autoscaler
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: shop outlives the autoscaler
+   // param: shop    Shop to scale
+   // param: config  When to hire and retire barbers
+   // post: The autoscaler is stopped
+   //
+   Autoscaler(Shop* shop, const AutoscalerConfig& config);
+
+   // --------------------------- Destructor
+   // post: The autoscaler thread is stopped and joined
+   //
+   ~Autoscaler();
+
+   // --------------------------- bool start()
+   // pre: The autoscaler is stopped
+   // return: false if the thread could not be created
+   //
+   bool start();
+
+   // --------------------------- void stop()
+   // Stops polling; hired barbers keep working until the shop closes
+   //
+   // pre: None
+   // post: The autoscaler thread is joined
+   //
+   void stop();
+
+   // --------------------------- int get_hired() / get_retired() / get_peak()
+   // pre: stop() was called
+   // return: Barbers hired, barbers retired, most barbers working at a poll
+   //
+   int get_hired() const;
+   int get_retired() const;
+   int get_peak() const;
+
+private:
+   Shop* shop_;
+   AutoscalerConfig config_;
+   vector<int> hires_;                       // Hired barbers still working, newest last
+   uint64_t last_hist_[kWaitBuckets];        // Wait histogram at the previous poll
+   int idle_;                                // Polls in a row with nobody waiting
+   int hired_;
+   int retired_;
+   int peak_;
+
+   PthreadMutex mutex_;                      // Guards stopping_
+   PthreadCond cond_stop_;
+   bool stopping_;
+   bool running_;
+   pthread_t thread_;
+
+   // --------------------------- void* run(void*)
+   // Thread body: polls until stop()
+   //
+   static void* run(void* arg);
+
+   // --------------------------- void poll()
+   // Hires or retires at most one barber
+   //
+   // pre: Called by the autoscaler thread
+   //
+   void poll();
+
+   // --------------------------- uint64_t windowP99()
+   // pre: Called by the autoscaler thread
+   // return: Upper bound of the p99 wait since the last call, 0 if no
+   //   customer was seated
+   // post: last_hist_ holds the current histogram
+   //
+   uint64_t windowP99();
+
+   Autoscaler(const Autoscaler&);
+   Autoscaler& operator=(const Autoscaler&);
+};
+#endif
@@ -0,0 +1,100 @@
+/** @file Bitmap.cpp
+ *
+ * Bitmap.cpp file:
+ * Hierarchical bitmap for finding a set bit among many
+ *
+ * Assumptions:
+ * Not thread safe; the owner serializes every call (Shop holds its mutex)
+ */
+
+#include "Bitmap.h"
+
+// --------------------------- Default constructor
+// post: The bitmap is empty and has no elements
+//
+Bitmap::Bitmap()
+{
+   init(0);
+}
+
+// --------------------------- void init(int)
+// pre: size >= 0
+// param: size  Number of elements
+// post: Every bit is clear
+//
+void Bitmap::init(int size)
+{
+   levels_.clear();
+   size_t words = ((size_t)size + 63) / 64;
+   do {
+      if (words == 0) {
+         words = 1;
+      }
+      levels_.push_back(vector<uint64_t>(words, 0));
+      words = (words + 63) / 64;
+   } while (levels_.back().size() > 1);
+}
+
+// --------------------------- void set(int)
+// Sets the bit and, if its word was zero, the summary bit above it
+//
+// pre: 0 <= i < size
+// param: i  Element to set
+//
+void Bitmap::set(int i)
+{
+   size_t index = (size_t)i;
+   for (size_t l = 0; l < levels_.size(); l++) {
+      uint64_t& word = levels_[l][index / 64];
+      bool was_empty = (word == 0);
+      word |= (uint64_t)1 << (index % 64);
+      if (!was_empty) {                                        // Levels above already know
+         return;
+      }
+      index /= 64;
+   }
+}
+
+// --------------------------- void clear(int)
+// Clears the bit and, if its word became zero, the summary bit above it
+//
+// pre: 0 <= i < size
+// param: i  Element to clear
+//
+void Bitmap::clear(int i)
+{
+   size_t index = (size_t)i;
+   for (size_t l = 0; l < levels_.size(); l++) {
+      uint64_t& word = levels_[l][index / 64];
+      word &= ~((uint64_t)1 << (index % 64));
+      if (word != 0) {                                         // Word still has bits: stop here
+         return;
+      }
+      index /= 64;
+   }
+}
+
+// --------------------------- bool test(int)
+// pre: 0 <= i < size
+// return: Whether bit i is set
+//
+bool Bitmap::test(int i) const
+{
+   return (levels_[0][(size_t)i / 64] >> ((size_t)i % 64)) & 1;
+}
+
+// --------------------------- int first()
+// pre: None
+// return: The lowest set element, or -1 if every bit is clear
+//
+int Bitmap::first() const
+{
+   if (levels_.back()[0] == 0) {
+      return -1;
+   }
+   size_t index = 0;
+   for (size_t l = levels_.size(); l-- > 0; ) {
+      index = index * 64 + __builtin_ctzll(levels_[l][index]);
+   }
+   return (int)index;
+}
@@ -0,0 +1,59 @@
+/** @file Bitmap.h
+ *
+ * Bitmap.h file:
+ * Hierarchical bitmap for finding a set bit among many
+ * Level 0 holds one bit per element; every level above holds one bit per
+ *   64-bit word of the level below, set while that word is non-zero, up
+ *   to a single top word. first() follows count-trailing-zeros down from
+ *   the top, so finding the lowest set bit costs one word per level
+ *   (two levels cover 4096 elements, three 262144) instead of a scan.
+ *
+ * Assumptions:
+ * Not thread safe; the owner serializes every call (Shop holds its mutex)
+ */
+
+#ifndef Bitmap_H_
+#define Bitmap_H_
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+class Bitmap
+{
+public:
+   // --------------------------- Default constructor
+   // post: The bitmap is empty and has no elements
+   //
+   Bitmap();
+
+   // --------------------------- void init(int)
+   // pre: size >= 0
+   // param: size  Number of elements
+   // post: Every bit is clear
+   //
+   void init(int size);
+
+   // --------------------------- void set(int) / void clear(int)
+   // pre: 0 <= i < size
+   // param: i  Element to set or clear
+   //
+   void set(int i);
+   void clear(int i);
+
+   // --------------------------- bool test(int)
+   // pre: 0 <= i < size
+   // return: Whether bit i is set
+   //
+   bool test(int i) const;
+
+   // --------------------------- int first()
+   // pre: None
+   // return: The lowest set element, or -1 if every bit is clear
+   //
+   int first() const;
+
+private:
+   vector<vector<uint64_t> > levels_;        // levels_[0] holds the elements, back() is one word
+};
+#endif
@@ -0,0 +1,45 @@
+/** @file Clock.h
+ *
+ * Clock.h file:
+ * Header-only helpers for reading a monotonic clock
+ * All timestamps taken by the shop, driver and tools come from here
+ *   so they can be compared against each other
+ *
+ * Assumptions:
+ * CLOCK_MONOTONIC is available (Linux / POSIX.1-2008)
+ */
+
+#ifndef Clock_H_
+#define Clock_H_
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+// --------------------------- uint64_t nowNanos()
+// pre: None
+// return: Nanoseconds on the monotonic clock since an arbitrary epoch
+//
+inline uint64_t nowNanos()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// --------------------------- void sleepUntilNanos(uint64_t)
+// Sleeps until the monotonic clock reaches deadline_ns (see nowNanos())
+// Absolute deadlines keep a sequence of sleeps from drifting
+//
+// pre: None
+// param: deadline_ns  Time to wake up at
+// post: nowNanos() >= deadline_ns
+//
+inline void sleepUntilNanos(uint64_t deadline_ns)
+{
+   struct timespec ts;
+   ts.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+   ts.tv_nsec = (long)(deadline_ns % 1000000000ull);
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+   }                                                           // Interrupted by a signal, sleep again
+}
+#endif
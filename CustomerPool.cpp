@@ -0,0 +1,124 @@
+/** @file CustomerPool.cpp
+ *
+ * CustomerPool.cpp file:
+ * Preallocated, recycled storage for per-customer thread parameters
+ *
+ * Assumptions:
+ * acquire() is only called from one thread (the driver's main thread)
+ * release() can be called from any thread
+ */
+
+#include "CustomerPool.h"
+
+// --------------------------- Parameter constructor
+// Preallocates enough chunks to hold capacity slots
+//
+// pre: None
+// param: capacity  Number of slots to preallocate (expected concurrent customers)
+// post: capacity slots (rounded up to whole chunks) are on the free list
+//
+CustomerPool::CustomerPool(int capacity) :
+   num_chunks_(0),
+   free_head_(0)
+{
+   do {
+      grow();
+   } while (get_capacity() < capacity && num_chunks_ < kPoolMaxChunks);
+}
+
+// --------------------------- Destructor
+// Deletes every chunk allocated by this pool
+//
+CustomerPool::~CustomerPool()
+{
+   for (int i = 0; i < num_chunks_; i++) {
+      delete []chunks_[i];
+   }
+}
+
+// --------------------------- CustomerSlot* acquire()
+// Pops a free slot, growing the pool by one chunk if none is free
+//
+// pre: Only called from a single thread
+// return: A slot for a new customer or NULL if kPoolMaxChunks is reached
+//
+CustomerSlot* CustomerPool::acquire()
+{
+   uint64_t head = free_head_.load(memory_order_acquire);
+   while (true) {
+      uint32_t link = (uint32_t)head;
+      if (link == 0) {                                         // Free list is empty
+         if (!grow()) {
+            return NULL;
+         }
+         head = free_head_.load(memory_order_acquire);
+         continue;
+      }
+
+      CustomerSlot* slot = slotAt(link - 1);
+      uint64_t next = ((head >> 32) + 1) << 32 | slot->next;   // Bump the tag on every pop
+      if (free_head_.compare_exchange_weak(head, next, memory_order_acquire,
+                                           memory_order_acquire)) {
+         return slot;
+      }
+   }
+}
+
+// --------------------------- void release(CustomerSlot*)
+// Returns a slot to the free list
+//
+// pre: slot was returned by acquire() and is no longer used
+// param: slot  Slot to recycle
+// post: slot can be handed out again by acquire()
+//
+void CustomerPool::release(CustomerSlot* slot)
+{
+   uint64_t head = free_head_.load(memory_order_relaxed);
+   uint64_t next;
+   do {
+      slot->next = (uint32_t)head;
+      next = (head & 0xffffffff00000000ull) | (slot->index + 1);
+   } while (!free_head_.compare_exchange_weak(head, next, memory_order_release,
+                                              memory_order_relaxed));
+}
+
+// --------------------------- int get_capacity()
+// pre: None
+// return: Number of slots allocated so far
+//
+int CustomerPool::get_capacity() const
+{
+   return num_chunks_ * kPoolChunkSlots;
+}
+
+// --------------------------- bool grow()
+// Allocates one more chunk and pushes its slots onto the free list
+//
+// pre: Only called from the thread that calls acquire()
+// return: false if kPoolMaxChunks chunks already exist
+//
+bool CustomerPool::grow()
+{
+   if (num_chunks_ == kPoolMaxChunks) {
+      return false;
+   }
+
+   CustomerSlot* chunk = new CustomerSlot[kPoolChunkSlots];
+   uint32_t first = (uint32_t)num_chunks_ * kPoolChunkSlots;
+   chunks_[num_chunks_++] = chunk;
+
+   for (int i = 0; i < kPoolChunkSlots; i++) {
+      chunk[i].index = first + i;
+      release(&chunk[i]);
+   }
+   return true;
+}
+
+// --------------------------- CustomerSlot* slotAt(uint32_t)
+// pre: index < get_capacity()
+// return: The slot stored at index
+//
+CustomerSlot* CustomerPool::slotAt(uint32_t index) const
+{
+   return &chunks_[index / kPoolChunkSlots][index % kPoolChunkSlots];
+}
@@ -0,0 +1,104 @@
+/** @file CustomerPool.h
+ *
+ * CustomerPool.h file:
+ * Preallocated, recycled storage for per-customer thread parameters
+ * The driver takes a slot for every arriving customer and the customer
+ *   thread gives it back when it leaves the shop, so the heap allocator
+ *   is not touched on every arrival by many threads at once
+ *
+ * Slots live in fixed-size chunks that are never freed before the pool
+ *   is destroyed. Free slots are kept on a lock-free stack of slot
+ *   indexes whose head carries a tag to rule out ABA on pop.
+ *
+ * Assumptions:
+ * acquire() is only called from one thread (the driver's main thread)
+ * release() can be called from any thread
+ */
+
+#ifndef CustomerPool_H_
+#define CustomerPool_H_
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "Shop.h"
+
+using namespace std;
+
+#define kPoolChunkSlots 256   // slots allocated at a time when the pool grows
+#define kPoolMaxChunks 8192   // upper bound on chunks (2M simultaneous customers)
+
+// CustomerSlot struct
+// Everything a customer thread needs; results go to its CustomerRecord
+struct CustomerSlot
+{
+   Shop* shop;                 // Shop being visited
+   int id;                     // Customer ID (starts at 1)
+   int customer_class;         // CustomerClass
+   uint64_t arrival_ns;        // Monotonic time the customer thread was created
+   bool batched;               // Admitted by the driver with visitShopBatch()
+   int admitted;               // If batched: the visitShopBatch() result
+   Shop::WaitTicket visit;     // If batched: the waiting chair it took
+   uint32_t index;             // Position of this slot in the pool
+   uint32_t next;              // Free-list link (index + 1, 0 ends the list)
+};
+
+class CustomerPool
+{
+public:
+   // --------------------------- Parameter constructor
+   // Preallocates enough chunks to hold capacity slots
+   //
+   // pre: None
+   // param: capacity  Number of slots to preallocate (expected concurrent customers)
+   // post: capacity slots (rounded up to whole chunks) are on the free list
+   //
+   CustomerPool(int capacity);
+
+   // --------------------------- Destructor
+   // Deletes every chunk allocated by this pool
+   //
+   ~CustomerPool();
+
+   // --------------------------- CustomerSlot* acquire()
+   // Pops a free slot, growing the pool by one chunk if none is free
+   //
+   // pre: Only called from a single thread
+   // return: A slot for a new customer or NULL if kPoolMaxChunks is reached
+   //
+   CustomerSlot* acquire();
+
+   // --------------------------- void release(CustomerSlot*)
+   // Returns a slot to the free list
+   //
+   // pre: slot was returned by acquire() and is no longer used
+   // param: slot  Slot to recycle
+   // post: slot can be handed out again by acquire()
+   //
+   void release(CustomerSlot* slot);
+
+   // --------------------------- int get_capacity()
+   // pre: None
+   // return: Number of slots allocated so far
+   //
+   int get_capacity() const;
+
+private:
+   CustomerSlot* chunks_[kPoolMaxChunks];    // Slot storage, kPoolChunkSlots per chunk
+   int num_chunks_;                          // Chunks allocated so far
+   atomic<uint64_t> free_head_;              // (tag << 32) | (index + 1) of first free slot
+
+   // --------------------------- bool grow()
+   // Allocates one more chunk and pushes its slots onto the free list
+   //
+   // pre: Only called from the thread that calls acquire()
+   // return: false if kPoolMaxChunks chunks already exist
+   //
+   bool grow();
+
+   // --------------------------- CustomerSlot* slotAt(uint32_t)
+   // pre: index < get_capacity()
+   // return: The slot stored at index
+   //
+   CustomerSlot* slotAt(uint32_t index) const;
+};
+#endif
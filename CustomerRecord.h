@@ -0,0 +1,60 @@
+/** @file CustomerRecord.h
+ *
+ * CustomerRecord.h file:
+ * Fixed binary layout of the per-customer trace written by the driver
+ * A record file is a RecordFileHeader followed by one CustomerRecord per
+ *   customer, indexed by customer ID - 1. Every field has a fixed width
+ *   and the file is in host byte order, so it can be read back with a
+ *   single mmap or numpy.fromfile without any parsing
+ *
+ * Assumptions:
+ * Readers run on a machine with the same byte order as the writer
+ */
+
+#ifndef CustomerRecord_H_
+#define CustomerRecord_H_
+#include <stdint.h>
+
+#define kRecordMagic "SHOPREC"  // first 8 bytes of a record file (including '\0')
+#define kRecordVersion 2        // bumped whenever CustomerRecord changes
+
+// Outcome of one customer's visit
+enum CustomerOutcome
+{
+   kOutcomeUnknown = 0,        // Customer thread never finished (e.g. not created)
+   kOutcomeServed = 1,         // Got a haircut and paid
+   kOutcomeDropped = 2,        // Left without service
+   kOutcomeReneged = 3         // Gave up waiting (see visitShop patience)
+};
+
+// RecordFileHeader struct
+// Describes the records that follow it (64 bytes)
+struct RecordFileHeader
+{
+   char magic[8];              // kRecordMagic
+   uint32_t version;           // kRecordVersion
+   uint32_t record_size;       // sizeof(CustomerRecord)
+   uint64_t count;             // Number of records in the file
+   uint64_t reserved[5];
+};
+
+// CustomerRecord struct
+// Timestamps are nanoseconds on the monotonic clock (see Clock.h), 0 if the
+// customer never reached that point (64 bytes)
+struct CustomerRecord
+{
+   int32_t customer;           // Customer ID (starts at 1)
+   int32_t barber;             // Barber index (starts at 0) or -1 if dropped
+   uint64_t arrival_ns;        // Customer thread created
+   uint64_t seat_ns;           // Moved to a service chair
+   uint64_t start_ns;          // Barber started the haircut
+   uint64_t end_ns;            // Barber finished the haircut
+   uint64_t leave_ns;          // Paid, or gave up, and left the shop
+   uint32_t outcome;           // CustomerOutcome
+   uint32_t customer_class;    // CustomerClass
+   uint32_t reserved[2];
+};
+
+static_assert(sizeof(RecordFileHeader) == 64, "RecordFileHeader layout changed");
+static_assert(sizeof(CustomerRecord) == 64, "CustomerRecord layout changed");
+#endif
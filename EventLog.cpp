@@ -0,0 +1,332 @@
+/** @file EventLog.cpp
+ *
+ * EventLog.cpp file:
+ * Structured binary log of Shop state transitions
+ *
+ * Assumptions:
+ * The EventLog outlives every thread that logs into it
+ * A thread logs into one EventLog at a time
+ */
+
+#include "EventLog.h"
+#include <sstream>
+#include <string.h>
+#include "Clock.h"
+
+static atomic<uint64_t> next_log_id(1);     // Never reused, unlike addresses
+
+// EventCursor struct
+// The segment a thread is currently filling. The destructor runs when the
+// thread exits and gives the segment back so short-lived customer threads
+// do not each waste most of a segment.
+struct EventCursor
+{
+   EventLog* log;              // Log the segment belongs to, NULL if none
+   uint64_t log_id;            // id of that log when the segment was claimed
+   uint32_t segment;           // Segment owned by this thread
+   uint32_t used;              // Events written into it
+
+   ~EventCursor()
+   {
+      if (log != NULL) {
+         log->retire(log_id, segment, used);
+      }
+   }
+};
+
+static thread_local EventCursor tls_cursor = { NULL, 0, 0, 0 };
+
+// --------------------------- Default constructor
+// pre: None
+// post: Nothing is logged until open() succeeds
+//
+EventLog::EventLog() :
+   events_(NULL),
+   num_segments_(0),
+   id_(0),
+   next_segment_(0),
+   next_seq_(1),
+   dropped_(0)
+{
+   pthread_mutex_init(&partial_mutex_, NULL);
+}
+
+// --------------------------- Destructor
+// Uses close() to write the final counters and unmap the log
+//
+EventLog::~EventLog()
+{
+   close();
+   pthread_mutex_destroy(&partial_mutex_);
+}
+
+// --------------------------- bool open(const string&, uint32_t)
+// Maps a log with room for num_segments segments
+// Each thread that logs holds a segment, so num_segments must cover the
+//   number of threads logging at the same time plus the events expected
+//
+// pre: Nothing is open
+// param: path          File to write to, or "" to keep the log in memory
+// param: num_segments  Segments of kEventSegmentEvents events to reserve
+// return: false if the mapping could not be created (errno is set)
+//
+bool EventLog::open(const string& path, uint32_t num_segments)
+{
+   size_t bytes = sizeof(EventFileHeader)
+                + (size_t)num_segments * kEventSegmentEvents * sizeof(ShopEvent);
+   if (!file_.open(path, bytes)) {
+      return false;
+   }
+
+   EventFileHeader* header = (EventFileHeader*)file_.data();
+   memcpy(header->magic, kEventMagic, sizeof(header->magic));
+   header->version = kEventVersion;
+   header->event_size = sizeof(ShopEvent);
+   header->segment_events = kEventSegmentEvents;
+   header->num_segments = num_segments;
+
+   events_ = (ShopEvent*)(header + 1);
+   num_segments_ = num_segments;
+   id_ = next_log_id.fetch_add(1);
+   next_segment_.store(0);
+   next_seq_.store(1);
+   dropped_.store(0);
+   partial_.clear();
+   return true;
+}
+
+// --------------------------- void close()
+// Writes the counters into the header, then flushes and unmaps the log
+//
+// pre: No thread is logging into this EventLog anymore
+// post: The log file (if any) is complete
+//
+void EventLog::close()
+{
+   if (events_ == NULL) {
+      return;
+   }
+
+   if (tls_cursor.log == this && tls_cursor.log_id == id_) {   // Closing thread may have logged itself
+      tls_cursor.log = NULL;
+   }
+
+   EventFileHeader* header = (EventFileHeader*)file_.data();
+   uint32_t used = next_segment_.load();
+   header->segments_used = (used < num_segments_) ? used : num_segments_;
+   header->events_logged = get_events_logged();
+   header->events_dropped = get_events_dropped();
+
+   file_.close();
+   events_ = NULL;
+   id_ = 0;
+}
+
+// --------------------------- void log(int, int, int, int)
+// Appends one event to the calling thread's segment
+// The event is counted as dropped if no segment is left
+//
+// pre: open() succeeded
+// param: type      ShopEventType
+// param: custID    Customer ID or 0
+// param: barbID    Barber index or -1
+// param: arg       Type-specific argument
+//
+void EventLog::log(int type, int custID, int barbID, int arg)
+{
+   EventCursor& cursor = tls_cursor;
+   if (cursor.log != this || cursor.log_id != id_) {          // First event of this thread in this log
+      if (!claim(&cursor.segment, &cursor.used)) {
+         cursor.log = NULL;
+         dropped_.fetch_add(1, memory_order_relaxed);
+         return;
+      }
+      cursor.log = this;
+      cursor.log_id = id_;
+   }
+   else if (cursor.used == kEventSegmentEvents) {             // Segment is full, move on to another
+      if (!claim(&cursor.segment, &cursor.used)) {
+         cursor.log = NULL;
+         dropped_.fetch_add(1, memory_order_relaxed);
+         return;
+      }
+   }
+
+   ShopEvent& event = events_[(size_t)cursor.segment * kEventSegmentEvents + cursor.used++];
+   event.time_ns = nowNanos();
+   event.seq = next_seq_.fetch_add(1, memory_order_relaxed);
+   event.customer = custID;
+   event.barber = barbID;
+   event.type = (uint16_t)type;
+   event.arg = arg;
+}
+
+// --------------------------- const ShopEvent* segment(uint32_t)
+// pre: index < get_num_segments()
+// return: First of the kEventSegmentEvents events of segment index
+//
+const ShopEvent* EventLog::segment(uint32_t index) const
+{
+   return &events_[(size_t)index * kEventSegmentEvents];
+}
+
+// --------------------------- uint32_t get_num_segments()
+// pre: None
+// return: Number of segments in the log
+//
+uint32_t EventLog::get_num_segments() const
+{
+   return num_segments_;
+}
+
+// --------------------------- uint64_t get_events_logged()
+// pre: None
+// return: Number of events written so far
+//
+uint64_t EventLog::get_events_logged() const
+{
+   return next_seq_.load(memory_order_relaxed) - 1;
+}
+
+// --------------------------- uint64_t get_events_dropped()
+// pre: None
+// return: Number of events lost because every segment was in use
+//
+uint64_t EventLog::get_events_dropped() const
+{
+   return dropped_.load(memory_order_relaxed);
+}
+
+// --------------------------- void retire(uint64_t, uint32_t, uint32_t)
+// Called when a thread stops logging; makes its segment available to
+//   the next thread if the segment still has room
+//
+// pre: The calling thread owns segment index
+// param: log_id  Identity of the log when the segment was claimed
+// param: index   Segment owned by the calling thread
+// param: used    Number of events written into it
+//
+void EventLog::retire(uint64_t log_id, uint32_t index, uint32_t used)
+{
+   if (log_id != id_ || used == kEventSegmentEvents) {        // Log was closed or reopened since
+      return;
+   }
+   pthread_mutex_lock(&partial_mutex_);
+   partial_.push_back(make_pair(index, used));
+   pthread_mutex_unlock(&partial_mutex_);
+}
+
+// --------------------------- bool claim(uint32_t*, uint32_t*)
+// Hands the calling thread a partly used or never used segment
+//
+// pre: None
+// param: index  Receives the segment index
+// param: used   Receives the number of events already in it
+// return: false if every segment is full or owned by another thread
+//
+bool EventLog::claim(uint32_t* index, uint32_t* used)
+{
+   pthread_mutex_lock(&partial_mutex_);
+   if (!partial_.empty()) {
+      *index = partial_.back().first;
+      *used = partial_.back().second;
+      partial_.pop_back();
+      pthread_mutex_unlock(&partial_mutex_);
+      return true;
+   }
+   pthread_mutex_unlock(&partial_mutex_);
+
+   uint32_t next = next_segment_.fetch_add(1, memory_order_relaxed);
+   if (next >= num_segments_) {
+      return false;
+   }
+   *index = next;
+   *used = 0;
+   return true;
+}
+
+// --------------------------- string formatEvent(const ShopEvent&)
+// Renders an event the way Shop prints it, e.g.
+//   customer[3]: takes a waiting chair. # waiting seats available = 1
+//
+// pre: None
+// param: event  Event to render
+// return: The output line without a newline, or "" for events that Shop
+//   does not print (kEventArrive, kEventLeave, unused slots)
+//
+string formatEvent(const ShopEvent& event)
+{
+   stringstream out;
+   switch (event.type) {
+   case kEventWait:
+      out << "customer[" << event.customer << "]: takes a waiting chair. # waiting seats available = "
+          << event.arg;
+      break;
+   case kEventSeat:
+      out << "customer[" << event.customer << "]: moves to service chair[" << event.barber + 1
+          << "], # waiting seats available = " << event.arg;
+      break;
+   case kEventAwait:
+      out << "customer[" << event.customer << "]: wait for barber[" << event.barber + 1
+          << "] to be done with hair-cut";
+      break;
+   case kEventPay:
+      out << "customer[" << event.customer << "]: says good-bye to barber[" << event.barber + 1 << "]";
+      break;
+   case kEventDrop:
+      if (event.arg == kDropDisplaced) {
+         out << "customer[" << event.customer << "]: leaves the shop because a priority customer "
+             << "took the waiting chair.";
+      }
+      else if (event.arg == kDropMissedAppointment) {
+         out << "customer[" << event.customer << "]: leaves the shop because of a missed appointment.";
+      }
+      else if (event.arg == kDropNoSkill) {
+         out << "customer[" << event.customer << "]: leaves the shop because no barber offers the service.";
+      }
+      else if (event.arg == kDropBarberAway) {
+         out << "customer[" << event.customer << "]: leaves the shop because their barber is not working.";
+      }
+      else {
+         out << "customer[" << event.customer << "]: leaves the shop because of no available "
+             << ((event.arg == kDropNoServiceChair) ? "service chairs." : "waiting chairs.");
+      }
+      break;
+   case kEventStart:
+      out << "barber  [" << event.barber + 1 << "]: starts a hair-cut service for customer["
+          << event.customer << "]";
+      break;
+   case kEventDone:
+      out << "barber  [" << event.barber + 1 << "]: says he's done with a hair-cut service for customer["
+          << event.customer << "]";
+      break;
+   case kEventSleep:
+      out << "barber  [" << event.barber + 1 << "]: sleeps because of no customers.";
+      break;
+   case kEventNext:
+      out << "barber  [" << event.barber + 1 << "]: calls in another customer";
+      break;
+   case kEventRenege:
+      out << "customer[" << event.customer << "]: runs out of patience and leaves the shop.";
+      break;
+   case kEventHire:
+      out << "barber  [" << event.barber + 1 << "]: starts working";
+      break;
+   case kEventRetire:
+      out << "barber  [" << event.barber + 1 << "]: takes no more customers";
+      break;
+   case kEventOffShift:
+      out << "barber  [" << event.barber + 1 << "]: goes home";
+      break;
+   case kEventResize:
+      out << "shop       : waiting room now has " << event.arg << " chairs";
+      break;
+   case kEventCheckIn:
+      out << "customer[" << event.customer << "]: checks in for appointment " << event.arg
+          << " with barber[" << event.barber + 1 << "]";
+      break;
+   default:                                                    // Not printed by Shop
+      break;
+   }
+   return out.str();
+}
@@ -0,0 +1,221 @@
+/** @file EventLog.h
+ *
+ * EventLog.h file:
+ * Structured binary log of Shop state transitions
+ * Every transition is one fixed-size ShopEvent written into a memory
+ *   mapped file (or anonymous memory), so logging costs a timestamp and
+ *   a 32 byte store instead of formatting a line of text
+ *
+ * The file is a EventFileHeader followed by fixed-size segments of
+ *   kEventSegmentEvents events. Each thread owns one segment at a time,
+ *   so threads never share a cache line while logging. When a thread
+ *   exits its partly used segment is handed to the next thread that
+ *   starts logging. Unused slots are left zeroed (type kEventNone).
+ * A global sequence number orders events across segments; formatEvent()
+ *   renders an event as the same line Shop has always printed.
+ *
+ * Assumptions:
+ * The EventLog outlives every thread that logs into it
+ * A thread logs into one EventLog at a time
+ */
+
+#ifndef EventLog_H_
+#define EventLog_H_
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+using namespace std;
+
+#define kEventMagic "SHOPEVT"    // first 8 bytes of an event file (including '\0')
+#define kEventVersion 1          // bumped whenever ShopEvent changes
+#define kEventSegmentEvents 64   // events per segment (2 KB)
+
+// Shop state transitions
+enum ShopEventType
+{
+   kEventNone = 0,             // Unused slot
+   kEventArrive,               // Customer enters visitShop            arg: CustomerClass
+   kEventWait,                 // Customer takes a waiting chair       arg: waiting seats available
+   kEventSeat,                 // Customer moves to a service chair    arg: waiting seats available
+   kEventAwait,                // Customer waits for the haircut to finish
+   kEventStart,                // Barber starts the haircut
+   kEventDone,                 // Barber finishes the haircut
+   kEventPay,                  // Customer pays and says good-bye
+   kEventLeave,                // Customer walks out of the shop (served or not)
+   kEventDrop,                 // Customer leaves without service      arg: ShopDropReason
+   kEventSleep,                // Barber sleeps because of no customers
+   kEventNext,                 // Barber calls in another customer
+   kEventRenege,               // Customer runs out of patience        arg: waiting seats available
+   kEventCheckIn,              // Customer waits for a booked barber   arg: appointment ID
+   kEventHire,                 // Barber starts working               arg: skill set
+   kEventRetire,               // Barber takes no more walk-ins
+   kEventOffShift,             // Retired barber leaves with an empty chair
+   kEventResize,               // Waiting room resized                arg: waiting chairs
+   kEventTypes
+};
+
+// Why a customer was dropped (kEventDrop arg)
+enum ShopDropReason
+{
+   kDropNoWaitingChair = 0,    // Every waiting chair was taken
+   kDropNoServiceChair = 1,    // No service chair was free (after waiting, or no waiting room)
+   kDropClassFull = 2,         // The customer's class used all of its waiting chairs
+   kDropDisplaced = 3,         // Gave up a waiting chair to a higher class customer
+   kDropMissedAppointment = 4, // Came after the booked slot ended, or without a booking
+   kDropNoSkill = 5,           // No barber performs the service the customer wants
+   kDropBarberAway = 6         // The booked barber is not working
+};
+
+// ShopEvent struct (32 bytes)
+struct ShopEvent
+{
+   uint64_t time_ns;           // Monotonic time (see Clock.h)
+   uint64_t seq;               // Global order of events in this log, starting at 1
+   int32_t customer;           // Customer ID or 0
+   int32_t barber;             // Barber index or -1
+   uint16_t type;              // ShopEventType
+   uint16_t reserved;
+   int32_t arg;                // Type-specific argument
+};
+
+// EventFileHeader struct (64 bytes)
+struct EventFileHeader
+{
+   char magic[8];              // kEventMagic
+   uint32_t version;           // kEventVersion
+   uint32_t event_size;        // sizeof(ShopEvent)
+   uint32_t segment_events;    // Events per segment
+   uint32_t num_segments;      // Segments in the file
+   uint32_t segments_used;     // Segments handed to threads (written by close())
+   uint32_t reserved0;
+   uint64_t events_logged;     // Written by close()
+   uint64_t events_dropped;    // Events lost because every segment was in use
+   uint64_t reserved[2];
+};
+
+static_assert(sizeof(ShopEvent) == 32, "ShopEvent layout changed");
+static_assert(sizeof(EventFileHeader) == 64, "EventFileHeader layout changed");
+
+class EventLog
+{
+public:
+   // --------------------------- Default constructor
+   // pre: None
+   // post: Nothing is logged until open() succeeds
+   //
+   EventLog();
+
+   // --------------------------- Destructor
+   // Uses close() to write the final counters and unmap the log
+   //
+   ~EventLog();
+
+   // --------------------------- bool open(const string&, uint32_t)
+   // Maps a log with room for num_segments segments
+   // Each thread that logs holds a segment, so num_segments must cover the
+   //   number of threads logging at the same time plus the events expected
+   //
+   // pre: Nothing is open
+   // param: path          File to write to, or "" to keep the log in memory
+   // param: num_segments  Segments of kEventSegmentEvents events to reserve
+   // return: false if the mapping could not be created (errno is set)
+   //
+   bool open(const string& path, uint32_t num_segments);
+
+   // --------------------------- void close()
+   // Writes the counters into the header, then flushes and unmaps the log
+   //
+   // pre: No thread is logging into this EventLog anymore
+   // post: The log file (if any) is complete
+   //
+   void close();
+
+   // --------------------------- void log(int, int, int, int)
+   // Appends one event to the calling thread's segment
+   // The event is counted as dropped if no segment is left
+   //
+   // pre: open() succeeded
+   // param: type      ShopEventType
+   // param: custID    Customer ID or 0
+   // param: barbID    Barber index or -1
+   // param: arg       Type-specific argument
+   //
+   void log(int type, int custID, int barbID, int arg);
+
+   // --------------------------- const ShopEvent* segment(uint32_t)
+   // pre: index < get_num_segments()
+   // return: First of the kEventSegmentEvents events of segment index
+   //
+   const ShopEvent* segment(uint32_t index) const;
+
+   // --------------------------- uint32_t get_num_segments()
+   // pre: None
+   // return: Number of segments in the log
+   //
+   uint32_t get_num_segments() const;
+
+   // --------------------------- uint64_t get_events_logged()
+   // pre: None
+   // return: Number of events written so far
+   //
+   uint64_t get_events_logged() const;
+
+   // --------------------------- uint64_t get_events_dropped()
+   // pre: None
+   // return: Number of events lost because every segment was in use
+   //
+   uint64_t get_events_dropped() const;
+
+   // --------------------------- void retire(uint64_t, uint32_t, uint32_t)
+   // Called when a thread stops logging; makes its segment available to
+   //   the next thread if the segment still has room
+   //
+   // pre: The calling thread owns segment index
+   // param: log_id  Identity of the log when the segment was claimed
+   // param: index   Segment owned by the calling thread
+   // param: used    Number of events written into it
+   //
+   void retire(uint64_t log_id, uint32_t index, uint32_t used);
+
+private:
+   MappedFile file_;                         // Header + segments
+   ShopEvent* events_;                       // First event of segment 0
+   uint32_t num_segments_;                   // Segments in the file
+   uint64_t id_;                             // Distinguishes logs opened at the same address
+   atomic<uint32_t> next_segment_;           // Next never-used segment
+   atomic<uint64_t> next_seq_;               // Next sequence number
+   atomic<uint64_t> dropped_;                // Events lost because no segment was free
+
+   // Partly used segments given back by threads that stopped logging
+   pthread_mutex_t partial_mutex_;
+   vector<pair<uint32_t, uint32_t> > partial_;
+
+   // --------------------------- bool claim(uint32_t*, uint32_t*)
+   // Hands the calling thread a partly used or never used segment
+   //
+   // pre: None
+   // param: index  Receives the segment index
+   // param: used   Receives the number of events already in it
+   // return: false if every segment is full or owned by another thread
+   //
+   bool claim(uint32_t* index, uint32_t* used);
+
+   EventLog(const EventLog&);                // Not copyable
+   EventLog& operator=(const EventLog&);
+};
+
+// --------------------------- string formatEvent(const ShopEvent&)
+// Renders an event the way Shop prints it, e.g.
+//   customer[3]: takes a waiting chair. # waiting seats available = 1
+//
+// pre: None
+// param: event  Event to render
+// return: The output line without a newline, or "" for events that Shop
+//   does not print (kEventArrive, kEventLeave, unused slots)
+//
+string formatEvent(const ShopEvent& event);
+#endif
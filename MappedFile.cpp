@@ -0,0 +1,106 @@
+/** @file MappedFile.cpp
+ *
+ * MappedFile.cpp file:
+ * A fixed-size region of memory that is optionally backed by a file
+ *
+ * Assumptions:
+ * The size is known before any thread writes into the region
+ */
+
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// --------------------------- Default constructor
+// pre: None
+// post: Nothing is mapped until open() succeeds
+//
+MappedFile::MappedFile() :
+   data_(NULL),
+   size_(0),
+   fd_(-1)
+{
+}
+
+// --------------------------- Destructor
+// Flushes and unmaps the region if one is open
+//
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+// --------------------------- bool open(const string&, size_t)
+// Maps size zero-filled bytes, backed by a file at path that is created
+//   or truncated, or by anonymous memory if path is empty
+//
+// pre: Nothing is open
+// param: path  File to write to, or "" for anonymous memory
+// param: size  Number of bytes to map
+// post: data() points to size writable bytes
+// return: false if the file or mapping could not be created (errno is set)
+//
+bool MappedFile::open(const string& path, size_t size)
+{
+   int flags = MAP_SHARED;
+   if (path.empty()) {
+      flags |= MAP_ANONYMOUS;
+   }
+   else {
+      fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (fd_ < 0 || ftruncate(fd_, size) != 0) {              // Sparse file, pages are filled as they are touched
+         close();
+         return false;
+      }
+   }
+
+   void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd_, 0);
+   if (data == MAP_FAILED) {
+      close();
+      return false;
+   }
+   data_ = data;
+   size_ = size;
+   return true;
+}
+
+// --------------------------- void close()
+// Flushes a file-backed region to disk and unmaps it
+//
+// pre: None
+// post: data() is NULL
+//
+void MappedFile::close()
+{
+   if (data_ != NULL) {
+      if (fd_ >= 0) {
+         msync(data_, size_, MS_SYNC);
+      }
+      munmap(data_, size_);
+      data_ = NULL;
+      size_ = 0;
+   }
+   if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+   }
+}
+
+// --------------------------- void* data()
+// pre: None
+// return: Start of the mapped region or NULL if nothing is open
+//
+void* MappedFile::data() const
+{
+   return data_;
+}
+
+// --------------------------- size_t size()
+// pre: None
+// return: Number of bytes mapped
+//
+size_t MappedFile::size() const
+{
+   return size_;
+}
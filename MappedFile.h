@@ -0,0 +1,75 @@
+/** @file MappedFile.h
+ *
+ * MappedFile.h file:
+ * A fixed-size region of memory that is optionally backed by a file
+ * Threads write trace data straight into the mapping, so exporting it
+ *   costs no formatting or copying: the kernel writes the pages back
+ *   to the file when the mapping is flushed or closed
+ * Without a path the region is anonymous memory of the same layout
+ *
+ * Assumptions:
+ * The size is known before any thread writes into the region
+ */
+
+#ifndef MappedFile_H_
+#define MappedFile_H_
+#include <stddef.h>
+#include <string>
+
+using namespace std;
+
+class MappedFile
+{
+public:
+   // --------------------------- Default constructor
+   // pre: None
+   // post: Nothing is mapped until open() succeeds
+   //
+   MappedFile();
+
+   // --------------------------- Destructor
+   // Flushes and unmaps the region if one is open
+   //
+   ~MappedFile();
+
+   // --------------------------- bool open(const string&, size_t)
+   // Maps size zero-filled bytes, backed by a file at path that is created
+   //   or truncated, or by anonymous memory if path is empty
+   //
+   // pre: Nothing is open
+   // param: path  File to write to, or "" for anonymous memory
+   // param: size  Number of bytes to map
+   // post: data() points to size writable bytes
+   // return: false if the file or mapping could not be created (errno is set)
+   //
+   bool open(const string& path, size_t size);
+
+   // --------------------------- void close()
+   // Flushes a file-backed region to disk and unmaps it
+   //
+   // pre: None
+   // post: data() is NULL
+   //
+   void close();
+
+   // --------------------------- void* data()
+   // pre: None
+   // return: Start of the mapped region or NULL if nothing is open
+   //
+   void* data() const;
+
+   // --------------------------- size_t size()
+   // pre: None
+   // return: Number of bytes mapped
+   //
+   size_t size() const;
+
+private:
+   void* data_;                              // Start of the mapping
+   size_t size_;                             // Length of the mapping
+   int fd_;                                  // Backing file or -1 if anonymous
+
+   MappedFile(const MappedFile&);            // Not copyable
+   MappedFile& operator=(const MappedFile&);
+};
+#endif
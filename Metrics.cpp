@@ -0,0 +1,112 @@
+/** @file Metrics.cpp
+ *
+ * Metrics.cpp file:
+ * Sharded counters of Shop transitions that can be read at any time
+ *
+ * Assumptions:
+ * C++11 atomics and thread_local
+ */
+
+#include "Metrics.h"
+#include "Clock.h"
+
+// --------------------------- Default constructor
+// post: Every counter is zero
+//
+ShopMetrics::ShopMetrics()
+{
+   for (int s = 0; s < kMetricShards; s++) {
+      for (int m = 0; m < kMetricCount; m++) {
+         shards_[s].counters[m].store(0, memory_order_relaxed);
+      }
+      for (int b = 0; b < kWaitBuckets; b++) {
+         shards_[s].wait_buckets[b].store(0, memory_order_relaxed);
+      }
+      shards_[s].wait_sum_ns.store(0, memory_order_relaxed);
+   }
+}
+
+// --------------------------- void addWait(uint64_t)
+// pre: None
+// param: wait_ns  Wait of one walk-in customer
+// post: The wait is counted in the calling thread's histogram shard
+//
+void ShopMetrics::addWait(uint64_t wait_ns)
+{
+   Shard& shard = shards_[shardIndex()];
+   int bucket = (wait_ns == 0) ? 0 : 64 - __builtin_clzll(wait_ns);
+   shard.wait_buckets[(bucket < kWaitBuckets) ? bucket : kWaitBuckets - 1].fetch_add(1, memory_order_relaxed);
+   shard.wait_sum_ns.fetch_add(wait_ns, memory_order_relaxed);
+}
+
+// --------------------------- int shardIndex()
+// pre: None
+// return: Shard of the calling thread, assigned on its first call
+//
+int ShopMetrics::shardIndex()
+{
+   static atomic<unsigned> next_shard(0);
+   static thread_local int shard = -1;
+   if (shard < 0) {
+      shard = (int)(next_shard.fetch_add(1, memory_order_relaxed) % kMetricShards);
+   }
+   return shard;
+}
+
+// --------------------------- void collect(uint64_t*)
+// pre: None
+// param: totals  Receives every counter summed over the shards, later
+//   stages first
+//
+void ShopMetrics::collect(uint64_t* totals) const
+{
+   for (int m = kMetricCount; m-- > 0; ) {
+      totals[m] = 0;
+      for (int s = 0; s < kMetricShards; s++) {
+         totals[m] += shards_[s].counters[m].load(memory_order_acquire);
+      }
+   }
+}
+
+// --------------------------- void snapshot(MetricsSnapshot*)
+// Sums the shards, later stages first, until two sums agree (see Metrics.h)
+//
+// pre: None
+// param: snap  Receives the counters and gauges
+//
+void ShopMetrics::snapshot(MetricsSnapshot* snap) const
+{
+   uint64_t totals[kMetricCount];
+   uint64_t again[kMetricCount];
+   collect(totals);
+   snap->exact = false;
+   for (int tries = 1; tries < kSnapshotTries && !snap->exact; tries++) {
+      collect(again);
+      snap->exact = true;
+      for (int m = 0; m < kMetricCount; m++) {
+         snap->exact = snap->exact && again[m] == totals[m];
+         totals[m] = again[m];
+      }
+   }
+   snap->time_ns = nowNanos();
+   snap->arrivals = totals[kMetricArrivals];
+   snap->waited = totals[kMetricWaited];
+   snap->seated = totals[kMetricSeated];
+   snap->served = totals[kMetricServed];
+   snap->dropped = totals[kMetricDropped];
+   snap->reneged = totals[kMetricReneged];
+   snap->waiting = (int64_t)(totals[kMetricWaited] - totals[kMetricUnwaited]);
+   snap->busy = (int64_t)(totals[kMetricSeated] - totals[kMetricFreed]);
+   snap->sleeping = (int64_t)(totals[kMetricSleeps] - totals[kMetricWakeups]);
+   snap->working = (int64_t)(totals[kMetricShiftStarts] - totals[kMetricShiftEnds]);
+   snap->wait_sum_ns = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      snap->wait_buckets[b] = 0;
+   }
+   for (int s = 0; s < kMetricShards; s++) {
+      for (int b = 0; b < kWaitBuckets; b++) {
+         snap->wait_buckets[b] += shards_[s].wait_buckets[b].load(memory_order_relaxed);
+      }
+      snap->wait_sum_ns += shards_[s].wait_sum_ns.load(memory_order_relaxed);
+   }
+}
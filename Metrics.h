@@ -0,0 +1,139 @@
+/** @file Metrics.h
+ *
+ * Metrics.h file:
+ * Sharded counters of Shop transitions that can be read at any time
+ * Every thread adds to its own cache-line aligned shard (threads are
+ *   spread over kMetricShards shards round robin), so counting is one
+ *   uncontended atomic add and never touches the shop's mutex.
+ * Gauges are not stored as values that go up and down: each one is a
+ *   pair of counters, e.g. waiting = waited - unwaited and busy = seated
+ *   - freed. A customer is always counted at an earlier stage before a
+ *   later one (ShopMetric order: arrived before waited before unwaited
+ *   before seated, ...), additions are releases and snapshot() acquires
+ *   the later stages first. A snapshot can therefore miss the newest
+ *   transitions but never sees a later stage without the earlier one:
+ *   gauges are never negative, and arrivals always cover seated +
+ *   dropped + reneged + the customers still waiting.
+ * Transitions counted while the shards are being summed can still make a
+ *   gauge read high. snapshot() therefore sums the shards again; counters
+ *   only grow, so if both sums agree every counter had exactly that value
+ *   at one instant in between, and the snapshot is marked exact. It gives
+ *   up after kSnapshotTries sums and returns the last, ordered one.
+ * Walk-in waits are also counted in a sharded log2 histogram. It is read
+ *   once per snapshot, after the counters, so it is at least as recent.
+ *
+ * Assumptions:
+ * C++11 atomics and thread_local
+ */
+
+#ifndef Metrics_H_
+#define Metrics_H_
+#include <atomic>
+#include <stdint.h>
+
+using namespace std;
+
+#define kMetricShards 16        // shards of every counter; threads beyond this share them
+#define kSnapshotTries 4        // sums snapshot() takes at most to find two that agree
+#define kWaitBuckets 64         // wait-time histogram buckets, bucket b holds waits below 2^b ns
+
+// Counters, in the order a customer or barber reaches them
+enum ShopMetric
+{
+   kMetricArrivals,            // Customers who came in
+   kMetricWaited,              // Customers who took a waiting chair
+   kMetricUnwaited,            // Customers who left their waiting chair
+   kMetricSeated,              // Customers who sat in a service chair
+   kMetricServed,              // Customers who paid
+   kMetricDropped,             // Customers turned away or dropped while waiting
+   kMetricReneged,             // Customers who ran out of patience
+   kMetricFreed,               // Service chairs given up after a haircut
+   kMetricSleeps,              // Barbers who went to sleep
+   kMetricWakeups,             // Barbers who woke up
+   kMetricShiftStarts,         // Barbers who started working (at opening or hired)
+   kMetricShiftEnds,           // Barbers who retired
+   kMetricCount
+};
+
+// MetricsSnapshot struct
+// Sum of every shard at one point in time
+struct MetricsSnapshot
+{
+   uint64_t time_ns;           // When the snapshot was taken
+   uint64_t arrivals;
+   uint64_t waited;
+   uint64_t seated;
+   uint64_t served;
+   uint64_t dropped;
+   uint64_t reneged;
+   int64_t waiting;            // Gauge: customers in waiting chairs
+   int64_t busy;               // Gauge: barbers with a customer in their chair
+   int64_t sleeping;           // Gauge: barbers asleep
+   int64_t working;            // Gauge: barbers working and not retiring
+   uint64_t wait_buckets[kWaitBuckets]; // Walk-in waits, bucket b below 2^b ns (bucket 0: no wait)
+   uint64_t wait_sum_ns;       // Sum of those waits
+   bool exact;                 // Every value held at one instant (see above)
+};
+
+class ShopMetrics
+{
+public:
+   // --------------------------- Default constructor
+   // post: Every counter is zero
+   //
+   ShopMetrics();
+
+   // --------------------------- void add(int, uint64_t)
+   // pre: 0 <= metric < kMetricCount
+   // param: metric  ShopMetric to count
+   // param: n       Amount to add
+   // post: The calling thread's shard of metric is increased by n
+   //
+   void add(int metric, uint64_t n = 1)
+   {
+      shards_[shardIndex()].counters[metric].fetch_add(n, memory_order_release);
+   };
+
+   // --------------------------- void addWait(uint64_t)
+   // pre: None
+   // param: wait_ns  Wait of one walk-in customer
+   // post: The wait is counted in the calling thread's histogram shard
+   //
+   void addWait(uint64_t wait_ns);
+
+   // --------------------------- void snapshot(MetricsSnapshot*)
+   // Sums the shards, later stages first, until two sums agree (see above)
+   //
+   // pre: None
+   // param: snap  Receives the counters and gauges
+   //
+   void snapshot(MetricsSnapshot* snap) const;
+
+private:
+   // Shard struct
+   // One thread's (or a few threads') counters, alone on its cache lines
+   struct alignas(64) Shard
+   {
+      atomic<uint64_t> counters[kMetricCount];
+      atomic<uint64_t> wait_buckets[kWaitBuckets];
+      atomic<uint64_t> wait_sum_ns;
+   };
+   Shard shards_[kMetricShards];
+
+   // --------------------------- int shardIndex()
+   // pre: None
+   // return: Shard of the calling thread, assigned on its first call
+   //
+   static int shardIndex();
+
+   // --------------------------- void collect(uint64_t*)
+   // pre: None
+   // param: totals  Receives every counter summed over the shards, later
+   //   stages first
+   //
+   void collect(uint64_t* totals) const;
+
+   ShopMetrics(const ShopMetrics&);
+   ShopMetrics& operator=(const ShopMetrics&);
+};
+#endif
@@ -0,0 +1,325 @@
+/** @file MetricsExporter.cpp
+ *
+ * MetricsExporter.cpp file:
+ * Serves a Shop's metrics in the Prometheus text format
+ *
+ * Assumptions:
+ * POSIX sockets and poll()
+ * The shop and its metrics outlive the exporter
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "MetricsExporter.h"
+
+// --------------------------- Parameter constructor
+// pre: shop has metrics attached (see Shop::set_metrics())
+// param: shop     Shop whose waiting room size is exported
+// param: metrics  Counters to export
+// post: The exporter is stopped
+//
+MetricsExporter::MetricsExporter(const Shop* shop, const ShopMetrics* metrics) :
+   shop_(shop),
+   metrics_(metrics),
+   listen_fd_(-1),
+   running_(false)
+{
+   wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+// --------------------------- Destructor
+// post: The exporter thread is stopped and joined
+//
+MetricsExporter::~MetricsExporter()
+{
+   stop();
+}
+
+// --------------------------- bool start(const string&)
+// pre: The exporter is stopped
+// param: address  "PORT", "127.0.0.1:PORT" or a Unix socket path
+// return: false if the socket or thread could not be created (errno is set)
+//
+bool MetricsExporter::start(const string& address)
+{
+   listen_fd_ = listenOn(address);
+   if (listen_fd_ < 0) {
+      return false;
+   }
+   if (pipe(wake_fd_) != 0) {
+      int err = errno;
+      stop();
+      errno = err;
+      return false;
+   }
+   int err = pthread_create(&thread_, NULL, run, this);
+   if (err != 0) {
+      stop();
+      errno = err;
+      return false;
+   }
+   running_ = true;
+   return true;
+}
+
+// --------------------------- void stop()
+// pre: None
+// post: The exporter thread is joined and the socket closed
+//
+void MetricsExporter::stop()
+{
+   if (running_) {
+      char wake = 0;
+      while (write(wake_fd_[1], &wake, 1) < 0 && errno == EINTR) {}
+      pthread_join(thread_, NULL);
+      running_ = false;
+   }
+   for (int i = 0; i < 2; i++) {
+      if (wake_fd_[i] >= 0) {
+         close(wake_fd_[i]);
+         wake_fd_[i] = -1;
+      }
+   }
+   if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      listen_fd_ = -1;
+   }
+   if (!unix_path_.empty()) {
+      unlink(unix_path_.c_str());
+      unix_path_.clear();
+   }
+}
+
+// --------------------------- int listenOn(const string&)
+// pre: None
+// param: address  See start()
+// return: Listening socket, -1 on error (errno is set)
+//
+int MetricsExporter::listenOn(const string& address)
+{
+   int fd;
+   if (address.find('/') != string::npos) {
+      sockaddr_un addr;
+      if (address.size() >= sizeof(addr.sun_path)) {
+         errno = ENAMETOOLONG;
+         return -1;
+      }
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strcpy(addr.sun_path, address.c_str());
+      fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0) {
+         return -1;
+      }
+      unlink(address.c_str());                                 // Left behind by an earlier run
+      if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+         int err = errno;
+         close(fd);
+         errno = err;
+         return -1;
+      }
+      unix_path_ = address;
+   }
+   else {
+      size_t colon = address.rfind(':');
+      string host = (colon == string::npos) ? "127.0.0.1" : address.substr(0, colon);
+      char* end;
+      long port = strtol(address.c_str() + ((colon == string::npos) ? 0 : colon + 1), &end, 10);
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons((uint16_t)port);
+      if (*end != '\0' || port < 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+         errno = EINVAL;
+         return -1;
+      }
+      fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0) {
+         return -1;
+      }
+      int reuse = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+      if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+         int err = errno;
+         close(fd);
+         errno = err;
+         return -1;
+      }
+   }
+   if (listen(fd, kExporterBacklog) != 0) {
+      int err = errno;
+      close(fd);
+      errno = err;
+      return -1;
+   }
+   return fd;
+}
+
+// --------------------------- void* run(void*)
+// Thread body: answers scrapes until stop()
+//
+void* MetricsExporter::run(void* arg)
+{
+   MetricsExporter* exporter = (MetricsExporter*)arg;
+   pollfd fds[2];
+   fds[0].fd = exporter->listen_fd_;
+   fds[0].events = POLLIN;
+   fds[1].fd = exporter->wake_fd_[0];
+   fds[1].events = POLLIN;
+
+   while (true) {
+      if (poll(fds, 2, -1) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         break;
+      }
+      if (fds[1].revents != 0) {                               // stop()
+         break;
+      }
+      if (fds[0].revents & POLLIN) {
+         int fd = accept(exporter->listen_fd_, NULL, NULL);
+         if (fd >= 0) {
+            exporter->answer(fd);
+         }
+      }
+   }
+   return nullptr;
+}
+
+// --------------------------- void answer(int)
+// Reads the request line and sends the metrics, or 404 for any other path
+// MSG_NOSIGNAL: a client that hangs up early fails this send() with EPIPE
+//   instead of raising SIGPIPE in the embedding process
+//
+// pre: fd is a connected client
+// post: The client got a response and fd is closed
+//
+void MetricsExporter::answer(int fd) const
+{
+   char request[1024];
+   size_t length = 0;
+   pollfd client;
+   client.fd = fd;
+   client.events = POLLIN;
+   while (length < sizeof(request) - 1 && memchr(request, '\n', length) == NULL) {
+      if (poll(&client, 1, kExporterTimeoutMs) <= 0) {         // Silent or broken client
+         close(fd);
+         return;
+      }
+      ssize_t n = read(fd, request + length, sizeof(request) - 1 - length);
+      if (n <= 0) {
+         close(fd);
+         return;
+      }
+      length += (size_t)n;
+   }
+   request[length] = '\0';
+
+   string status;
+   string body;
+   if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+      status = "200 OK";
+      body = render();
+   }
+   else {
+      status = "404 Not Found";
+      body = "Try GET /metrics\n";
+   }
+   char header[160];
+   snprintf(header, sizeof(header),
+            "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+            "Connection: close\r\n\r\n", status.c_str(), body.size());
+   string response = header + body;
+   const char* data = response.data();
+   size_t left = response.size();
+   while (left > 0) {
+      ssize_t n = send(fd, data, left, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n <= 0) {
+         break;
+      }
+      data += n;
+      left -= (size_t)n;
+   }
+   close(fd);
+}
+
+// --------------------------- void appendMetric(string*, ...)
+// Appends one metric with its HELP and TYPE lines
+//
+// pre: None
+// param: out    Text to append to
+// param: name   Metric name
+// param: type   "counter" or "gauge"
+// param: help   One line description
+// param: value  Current value
+//
+static void appendMetric(string* out, const char* name, const char* type, const char* help, double value)
+{
+   char line[256];
+   snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+   *out += line;
+}
+
+// --------------------------- string render()
+// pre: None
+// return: One snapshot in the Prometheus text format
+//
+string MetricsExporter::render() const
+{
+   MetricsSnapshot snap;
+   metrics_->snapshot(&snap);
+   string out;
+   appendMetric(&out, "shop_customers_arrived_total", "counter", "Customers who came in", snap.arrivals);
+   appendMetric(&out, "shop_customers_waited_total", "counter", "Customers who took a waiting chair", snap.waited);
+   appendMetric(&out, "shop_customers_seated_total", "counter", "Customers who sat in a service chair", snap.seated);
+   appendMetric(&out, "shop_customers_served_total", "counter", "Customers who paid", snap.served);
+   appendMetric(&out, "shop_customers_dropped_total", "counter",
+                "Customers turned away or dropped while waiting", snap.dropped);
+   appendMetric(&out, "shop_customers_reneged_total", "counter",
+                "Customers who ran out of patience", snap.reneged);
+   appendMetric(&out, "shop_waiting_customers", "gauge", "Customers in waiting chairs", snap.waiting);
+   appendMetric(&out, "shop_waiting_chairs", "gauge", "Waiting chairs", shop_->get_chairs());
+   appendMetric(&out, "shop_barbers_busy", "gauge", "Barbers with a customer in their chair", snap.busy);
+   appendMetric(&out, "shop_barbers_sleeping", "gauge", "Barbers asleep", snap.sleeping);
+   appendMetric(&out, "shop_barbers_working", "gauge", "Barbers working and not retiring", snap.working);
+   appendMetric(&out, "shop_barber_utilization", "gauge", "Busy barbers over working barbers",
+                (snap.working > 0) ? (double)snap.busy / snap.working : 0.0);
+
+   // Bucket b holds waits below 2^b ns, so its upper bound is 2^b ns; the
+   //   last bucket also holds every longer wait and becomes +Inf
+   out += "# HELP shop_wait_seconds Time walk-in customers waited for a barber\n"
+          "# TYPE shop_wait_seconds histogram\n";
+   char line[128];
+   uint64_t count = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      count += snap.wait_buckets[b];
+      if (b == kWaitBuckets - 1) {
+         snprintf(line, sizeof(line), "shop_wait_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)count);
+      }
+      else if (b >= 10 && b <= 36) {                           // 1 us to 69 s; the rest say nothing new
+         snprintf(line, sizeof(line), "shop_wait_seconds_bucket{le=\"%.12g\"} %llu\n",
+                  (double)((uint64_t)1 << b) / 1e9, (unsigned long long)count);
+      }
+      else {
+         continue;
+      }
+      out += line;
+   }
+   snprintf(line, sizeof(line), "shop_wait_seconds_sum %.9f\nshop_wait_seconds_count %llu\n",
+            (double)snap.wait_sum_ns / 1e9, (unsigned long long)count);
+   out += line;
+   return out;
+}
@@ -0,0 +1,100 @@
+/** @file MetricsExporter.h
+ *
+ * MetricsExporter.h file:
+ * Serves a Shop's metrics in the Prometheus text format
+ * A thread listens on a local socket, either 127.0.0.1:PORT or a Unix
+ *   socket path, and answers every HTTP GET of /metrics with one
+ *   ShopMetrics snapshot: the customer counters, the barber and waiting
+ *   room gauges, the utilization of the working barbers and the walk-in
+ *   wait histogram. Snapshots and get_chairs() never take the shop's
+ *   mutex, so a scrape cannot hold up visitShop() or byeCustomer().
+ * Scrapes are answered one at a time; a client that sends nothing for
+ *   kExporterTimeoutMs is hung up on.
+ * Test it with e.g. curl http://127.0.0.1:9100/metrics or
+ *   curl --unix-socket /tmp/shop.sock http://localhost/metrics
+ *
+ * Assumptions:
+ * POSIX sockets and poll()
+ * The shop and its metrics outlive the exporter
+ */
+
+#ifndef MetricsExporter_H_
+#define MetricsExporter_H_
+#include <pthread.h>
+#include <string>
+#include "Metrics.h"
+#include "Shop.h"
+
+using namespace std;
+
+#define kExporterTimeoutMs 1000 // time a client has to send its request
+#define kExporterBacklog 16     // connections that can queue while one is answered
+
+class MetricsExporter
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: shop has metrics attached (see Shop::set_metrics())
+   // param: shop     Shop whose waiting room size is exported
+   // param: metrics  Counters to export
+   // post: The exporter is stopped
+   //
+   MetricsExporter(const Shop* shop, const ShopMetrics* metrics);
+
+   // --------------------------- Destructor
+   // post: The exporter thread is stopped and joined
+   //
+   ~MetricsExporter();
+
+   // --------------------------- bool start(const string&)
+   // pre: The exporter is stopped
+   // param: address  "PORT" or "127.0.0.1:PORT" for TCP on the loopback
+   //   interface, anything containing a '/' for a Unix socket at that path
+   //   (an existing socket file there is replaced)
+   // return: false if the socket or thread could not be created (errno is set)
+   //
+   bool start(const string& address);
+
+   // --------------------------- void stop()
+   // pre: None
+   // post: The exporter thread is joined and the socket closed
+   //
+   void stop();
+
+   // --------------------------- string render()
+   // pre: None
+   // return: One snapshot in the Prometheus text format
+   //
+   string render() const;
+
+private:
+   const Shop* shop_;
+   const ShopMetrics* metrics_;
+   int listen_fd_;
+   int wake_fd_[2];                          // stop() writes to [1] to end the poll() in run()
+   string unix_path_;                        // Removed by stop(), empty for TCP
+   bool running_;
+   pthread_t thread_;
+
+   // --------------------------- void* run(void*)
+   // Thread body: answers scrapes until stop()
+   //
+   static void* run(void* arg);
+
+   // --------------------------- void answer(int)
+   // pre: fd is a connected client
+   // post: The client got a response and fd is closed
+   //
+   void answer(int fd) const;
+
+   // --------------------------- int listenOn(const string&)
+   // pre: None
+   // param: address  See start()
+   // return: Listening socket, -1 on error (errno is set)
+   //
+   int listenOn(const string& address);
+
+   MetricsExporter(const MetricsExporter&);
+   MetricsExporter& operator=(const MetricsExporter&);
+};
+#endif
@@ -0,0 +1,165 @@
+/** @file MpmcRing.h
+ *
+ * MpmcRing.h file:
+ * Bounded lock-free multi-producer multi-consumer FIFO queue
+ * This is Dmitry Vyukov's array queue: every cell carries a sequence
+ *   number that says whose turn it is. A producer claims cell pos once
+ *   its sequence equals pos, writes the item and publishes it by setting
+ *   the sequence to pos + 1; a consumer claims it once the sequence is
+ *   pos + 1 and hands it back to the producers of the next lap by setting
+ *   it to pos + capacity. Claiming a position is one compare-exchange on
+ *   the shared enqueue or dequeue counter, so pushes and pops contend
+ *   only with their own kind, and a full or empty ring fails at once
+ *   instead of blocking.
+ * The capacity is rounded up to a power of two so a position maps to
+ *   its cell with a mask.
+ * It is not lock-free in the strictest sense: a thread preempted between
+ *   claiming a cell and publishing it holds up the consumers of that one
+ *   cell until it runs again.
+ *
+ * Assumptions:
+ * T is copy-assignable and default constructible
+ * Callers that find the ring full or empty back off on their own
+ */
+
+#ifndef MpmcRing_H_
+#define MpmcRing_H_
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+template <typename T>
+class MpmcRing
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: capacity > 0
+   // param: capacity  Items the ring holds at least (rounded up to a power of two)
+   // post: The ring is empty
+   //
+   MpmcRing(size_t capacity)
+   {
+      size_t size = 1;
+      while (size < capacity) {
+         size <<= 1;
+      }
+      mask_ = size - 1;
+      cells_ = new Cell[size];
+      for (size_t i = 0; i < size; i++) {
+         cells_[i].seq.store(i, memory_order_relaxed);
+      }
+      enqueue_pos_.store(0, memory_order_relaxed);
+      dequeue_pos_.store(0, memory_order_relaxed);
+   };
+
+   // --------------------------- Destructor
+   // pre: No thread uses the ring
+   //
+   ~MpmcRing()
+   {
+      delete []cells_;
+   };
+
+   // --------------------------- bool tryPush(const T&)
+   // pre: None
+   // param: item  Item to append
+   // post: item is the newest item, if there was room
+   // return: false if the ring was full
+   //
+   bool tryPush(const T& item)
+   {
+      size_t pos = enqueue_pos_.load(memory_order_relaxed);
+      Cell* cell;
+      while (true) {
+         cell = &cells_[pos & mask_];
+         size_t seq = cell->seq.load(memory_order_acquire);
+         intptr_t lag = (intptr_t)seq - (intptr_t)pos;
+         if (lag == 0) {                                       // Free on this lap: claim it
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+               break;
+            }
+         }
+         else if (lag < 0) {                                   // Last lap's item is still there
+            return false;
+         }
+         else {                                                // Another producer claimed it
+            pos = enqueue_pos_.load(memory_order_relaxed);
+         }
+      }
+      cell->value = item;
+      cell->seq.store(pos + 1, memory_order_release);          // Publish to the consumers
+      return true;
+   };
+
+   // --------------------------- bool tryPop(T*)
+   // pre: None
+   // param: item  Receives the oldest item
+   // post: The oldest item is removed, if there was one
+   // return: false if the ring was empty
+   //
+   bool tryPop(T* item)
+   {
+      size_t pos = dequeue_pos_.load(memory_order_relaxed);
+      Cell* cell;
+      while (true) {
+         cell = &cells_[pos & mask_];
+         size_t seq = cell->seq.load(memory_order_acquire);
+         intptr_t lag = (intptr_t)seq - (intptr_t)(pos + 1);
+         if (lag == 0) {                                       // Published: claim it
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+               break;
+            }
+         }
+         else if (lag < 0) {                                   // Nothing published here yet
+            return false;
+         }
+         else {                                                // Another consumer took it
+            pos = dequeue_pos_.load(memory_order_relaxed);
+         }
+      }
+      *item = cell->value;
+      cell->seq.store(pos + mask_ + 1, memory_order_release);  // Free for the next lap
+      return true;
+   };
+
+   // --------------------------- size_t capacity()
+   // pre: None
+   // return: Items the ring holds
+   //
+   size_t capacity() const
+   {
+      return mask_ + 1;
+   };
+
+   // --------------------------- size_t size()
+   // pre: None
+   // return: Items in the ring; only a hint while other threads push or pop
+   //
+   size_t size() const
+   {
+      size_t tail = dequeue_pos_.load(memory_order_acquire);
+      size_t head = enqueue_pos_.load(memory_order_acquire);
+      return (head > tail) ? head - tail : 0;
+   };
+
+private:
+   // Cell struct
+   // One slot and the sequence number that says whose turn it is
+   struct Cell
+   {
+      atomic<size_t> seq;
+      T value;
+   };
+
+   Cell* cells_;
+   size_t mask_;
+   alignas(64) atomic<size_t> enqueue_pos_;  // Producers and consumers each get
+   alignas(64) atomic<size_t> dequeue_pos_;  //   their own cache line
+   char pad_[64 - sizeof(atomic<size_t>)];
+
+   MpmcRing(const MpmcRing&);
+   MpmcRing& operator=(const MpmcRing&);
+};
+#endif
@@ -0,0 +1,353 @@
+/** @file Reactor.cpp
+ *
+ * Reactor.cpp file:
+ * Event loop front end that plays many customers on one thread
+ * One loop turn: admit every arrival that is due, re-arm the timer for
+ *   the next one, sleep in epoll_wait(), then read whichever descriptors
+ *   woke it and drain the completion queue. The eventfd is read before
+ *   the queue is drained and the shop writes it after pushing (once it
+ *   has released its mutex), so a completion is either drained now or
+ *   wakes the next epoll_wait().
+ *
+ * Assumptions:
+ * Linux: epoll, eventfd and timerfd
+ * The shop outlives the reactor and the records outlive join()
+ */
+
+#include "Reactor.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "Clock.h"
+#include "ThreadUtil.h"
+
+// --------------------------- Parameter constructor
+// pre: max_in_flight > 0
+// param: shop           Shop the customers visit
+// param: records        Record of every customer, indexed by ID - 1
+// param: max_in_flight  Visits open at once (waiting or in a chair)
+// post: The reactor is not started
+//
+Reactor::Reactor(Shop* shop, CustomerRecord* records, int max_in_flight) :
+   shop_(shop),
+   records_(records),
+   max_in_flight_(max_in_flight),
+   next_(0),
+   holding_(false),
+   epoll_fd_(-1),
+   event_fd_(-1),
+   timer_fd_(-1),
+   armed_ns_(0),
+   queue_(NULL),
+   tickets_(NULL),
+   wakeups_(0),
+   timer_events_(0),
+   completion_events_(0),
+   held_(0),
+   peak_in_flight_(0),
+   cpu_(-1),
+   running_(false),
+   error_(0)
+{
+}
+
+// --------------------------- Destructor
+// post: The loop thread is joined and the descriptors are closed
+//
+Reactor::~Reactor()
+{
+   join();
+   closeFds();
+   delete []tickets_;
+}
+
+// --------------------------- bool start(const vector<ReactorArrival>&, int)
+// Opens the descriptors and starts the loop thread
+//
+// pre: The reactor is not started
+// param: arrivals  Customers in order of arrival time
+// param: cpu       CPU to pin the loop to (modulo the CPUs online), -1 for any
+// return: false with errno set if a descriptor or the thread could not
+//   be created
+//
+bool Reactor::start(const vector<ReactorArrival>& arrivals, int cpu)
+{
+   epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+   event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);  // The clock of nowNanos()
+   if (epoll_fd_ < 0 || event_fd_ < 0 || timer_fd_ < 0) {
+      int err = errno;
+      closeFds();
+      errno = err;
+      return false;
+   }
+   int fds[2] = { event_fd_, timer_fd_ };
+   for (int i = 0; i < 2; i++) {
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = fds[i];
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+         int err = errno;
+         closeFds();
+         errno = err;
+         return false;
+      }
+   }
+
+   arrivals_ = arrivals;
+   tickets_ = new Shop::WaitTicket[max_in_flight_];
+   for (int i = max_in_flight_ - 1; i >= 0; i--) {
+      free_.push_back(i);
+   }
+   cpu_ = cpu;
+   int err = pthread_create(&thread_, NULL, run, this);
+   if (err != 0) {
+      errno = err;
+      return false;
+   }
+   running_ = true;
+   return true;
+}
+
+// --------------------------- bool join()
+// pre: start() succeeded
+// post: Every customer of the schedule has left the shop, unless the
+//   loop failed
+// return: false with errno set if epoll_wait() or the timer failed
+//
+bool Reactor::join()
+{
+   if (running_) {
+      pthread_join(thread_, NULL);
+      running_ = false;
+   }
+   if (error_ != 0) {
+      errno = error_;
+      return false;
+   }
+   return true;
+}
+
+// --------------------------- get_wakeups() / get_timer_events() / get_completion_events()
+//   / get_held() / get_peak_in_flight()
+// pre: join() was called
+// return: Returns from epoll_wait(), timer expirations read, eventfd
+//   writes read (one per shop critical section that completed visits of
+//   this reactor, however many), arrivals held because max_in_flight visits
+//   were open, most visits open at once
+//
+uint64_t Reactor::get_wakeups() const
+{
+   return wakeups_;
+}
+
+uint64_t Reactor::get_timer_events() const
+{
+   return timer_events_;
+}
+
+uint64_t Reactor::get_completion_events() const
+{
+   return completion_events_;
+}
+
+uint64_t Reactor::get_held() const
+{
+   return held_;
+}
+
+int Reactor::get_peak_in_flight() const
+{
+   return peak_in_flight_;
+}
+
+// --------------------------- void* run(void*)
+// Thread body: pins itself, then runs loop()
+// The completion queue lives on this stack, like a customer thread's
+//   WaitTicket. It holds two completions per open visit, which is every
+//   completion the shop can owe the reactor (see tryVisitShop()). If the
+//   loop fails, the open visits are still polled to the end, since the
+//   barbers push to the queue until they are done. The shop writes the
+//   eventfd after pushing, so the last write is waited out before the
+//   eventfd can be closed.
+//
+void* Reactor::run(void* arg)
+{
+   Reactor* reactor = (Reactor*)arg;
+   if (reactor->cpu_ >= 0) {
+      pinThread(pthread_self(), reactor->cpu_);                // Unpinned if that fails; still correct
+   }
+   CompletionQueue queue(2 * (size_t)reactor->max_in_flight_, reactor->event_fd_);
+   reactor->queue_ = &queue;
+   reactor->error_ = reactor->loop() ? 0 : errno;
+   while (!reactor->in_flight_.empty()) {
+      usleep(100);
+      reactor->drainCompletions();
+   }
+   reactor->shop_->awaitNotifies();
+   reactor->queue_ = NULL;
+   return nullptr;
+}
+
+// --------------------------- bool loop()
+// pre: Called by the loop thread
+// post: Every arrival was admitted and every visit is finished
+// return: false with errno set if epoll_wait() or the timer failed
+//
+bool Reactor::loop()
+{
+   while (true) {
+      admitDue();
+      if (next_ == arrivals_.size() && in_flight_.empty()) {
+         return true;
+      }
+      if (!armTimer()) {
+         return false;
+      }
+
+      struct epoll_event events[2];
+      int n = epoll_wait(epoll_fd_, events, 2, -1);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      wakeups_++;
+      for (int i = 0; i < n; i++) {
+         uint64_t count;
+         if (read(events[i].data.fd, &count, sizeof(count)) != sizeof(count)) {
+            continue;                                          // Already read: EAGAIN
+         }
+         if (events[i].data.fd == timer_fd_) {
+            timer_events_ += count;
+            armed_ns_ = 0;
+         }
+         else {
+            completion_events_ += count;
+         }
+      }
+      drainCompletions();
+   }
+}
+
+// --------------------------- void admitDue()
+// A customer the shop seats or queues keeps a ticket until their last
+//   completion is popped; one it turns away is done at once
+//
+// pre: Called by the loop thread
+// post: Every arrival due by now is in the shop, or the first of them
+//   is held for lack of a free ticket
+//
+void Reactor::admitDue()
+{
+   uint64_t now = nowNanos();
+   while (next_ < arrivals_.size() && arrivals_[next_].arrival_ns <= now) {
+      if (free_.empty()) {                                     // A visit may have finished since
+         drainCompletions();
+      }
+      if (free_.empty()) {
+         if (!holding_) {
+            held_++;
+            holding_ = true;
+         }
+         return;
+      }
+      holding_ = false;
+      const ReactorArrival& arrival = arrivals_[next_++];
+      int ticket = free_.back();
+      free_.pop_back();
+
+      CustomerRecord& record = records_[arrival.custID - 1];
+      record.customer = arrival.custID;
+      record.customer_class = arrival.custClass;
+      record.arrival_ns = arrival.arrival_ns;                  // Includes any time held
+      int barbID = shop_->tryVisitShop(arrival.custID, &tickets_[ticket], queue_, arrival.custClass);
+      if (barbID == -1) {
+         record.barber = -1;
+         record.leave_ns = nowNanos();
+         record.outcome = kOutcomeDropped;
+         free_.push_back(ticket);
+         continue;
+      }
+      if (barbID >= 0) {
+         record.barber = barbID;
+         record.seat_ns = nowNanos();
+      }
+      in_flight_[arrival.custID] = ticket;                     // Before any completion is popped
+      if ((int)in_flight_.size() > peak_in_flight_) {
+         peak_in_flight_ = (int)in_flight_.size();
+      }
+   }
+}
+
+// --------------------------- void drainCompletions()
+// pre: Called by the loop thread
+// post: The completion queue is empty; finished visits are recorded
+//   and their tickets free
+//
+void Reactor::drainCompletions()
+{
+   ShopCompletion completion;
+   while (queue_->tryPop(&completion)) {
+      CustomerRecord& record = records_[completion.custID - 1];
+      if (completion.kind == kVisitSeated) {
+         record.barber = completion.barbID;
+         record.seat_ns = nowNanos();
+         continue;
+      }
+      if (completion.kind == kVisitDone) {
+         record.start_ns = completion.start_ns;
+         record.end_ns = completion.end_ns;
+         record.outcome = kOutcomeServed;
+      }
+      else {
+         record.barber = -1;
+         record.outcome = kOutcomeDropped;
+      }
+      record.leave_ns = nowNanos();
+      unordered_map<int, int>::iterator visit = in_flight_.find(completion.custID);
+      free_.push_back(visit->second);
+      in_flight_.erase(visit);
+   }
+}
+
+// --------------------------- bool armTimer()
+// Skips the syscall when the timer is already set to the right time
+//
+// pre: Called by the loop thread
+// post: The timer expires at the next arrival, or is disarmed if there
+//   is none or it would be held
+// return: false with errno set if timerfd_settime() failed
+//
+bool Reactor::armTimer()
+{
+   uint64_t due_ns = (next_ < arrivals_.size() && !free_.empty()) ? arrivals_[next_].arrival_ns : 0;
+   if (due_ns == armed_ns_) {
+      return true;
+   }
+   struct itimerspec spec = itimerspec();                      // All zero disarms it
+   spec.it_value.tv_sec = (time_t)(due_ns / 1000000000ull);
+   spec.it_value.tv_nsec = (long)(due_ns % 1000000000ull);
+   if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+      return false;
+   }
+   armed_ns_ = due_ns;
+   return true;
+}
+
+// --------------------------- void closeFds()
+// post: Every descriptor that was opened is closed
+//
+void Reactor::closeFds()
+{
+   int* fds[3] = { &epoll_fd_, &event_fd_, &timer_fd_ };
+   for (int i = 0; i < 3; i++) {
+      if (*fds[i] >= 0) {
+         close(*fds[i]);
+         *fds[i] = -1;
+      }
+   }
+}
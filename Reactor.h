@@ -0,0 +1,172 @@
+/** @file Reactor.h
+ *
+ * Reactor.h file:
+ * Event loop front end that plays many customers on one thread
+ * A reactor is handed a schedule of arrivals and runs them through
+ *   tryVisitShop() on a thread of its own, the way a network server runs
+ *   its connections: it sleeps in epoll_wait() on two file descriptors
+ *   and does whatever became due when it wakes up.
+ *   - a timerfd armed for the next arrival: the customer walks in
+ *   - an eventfd the shop writes after it pushes completions on the
+ *     reactor's CompletionQueue: a customer was called in, served or
+ *     dropped (see CompletionQueue)
+ * So a customer costs a WaitTicket and a few syscalls instead of a thread,
+ *   and one reactor per core can keep up with arrival rates where the
+ *   driver's thread per customer is spent creating threads.
+ * The barbers stay threads: the monitor's barber side blocks in
+ *   helloCustomer() by design, and the haircut is the barber's own timed
+ *   wait. Their completions reach the reactor as events all the same.
+ * A reactor keeps at most max_in_flight visits open. An arrival that finds
+ *   them all open is held until a visit finishes (see get_held()), which
+ *   also bounds the completion queue so the shop never finds it full.
+ * Every visit is written to the customer's CustomerRecord, so reports
+ *   read the same records whether customers were threads or events.
+ *
+ * Assumptions:
+ * Linux: epoll, eventfd and timerfd
+ * The shop outlives the reactor and the records outlive join()
+ * Every customer ID in the schedule has a record and is in one schedule only
+ */
+
+#ifndef Reactor_H_
+#define Reactor_H_
+#include <pthread.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "CustomerRecord.h"
+#include "Shop.h"
+
+using namespace std;
+
+// ReactorArrival struct
+// One customer of a reactor's schedule
+struct ReactorArrival
+{
+   uint64_t arrival_ns;        // Monotonic time the customer walks in
+   int custID;
+   int custClass;              // CustomerClass
+};
+
+class Reactor
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: max_in_flight > 0
+   // param: shop           Shop the customers visit
+   // param: records        Record of every customer, indexed by ID - 1
+   // param: max_in_flight  Visits open at once (waiting or in a chair)
+   // post: The reactor is not started
+   //
+   Reactor(Shop* shop, CustomerRecord* records, int max_in_flight);
+
+   // --------------------------- Destructor
+   // post: The loop thread is joined and the descriptors are closed
+   //
+   ~Reactor();
+
+   // --------------------------- bool start(const vector<ReactorArrival>&, int)
+   // Opens the descriptors and starts the loop thread
+   //
+   // pre: The reactor is not started
+   // param: arrivals  Customers in order of arrival time
+   // param: cpu       CPU to pin the loop to (modulo the CPUs online), -1 for any
+   // return: false with errno set if a descriptor or the thread could not
+   //   be created
+   //
+   bool start(const vector<ReactorArrival>& arrivals, int cpu);
+
+   // --------------------------- bool join()
+   // pre: start() succeeded
+   // post: Every customer of the schedule has left the shop, unless the
+   //   loop failed
+   // return: false with errno set if epoll_wait() or the timer failed
+   //
+   bool join();
+
+   // --------------------------- get_wakeups() / get_timer_events() / get_completion_events()
+   //   / get_held() / get_peak_in_flight()
+   // pre: join() was called
+   // return: Returns from epoll_wait(), timer expirations read, eventfd
+   //   writes read (one per shop critical section that completed visits of
+   //   this reactor, however many), arrivals held because max_in_flight visits
+   //   were open, most visits open at once
+   //
+   uint64_t get_wakeups() const;
+   uint64_t get_timer_events() const;
+   uint64_t get_completion_events() const;
+   uint64_t get_held() const;
+   int get_peak_in_flight() const;
+
+private:
+   Shop* shop_;
+   CustomerRecord* records_;
+   int max_in_flight_;
+   vector<ReactorArrival> arrivals_;
+   size_t next_;                             // Next arrival to admit
+   bool holding_;                            // arrivals_[next_] is due but held
+
+   int epoll_fd_;
+   int event_fd_;                            // Written by the shop after pushing completions
+   int timer_fd_;                            // Expires at the next arrival
+   uint64_t armed_ns_;                       // Expiry timer_fd_ is set to, 0 if disarmed
+   CompletionQueue* queue_;                  // On the loop thread's stack while it runs
+   Shop::WaitTicket* tickets_;               // max_in_flight_ visits
+   vector<int> free_;                        // Tickets not in use
+   unordered_map<int, int> in_flight_;       // Customer ID -> ticket of each open visit
+
+   uint64_t wakeups_;
+   uint64_t timer_events_;
+   uint64_t completion_events_;
+   uint64_t held_;
+   int peak_in_flight_;
+
+   int cpu_;
+   bool running_;
+   int error_;                               // errno of a failed loop, else 0
+   pthread_t thread_;
+
+   // --------------------------- void* run(void*)
+   // Thread body: pins itself, then runs loop() on a completion queue
+   //   of its own
+   //
+   static void* run(void* arg);
+
+   // --------------------------- bool loop()
+   // pre: Called by the loop thread
+   // post: Every arrival was admitted and every visit is finished
+   // return: false with errno set if epoll_wait() or the timer failed
+   //
+   bool loop();
+
+   // --------------------------- void admitDue()
+   // pre: Called by the loop thread
+   // post: Every arrival due by now is in the shop, or the first of them
+   //   is held for lack of a free ticket
+   //
+   void admitDue();
+
+   // --------------------------- void drainCompletions()
+   // pre: Called by the loop thread
+   // post: The completion queue is empty; finished visits are recorded
+   //   and their tickets free
+   //
+   void drainCompletions();
+
+   // --------------------------- bool armTimer()
+   // pre: Called by the loop thread
+   // post: The timer expires at the next arrival, or is disarmed if there
+   //   is none or it would be held
+   // return: false with errno set if timerfd_settime() failed
+   //
+   bool armTimer();
+
+   // --------------------------- void closeFds()
+   // post: Every descriptor that was opened is closed
+   //
+   void closeFds();
+
+   Reactor(const Reactor&);
+   Reactor& operator=(const Reactor&);
+};
+#endif
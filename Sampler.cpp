@@ -0,0 +1,178 @@
+/** @file Sampler.cpp
+ *
+ * Sampler.cpp file:
+ * Records the shop's queue length, busy barbers and drops over time
+ *
+ * Assumptions:
+ * The shop and its metrics outlive the sampler
+ * The samples are only read after stop()
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <time.h>
+#include "Clock.h"
+#include "Sampler.h"
+
+// --------------------------- Parameter constructor
+// pre: shop has metrics attached (see Shop::set_metrics()); capacity > 0
+// param: shop         Shop whose waiting room size is sampled
+// param: metrics      Counters and gauges to sample
+// param: capacity     Samples kept
+// param: interval_ns  Time between samples
+// post: The ring is allocated and the sampler is stopped
+//
+Sampler::Sampler(const Shop* shop, const ShopMetrics* metrics, size_t capacity, uint64_t interval_ns) :
+   shop_(shop),
+   metrics_(metrics),
+   ring_(capacity),                                            // Touched now, not while sampling
+   interval_ns_(interval_ns),
+   start_ns_(0),
+   taken_(0),
+   missed_(0),
+   cpu_ns_(0),
+   stopping_(false),
+   running_(false)
+{
+}
+
+// --------------------------- Destructor
+// post: The sampler thread is stopped and joined
+//
+Sampler::~Sampler()
+{
+   stop();
+}
+
+// --------------------------- bool start()
+// pre: The sampler is stopped
+// return: false if the thread could not be created
+//
+bool Sampler::start()
+{
+   start_ns_ = nowNanos();
+   stopping_ = false;
+   running_ = (pthread_create(&thread_, NULL, run, this) == 0);
+   return running_;
+}
+
+// --------------------------- void stop()
+// pre: None
+// post: The sampler thread is joined
+//
+void Sampler::stop()
+{
+   if (!running_) {
+      return;
+   }
+   mutex_.lock();
+   stopping_ = true;
+   cond_stop_.signal();
+   mutex_.unlock();
+   pthread_join(thread_, NULL);
+   running_ = false;
+}
+
+// --------------------------- void* run(void*)
+// Thread body: samples until stop()
+//
+void* Sampler::run(void* arg)
+{
+   Sampler* sampler = (Sampler*)arg;
+   uint64_t next_ns = sampler->start_ns_;
+
+   sampler->mutex_.lock();
+   while (!sampler->stopping_) {
+      sampler->cond_stop_.wait_until(sampler->mutex_, next_ns);
+      uint64_t now = nowNanos();
+      if (sampler->stopping_ || now < next_ns) {               // Stopped or woken early
+         continue;
+      }
+      sampler->mutex_.unlock();
+      sampler->sample();
+      next_ns += sampler->interval_ns_;
+      if (now >= next_ns) {                                    // Late: skip the ticks already past
+         uint64_t behind = (now - next_ns) / sampler->interval_ns_ + 1;
+         sampler->missed_ += behind;
+         next_ns += behind * sampler->interval_ns_;
+      }
+      sampler->mutex_.lock();
+   }
+   sampler->mutex_.unlock();
+
+   struct timespec cpu;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+   sampler->cpu_ns_ = (uint64_t)cpu.tv_sec * 1000000000ull + (uint64_t)cpu.tv_nsec;
+   return nullptr;
+}
+
+// --------------------------- void sample()
+// pre: Called by the sampler thread
+// post: One more sample is in the ring
+//
+void Sampler::sample()
+{
+   MetricsSnapshot snap;
+   metrics_->snapshot(&snap);
+   ShopSample& s = ring_[taken_ % ring_.size()];
+   s.time_ns = snap.time_ns;
+   s.waiting = (int32_t)snap.waiting;
+   s.chairs = shop_->get_chairs();
+   s.busy = (int32_t)snap.busy;
+   s.working = (int32_t)snap.working;
+   s.arrivals = snap.arrivals;
+   s.dropped = snap.dropped;
+   s.reneged = snap.reneged;
+   taken_++;
+}
+
+// --------------------------- bool writeCsv(const string&)
+// pre: stop() was called
+// param: path  File to create or truncate
+// return: false if the file could not be written
+//
+bool Sampler::writeCsv(const string& path) const
+{
+   ofstream out(path.c_str(), ios::trunc);
+   out << fixed << setprecision(3);
+   out << "time_ms,waiting,chairs,busy,working,arrivals,dropped,reneged,drops_per_s\n";
+   uint64_t kept = get_kept();
+   const ShopSample* last = NULL;
+   for (uint64_t i = taken_ - kept; i < taken_; i++) {
+      const ShopSample& s = ring_[i % ring_.size()];
+      double drops_per_s = 0.0;
+      if (last != NULL && s.time_ns > last->time_ns) {
+         drops_per_s = (double)(s.dropped - last->dropped) * 1e9 / (s.time_ns - last->time_ns);
+      }
+      out << (s.time_ns - start_ns_) / 1e6 << "," << s.waiting << "," << s.chairs << "," << s.busy << ","
+          << s.working << "," << s.arrivals << "," << s.dropped << "," << s.reneged << ","
+          << drops_per_s << "\n";
+      last = &s;
+   }
+   return (bool)out;
+}
+
+// --------------------------- get_taken() / get_kept() / get_missed() / get_cpu_ns()
+// pre: stop() was called
+// return: Samples taken, samples still in the ring, ticks skipped
+//   because the sampler was late, CPU time of the sampler thread
+//
+uint64_t Sampler::get_taken() const
+{
+   return taken_;
+}
+
+size_t Sampler::get_kept() const
+{
+   return (taken_ < ring_.size()) ? (size_t)taken_ : ring_.size();
+}
+
+uint64_t Sampler::get_missed() const
+{
+   return missed_;
+}
+
+uint64_t Sampler::get_cpu_ns() const
+{
+   return cpu_ns_;
+}
@@ -0,0 +1,126 @@
+/** @file Sampler.h
+ *
+ * Sampler.h file:
+ * Records the shop's queue length, busy barbers and drops over time
+ * A thread takes a sample every interval into a ring buffer allocated up
+ *   front; once the ring is full the oldest samples are overwritten, so
+ *   the last capacity samples are kept. The values are read from
+ *   ShopMetrics and get_chairs(), which never take the shop's mutex, so
+ *   sampling at 1 kHz costs the shop nothing but a few cache misses.
+ * The sampler is late rather than early: if a sample takes longer than
+ *   an interval the ticks in between are skipped and counted, not made up.
+ * After stop() the samples can be written as CSV, one row per sample.
+ *
+ * Assumptions:
+ * The shop and its metrics outlive the sampler
+ * The samples are only read after stop()
+ */
+
+#ifndef Sampler_H_
+#define Sampler_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Metrics.h"
+#include "Shop.h"
+
+using namespace std;
+
+#define kSamplerSlots 65536     // default ring size: a minute at 1 kHz
+
+// ShopSample struct
+// One row of the time series
+struct ShopSample
+{
+   uint64_t time_ns;           // When the sample was taken
+   int32_t waiting;            // Customers in waiting chairs
+   int32_t chairs;             // Waiting chairs
+   int32_t busy;               // Barbers with a customer in their chair
+   int32_t working;            // Barbers working and not retiring
+   uint64_t arrivals;          // Counters since the shop opened
+   uint64_t dropped;
+   uint64_t reneged;
+};
+
+class Sampler
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: shop has metrics attached (see Shop::set_metrics()); capacity > 0
+   // param: shop         Shop whose waiting room size is sampled
+   // param: metrics      Counters and gauges to sample
+   // param: capacity     Samples kept
+   // param: interval_ns  Time between samples
+   // post: The ring is allocated and the sampler is stopped
+   //
+   Sampler(const Shop* shop, const ShopMetrics* metrics, size_t capacity, uint64_t interval_ns);
+
+   // --------------------------- Destructor
+   // post: The sampler thread is stopped and joined
+   //
+   ~Sampler();
+
+   // --------------------------- bool start()
+   // pre: The sampler is stopped
+   // return: false if the thread could not be created
+   //
+   bool start();
+
+   // --------------------------- void stop()
+   // pre: None
+   // post: The sampler thread is joined
+   //
+   void stop();
+
+   // --------------------------- bool writeCsv(const string&)
+   // Writes the kept samples, oldest first, with a header row; drops_per_s
+   //   is the drop rate since the row before
+   //
+   // pre: stop() was called
+   // param: path  File to create or truncate
+   // return: false if the file could not be written
+   //
+   bool writeCsv(const string& path) const;
+
+   // --------------------------- get_taken() / get_kept() / get_missed() / get_cpu_ns()
+   // pre: stop() was called
+   // return: Samples taken, samples still in the ring, ticks skipped
+   //   because the sampler was late, CPU time of the sampler thread
+   //
+   uint64_t get_taken() const;
+   size_t get_kept() const;
+   uint64_t get_missed() const;
+   uint64_t get_cpu_ns() const;
+
+private:
+   const Shop* shop_;
+   const ShopMetrics* metrics_;
+   vector<ShopSample> ring_;                 // Sample i is at ring_[i % capacity]
+   uint64_t interval_ns_;
+   uint64_t start_ns_;
+   uint64_t taken_;
+   uint64_t missed_;
+   uint64_t cpu_ns_;
+
+   PthreadMutex mutex_;                      // Guards stopping_
+   PthreadCond cond_stop_;
+   bool stopping_;
+   bool running_;
+   pthread_t thread_;
+
+   // --------------------------- void* run(void*)
+   // Thread body: samples until stop()
+   //
+   static void* run(void* arg);
+
+   // --------------------------- void sample()
+   // pre: Called by the sampler thread
+   // post: One more sample is in the ring
+   //
+   void sample();
+
+   Sampler(const Sampler&);
+   Sampler& operator=(const Sampler&);
+};
+#endif
@@ -0,0 +1,61 @@
+/** @file Schedule.cpp
+ *
+ * Schedule.cpp file:
+ * Reads and writes recorded customer workloads
+ *
+ * Assumptions:
+ * Readers run on a machine with the same byte order as the writer
+ */
+
+#include "Schedule.h"
+#include <fstream>
+#include <string.h>
+
+// --------------------------- bool writeSchedule(const string&, const vector<ScheduleEntry>&)
+// pre: entries are in arrival order
+// param: path     File to create or truncate
+// param: entries  Schedule to write
+// return: false if the file could not be written
+//
+bool writeSchedule(const string& path, const vector<ScheduleEntry>& entries)
+{
+   ofstream out(path.c_str(), ios::binary | ios::trunc);
+
+   ScheduleFileHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, kScheduleMagic, sizeof(header.magic));
+   header.version = kScheduleVersion;
+   header.entry_size = sizeof(ScheduleEntry);
+   header.count = entries.size();
+
+   out.write((const char*)&header, sizeof(header));
+   if (!entries.empty()) {
+      out.write((const char*)&entries[0], entries.size() * sizeof(ScheduleEntry));
+   }
+   return (bool)out;
+}
+
+// --------------------------- bool readSchedule(const string&, vector<ScheduleEntry>*)
+// pre: None
+// param: path     File written by writeSchedule()
+// param: entries  Receives the schedule
+// return: false if the file could not be read or is not a schedule
+//
+bool readSchedule(const string& path, vector<ScheduleEntry>* entries)
+{
+   ifstream in(path.c_str(), ios::binary);
+
+   ScheduleFileHeader header;
+   if (!in.read((char*)&header, sizeof(header))
+       || memcmp(header.magic, kScheduleMagic, sizeof(header.magic)) != 0
+       || header.version != kScheduleVersion
+       || header.entry_size != sizeof(ScheduleEntry)) {
+      return false;
+   }
+
+   entries->resize(header.count);
+   if (header.count > 0) {
+      in.read((char*)&(*entries)[0], header.count * sizeof(ScheduleEntry));
+   }
+   return (bool)in;
+}
@@ -0,0 +1,63 @@
+/** @file Schedule.h
+ *
+ * Schedule.h file:
+ * A recorded customer workload: when each customer arrived and how long
+ *   their haircut takes
+ * driver --schedule FILE records the arrivals it produced, and replay
+ *   feeds the same schedule into a Shop again, so two runs (or two
+ *   monitor implementations) see exactly the same workload
+ * A schedule file is a ScheduleFileHeader followed by one ScheduleEntry
+ *   per customer, in arrival order (customer ID = index + 1)
+ *
+ * Assumptions:
+ * Readers run on a machine with the same byte order as the writer
+ */
+
+#ifndef Schedule_H_
+#define Schedule_H_
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define kScheduleMagic "SHOPSCH"  // first 8 bytes of a schedule file (including '\0')
+#define kScheduleVersion 2        // bumped whenever ScheduleEntry changes
+
+// ScheduleFileHeader struct (32 bytes)
+struct ScheduleFileHeader
+{
+   char magic[8];              // kScheduleMagic
+   uint32_t version;           // kScheduleVersion
+   uint32_t entry_size;        // sizeof(ScheduleEntry)
+   uint64_t count;             // Number of entries in the file
+   uint64_t reserved;
+};
+
+// ScheduleEntry struct (16 bytes)
+struct ScheduleEntry
+{
+   uint64_t arrival_ns;        // Arrival time relative to the first customer
+   uint32_t service_us;        // Length of the haircut in microseconds
+   uint32_t customer_class;    // CustomerClass of the customer
+};
+
+static_assert(sizeof(ScheduleFileHeader) == 32, "ScheduleFileHeader layout changed");
+static_assert(sizeof(ScheduleEntry) == 16, "ScheduleEntry layout changed");
+
+// --------------------------- bool writeSchedule(const string&, const vector<ScheduleEntry>&)
+// pre: entries are in arrival order
+// param: path     File to create or truncate
+// param: entries  Schedule to write
+// return: false if the file could not be written
+//
+bool writeSchedule(const string& path, const vector<ScheduleEntry>& entries);
+
+// --------------------------- bool readSchedule(const string&, vector<ScheduleEntry>*)
+// pre: None
+// param: path     File written by writeSchedule()
+// param: entries  Receives the schedule
+// return: false if the file could not be read or is not a schedule
+//
+bool readSchedule(const string& path, vector<ScheduleEntry>* entries);
+#endif
@@ -16,268 +16,1236 @@
  */
 
 #include "Shop.h"
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "Clock.h"
+#include "ShopProbes.h"
+
+template class BasicShop<PthreadSync>;
+template class BasicShop<StdSync>;
+template class BasicShop<SpinSync>;
+template class BasicShop<TicketSync>;
+template class BasicShop<FutexSync>;
+template class BasicShop<PthreadSync, SHOP_FIXED_BARBERS, SHOP_FIXED_CHAIRS>;
 
 // --------------------------- Parameter constructor
 // Uses init() to initialize all array values and mutex/conditions
 // Sets max barbers and chairs to default values if parameter is invalid
+// A fixed-size shop ignores the parameters and uses Barbers and Chairs
 // 
 // pre: None
-// param: num_barbers  Maximum allowed number of barbers working at a time
+// param: num_barbers  Number of barbers working when the shop opens
 // param: num_chairs   Maximum number of waiting customers
+// param: max_barbers  Most barbers that can work at a time (see addBarber()),
+//   at least num_barbers
 // post: Shop object can be passed threads of customers and barbers
 //
-Shop::Shop(int num_barbers, int num_chairs) :                  // Use default values if parameters are invalid
-   max_waiting_cust_((num_chairs >= 0) ? num_chairs : kDefaultNumChairs), 
-   max_working_barb_((num_barbers > 0) ? num_barbers : kDefaultBarbers),
-   cust_drops_(0),
+template <typename Sync, int Barbers, int Chairs>
+BasicShop<Sync, Barbers, Chairs>::BasicShop(int num_barbers, int num_chairs, int max_barbers) : // Use default values if parameters are invalid
+   max_waiting_cust_((Barbers > 0) ? Chairs : (num_chairs >= 0) ? num_chairs : kDefaultNumChairs), 
+   max_working_barb_((Barbers > 0) ? Barbers : (num_barbers <= 0) ? kDefaultBarbers
+                     : (max_barbers > num_barbers) ? max_barbers : num_barbers),
    waiting_customers_(0),
-   sleeping_barbs_(0)
+   sleeping_barbs_(0),
+   working_barbs_((Barbers > 0) ? Barbers : (num_barbers > 0) ? num_barbers : kDefaultBarbers),
+   cust_drops_(0),
+   wheel_((uint64_t)kPatienceTickUs * 1000)
 {
-   customer_in_chair_ = new int[max_working_barb_];
-   in_service_ = new bool[max_working_barb_];
-   money_paid_ = new bool[max_working_barb_];
-   cond_customer_served_ = new pthread_cond_t[max_working_barb_];
-   cond_barber_paid_ = new pthread_cond_t[max_working_barb_];
-   cond_barber_sleeping_ = new pthread_cond_t[max_working_barb_];
+   customer_in_chair_.allocate(barbers());
+   in_service_.allocate(barbers());
+   money_paid_.allocate(barbers());
+   service_start_ns_.allocate(barbers());
+   service_end_ns_.allocate(barbers());
+   chair_completions_.allocate(barbers());
+   checked_in_.allocate(barbers());
+   skills_.allocate(barbers());
+   shift_.allocate(barbers());
+   barber_time_.allocate(barbers());
+   activity_since_ns_.allocate(barbers());
+   cond_customer_served_.allocate(barbers());
+   cond_barber_paid_.allocate(barbers());
+   cond_barber_sleeping_.allocate(barbers());
 
    init();                                                     // Initialize arrays and conditions/mutex
 };
 
 // --------------------------- Default constructor
 // Uses init() to initialize all array values and mutex/conditions
-// Sets max barbers and chairs to default values
+// Sets max barbers and chairs to default values, or to Barbers and Chairs
+//   for a fixed-size shop
 // 
 // pre: None
 // post: Shop object can be passed threads of customers and barbers
 //
-Shop::Shop() :
-   max_waiting_cust_(kDefaultNumChairs),                       // Use default values
-   max_working_barb_(kDefaultBarbers),
-   cust_drops_(0),
+template <typename Sync, int Barbers, int Chairs>
+BasicShop<Sync, Barbers, Chairs>::BasicShop() :
+   max_waiting_cust_((Barbers > 0) ? Chairs : kDefaultNumChairs), // Use default values
+   max_working_barb_((Barbers > 0) ? Barbers : kDefaultBarbers),
    waiting_customers_(0),
-   sleeping_barbs_(0)
+   sleeping_barbs_(0),
+   working_barbs_(max_working_barb_),
+   cust_drops_(0),
+   wheel_((uint64_t)kPatienceTickUs * 1000)
 {
-   customer_in_chair_ = new int[max_working_barb_];
-   in_service_ = new bool[max_working_barb_];
-   money_paid_ = new bool[max_working_barb_];
-   cond_customer_served_ = new pthread_cond_t[max_working_barb_];
-   cond_barber_paid_ = new pthread_cond_t[max_working_barb_];
-   cond_barber_sleeping_ = new pthread_cond_t[max_working_barb_];
+   customer_in_chair_.allocate(barbers());
+   in_service_.allocate(barbers());
+   money_paid_.allocate(barbers());
+   service_start_ns_.allocate(barbers());
+   service_end_ns_.allocate(barbers());
+   chair_completions_.allocate(barbers());
+   checked_in_.allocate(barbers());
+   skills_.allocate(barbers());
+   shift_.allocate(barbers());
+   barber_time_.allocate(barbers());
+   activity_since_ns_.allocate(barbers());
+   cond_customer_served_.allocate(barbers());
+   cond_barber_paid_.allocate(barbers());
+   cond_barber_sleeping_.allocate(barbers());
 
    init();                                                     // Initialize arrays and conditions/mutex
 };
 
 // --------------------------- Destructor
-// Deletes the dynamically allocated arrays in this class (6 total)
+// The arrays in this class free themselves (see ShopArray)
 //
-Shop::~Shop()
+template <typename Sync, int Barbers, int Chairs>
+BasicShop<Sync, Barbers, Chairs>::~BasicShop()
 {
-   delete []customer_in_chair_;
-   delete []in_service_;
-   delete []money_paid_;
-   delete []cond_customer_served_;
-   delete []cond_barber_paid_;
-   delete []cond_barber_sleeping_;
 }
 
 // --------------------------- void init()
 // Initializes every element of every array used in this class
-//   as well as the mutex and condition variables
+// The mutex and condition variables initialize themselves
 // 
 // pre: None
 // post: This Shop object is initialized and ready for operation
 //
-void Shop::init()
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::init()
 {
-   pthread_mutex_init(&mutex_, NULL);
-   pthread_cond_init(&cond_customers_waiting_, NULL);
+   event_log_ = NULL;
+   metrics_ = NULL;
+   print_enabled_ = true;
+   closed_ = false;
+   notifying_ = 0;
 
-   for (int i = 0; i < max_working_barb_; i++) {
+   for (int s = 0; s < kMaxServices; s++) {
+      skill_barbers_[s] = 0;
+      free_[s].init(barbers());
+   }
+   for (int i = 0; i < barbers(); i++) {
+      shift_[i] = (i < working_barbs_) ? kBarberOn : kBarberOff;
+      skills_[i] = 1;                                          // Plain haircuts only
+      if (shift_[i] == kBarberOn) {
+         free_[0].set(i);
+      }
       customer_in_chair_[i] = 0;
       in_service_[i] = false;
       money_paid_[i] = false;
-
-      pthread_cond_init(&cond_customer_served_[i], NULL);
-      pthread_cond_init(&cond_barber_paid_[i], NULL);
-      pthread_cond_init(&cond_barber_sleeping_[i], NULL);
+      service_start_ns_[i] = 0;
+      service_end_ns_[i] = 0;
+      chair_completions_[i] = NULL;
+      checked_in_[i] = NULL;
    }
-}
 
-// --------------------------- string int2string(int)
-// Uses a stringstream to convert an int into a string
-// 
-// pre: None
-// param: i  int to be converted
-// return: string containing i
-//
-string Shop::int2string(int i)
-{
-   stringstream out;
-   out << i;
-   return out.str();
+   waiting_mask_ = 0;
+   weight_mask_ = 0;
+   credit_mask_ = 0;
+   timekeeper_ = NULL;
+   reneged_ = 0;
+   book_.init(barbers());
+   skill_barbers_[0] = working_barbs_;
+   wait_seq_ = 0;
+   occupancy_.time_ns = nowNanos();
+   for (int i = 0; i < barbers(); i++) {                       // The shop opens with everyone asleep
+      barber_time_[i].sleeping_ns = 0;
+      barber_time_[i].serving_ns = 0;
+      barber_time_[i].checkout_ns = 0;
+      barber_time_[i].activity = kActivityAway;
+      activity_since_ns_[i] = occupancy_.time_ns;
+      if (shift_[i] == kBarberOn) {
+         setActivity(i, kActivitySleeping, occupancy_.time_ns);
+      }
+   }
+   occupancy_.waiting_ns = 0;
+   occupancy_.chairs_ns = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      wait_hist_[b] = 0;
+   }
+   for (int c = 0; c < kNumClasses; c++) {
+      for (int s = 0; s < kMaxServices; s++) {
+         queue_head_[s][c] = NULL;
+         queue_tail_[s][c] = NULL;
+      }
+      service_mask_[c] = 0;
+      class_waiting_[c] = 0;
+      class_chairs_[c] = INT_MAX;                              // Every class may use every waiting chair
+      class_weight_[c] = 0;                                    // Strict priority
+      class_credit_[c] = 0;
+      class_drops_[c] = 0;
+   }
 }
 
-// --------------------------- void print(int, string)
-// Prints a preformatted output based on the ID passed in
-// If the person is negative their ID is of a barber, otherwise
-//   it is of a customer
+// --------------------------- void event(int, int, int, int)
+// Records a state transition of a customer or barber
+// The transition is appended to the event log if one is attached, and
+//   printed in the preformatted output (see formatEvent) unless printing
+//   was turned off with set_print(false)
+// Every transition also has a USDT probe shop:<name>(custID, barbID, arg),
+//   named as in logview, which is a nop unless a tracer attaches
 // Output format is as follows:
-//   customer[person]:  message
+//   customer[custID]:  message
 //      OR 
-//   barber [-person]:  message
+//   barber  [barbID + 1]:  message
 // 
 // pre: None
-// param: person   ID of thread printing message
-// param: message  Message being output for that thread
-// post: Message is output to console as indicated above
+// param: type    ShopEventType of the transition
+// param: custID  ID of the customer involved, 0 if none
+// param: barbID  ID of the barber involved, -1 if none
+// param: arg     Type-specific argument (see ShopEventType)
+// post: Transition is logged and/or output to console as indicated above
 //
-void Shop::print(int person, string message)
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::event(int type, int custID, int barbID, int arg)
 {
-   bool isBarb = false;
-   if (person <= 0)                                            // Barber IDs are passed as negative values
-   {                                                           // Customer IDs begin at +1
-      isBarb = true;
-      person = -person;
+   switch (type) {                                             // One probe site per transition
+   case kEventArrive:   SHOP_PROBE3(arrive, custID, barbID, arg);   break;
+   case kEventWait:     SHOP_PROBE3(wait, custID, barbID, arg);     break;
+   case kEventSeat:     SHOP_PROBE3(seat, custID, barbID, arg);     break;
+   case kEventAwait:    SHOP_PROBE3(await, custID, barbID, arg);    break;
+   case kEventStart:    SHOP_PROBE3(start, custID, barbID, arg);    break;
+   case kEventDone:     SHOP_PROBE3(done, custID, barbID, arg);     break;
+   case kEventPay:      SHOP_PROBE3(pay, custID, barbID, arg);      break;
+   case kEventLeave:    SHOP_PROBE3(leave, custID, barbID, arg);    break;
+   case kEventDrop:     SHOP_PROBE3(drop, custID, barbID, arg);     break;
+   case kEventSleep:    SHOP_PROBE3(sleep, custID, barbID, arg);    break;
+   case kEventNext:     SHOP_PROBE3(next, custID, barbID, arg);     break;
+   case kEventRenege:   SHOP_PROBE3(renege, custID, barbID, arg);   break;
+   case kEventCheckIn:  SHOP_PROBE3(checkin, custID, barbID, arg);  break;
+   case kEventHire:     SHOP_PROBE3(hire, custID, barbID, arg);     break;
+   case kEventRetire:   SHOP_PROBE3(retire, custID, barbID, arg);   break;
+   case kEventOffShift: SHOP_PROBE3(offshift, custID, barbID, arg); break;
+   case kEventResize:   SHOP_PROBE3(resize, custID, barbID, arg);   break;
+   default:                                                    break;
+   }
+   if (event_log_ != NULL) {
+      event_log_->log(type, custID, barbID, arg);
+   }
+   if (metrics_ != NULL) {
+      switch (type) {
+      case kEventArrive: metrics_->add(kMetricArrivals); break;
+      case kEventSeat:   metrics_->add(kMetricSeated);   break;
+      case kEventPay:    metrics_->add(kMetricServed);   break;
+      case kEventDrop:   metrics_->add(kMetricDropped);  break;
+      case kEventRenege: metrics_->add(kMetricReneged);  break;
+      case kEventNext:   metrics_->add(kMetricFreed);    break;
+      case kEventSleep:  metrics_->add(kMetricSleeps);   break;
+      case kEventHire:   metrics_->add(kMetricShiftStarts); break;
+      case kEventRetire: metrics_->add(kMetricShiftEnds); break;
+      default:                                         break;
+      }
+   }
+   if (print_enabled_) {
+      ShopEvent ev = { 0, 0, custID, barbID, (uint16_t)type, 0, arg };
+      string line = formatEvent(ev);
+      if (!line.empty()) {                                     // Arrivals and departures are not printed
+         cout << line << endl;
+      }
    }
-   cout << ((!isBarb) ? "customer[" : "barber  [") << person << "]: " << message << endl;
 }
 
-// --------------------------- int visitShop(int)
-// First customer method, closely tied with assignBarber(int).
+// --------------------------- int visitShop(int, int, int, uint64_t, bool*)
+// First customer method, closely tied with assignBarber(int, int).
 // Uses mutex start to finish with a wait call in the case that there are
 //   waiting chairs but no available barber.
-// All paths lead to assignBarber(int) which returns an available barber's ID
-// This barber is then set as in service and woken if sleeping
+// A free service chair of a barber with the skill for the service is taken
+//   right away, otherwise the customer queues in a waiting chair of their
+//   service and class until a qualified barber calls them in. When
+//   every waiting chair is taken, the newest waiter of the lowest class
+//   below custClass is displaced (dropped) to make room.
+// A customer with patience reneges if they are still waiting once it has
+//   run out (up to kPatienceTickUs late); reneging is not a drop.
 // Unlike barbID, custID is not used for any indexing so the runtime value will
 //   be the same as the printout value.
 //
 // pre: Calling method either ensures against or handles the case of not finding an open barber
-// param: custID  ID of the customer calling this method
-// return: Returns the ID of the first available barber found or -1 if none were found
+// param: custID     ID of the customer calling this method
+// param: custClass  CustomerClass of the customer
+// param: service    Service type the customer wants, 0 <= service < kMaxServices
+// param: patience_ns  Longest wait in a waiting chair, 0 to wait forever
+// param: reneged    Optional: receives whether the customer ran out of patience
+// return: Returns the ID of the barber serving the customer or -1 if they
+//   were dropped or reneged
 //
-int Shop::visitShop(int custID)
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::visitShop(int custID, int custClass, int service,
+                                               uint64_t patience_ns, bool* reneged)
 {
-   int barbID;
-   pthread_mutex_lock(&mutex_);
+   if (reneged != NULL) {
+      *reneged = false;
+   }
+   WaitTicket ticket;
+   ticket.completions = NULL;
+   mutex_.lock();
+   int barbID = admit(custID, custClass, service, patience_ns, &ticket);
+   if (barbID == kVisitQueued) {
+      if (!notify_fds_.empty()) {                              // Displaced a tryVisitShop() waiter:
+         unlockAndNotify();                                    //   tell its poller before we sleep
+         mutex_.lock();
+      }
+      barbID = awaitTicket(&ticket, reneged);
+   }
+   unlockAndNotify();
+   return barbID;
+}
 
-   if (max_waiting_cust_ == 0)                                 // No waiting chairs, only service chairs
-   {
-      barbID = assignBarber(custID);                           // Look for an open service chair
-      if (barbID == -1)       
-      {
-         print(custID, "leaves the shop because of no available service chairs.");
-         ++cust_drops_;
-
-         pthread_mutex_unlock(&mutex_);                        // -1 returned means no open service chair
-         return barbID;                                        //   was found and outputs that the
-      }                                                        //   customer leaves the shop
-   }    
-   else                                                        // There are waiting chairs
-   {
-      if (max_waiting_cust_ == waiting_customers_)             // If all waiting chairs are full:
-      {
-         print(custID, "leaves the shop because of no available waiting chairs.");
-         ++cust_drops_;
+// --------------------------- int visitShopBatch(const int*, int, int*, WaitTicket**, ...)
+// visitShop() for a burst of customers arriving together: each one is
+//   seated, given a waiting chair or dropped as visitShop() would, in
+//   order, but under one acquisition of mutex_. Each barber seated is
+//   signaled as he is seated, with mutex_ held as every Sync policy
+//   requires (see Sync.h).
+// A customer given a waiting chair has not been served yet: their
+//   thread calls awaitVisit() with their visit to wait for a barber.
+//
+// pre: n >= 0; every array has n entries; 0 <= services[i] < kMaxServices
+// param: custIDs      IDs of the customers, in order of arrival
+// param: n            Number of customers
+// param: results      Receives per customer the barber seating them,
+//   -1 if dropped or kVisitQueued if they took a waiting chair
+// param: visits       Per customer storage for the waiting chair, kept
+//   alive by the caller until awaitVisit() returns; the visits need not
+//   be contiguous (a customer's can live in their own record)
+// param: custClasses  Optional: CustomerClass per customer, else walk-ins
+// param: services     Optional: service type per customer, else 0
+// param: patience_ns  Optional: patience per customer, else none
+// return: Customers that took a waiting chair
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::visitShopBatch(const int* custIDs, int n, int* results, WaitTicket** visits,
+                                                    const int* custClasses, const int* services,
+                                                    const uint64_t* patience_ns)
+{
+   int queued = 0;
+   mutex_.lock();
+   for (int i = 0; i < n; i++) {
+      visits[i]->completions = NULL;
+      results[i] = admit(custIDs[i],
+                         (custClasses != NULL) ? custClasses[i] : kClassWalkIn,
+                         (services != NULL) ? services[i] : 0,
+                         (patience_ns != NULL) ? patience_ns[i] : 0,
+                         visits[i]);
+      queued += (results[i] == kVisitQueued);
+   }
+   unlockAndNotify();
+   return queued;
+}
 
-         pthread_mutex_unlock(&mutex_);                        // Leave the shop
-         return -1;
-      }
+// --------------------------- int awaitVisit(WaitTicket*, bool*)
+// Second half of visitShop() for a customer visitShopBatch() queued:
+//   waits to be called in, displaced or to run out of patience
+// Call it soon after visitShopBatch(): while a patient customer's thread
+//   is not waiting here, they cannot keep time for the other patient waiters
+//
+// pre: visitShopBatch() returned kVisitQueued for this visit
+// param: visit    The customer's entry of visits
+// param: reneged  Optional: receives whether the customer ran out of patience
+// return: ID of the barber serving the customer or -1 if they were
+//   dropped or reneged
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::awaitVisit(WaitTicket* visit, bool* reneged)
+{
+   if (reneged != NULL) {
+      *reneged = false;
+   }
+   mutex_.lock();
+   int barbID = awaitTicket(visit, reneged);
+   mutex_.unlock();
+   return barbID;
+}
+
+// --------------------------- int tryVisitShop(int, WaitTicket*, CompletionQueue*, int, int)
+// visitShop() without waiting: the customer is seated, given a waiting
+//   chair or dropped, and the call returns at once. The rest of the
+//   visit is pushed on completions by the barber threads:
+//   - seated now: kVisitDone once the haircut is over
+//   - queued: kVisitSeated when a barber calls them in, then kVisitDone;
+//     or kVisitDropped if they are displaced
+//   - dropped: nothing
+// The customer does not call leaveShop(): the barber takes payment
+//   himself when the haircut is over. There is no patience; a caller
+//   that wants one keeps its own deadlines.
+// completions must hold two entries per visit the caller has in flight
+//   on it; the shop aborts if it ever finds the queue full, since the
+//   barber pushing holds the mutex and cannot wait for the caller to poll.
+//
+// pre: completions has room for every completion still to come
+// param: custID       ID of the customer
+// param: visit        Storage for the visit, kept alive by the caller
+//   until its kVisitDone or kVisitDropped is popped
+// param: completions  Where the rest of the visit is reported
+// param: custClass    CustomerClass of the customer
+// param: service      Service type the customer wants
+// return: ID of the barber seating the customer, -1 if dropped or
+//   kVisitQueued if they took a waiting chair
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::tryVisitShop(int custID, WaitTicket* visit, CompletionQueue* completions,
+                                                  int custClass, int service)
+{
+   visit->completions = completions;
+   mutex_.lock();
+   int barbID = admit(custID, custClass, service, 0, visit);
+   unlockAndNotify();
+   return barbID;
+}
 
-      barbID = assignBarber(custID);                           // Look for an open service chair
+// --------------------------- int admit(int, int, int, uint64_t, WaitTicket*)
+// A free service chair of a barber with the skill for the service is taken
+//   right away, otherwise the customer queues in a waiting chair of their
+//   service and class. When every waiting chair is taken, the newest
+//   waiter of the lowest class below custClass is displaced (dropped) to
+//   make room.
+//
+// pre: mutex_ is held
+// param: custID       ID of the customer
+// param: custClass    CustomerClass of the customer
+// param: service      Service type the customer wants
+// param: patience_ns  Longest wait in a waiting chair, 0 to wait forever
+// param: ticket       Storage for the waiting chair
+// return: ID of the barber seating the customer, -1 if dropped or
+//   kVisitQueued if ticket is now in a waiting queue
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::admit(int custID, int custClass, int service, uint64_t patience_ns,
+                                           WaitTicket* ticket)
+{
+   event(kEventArrive, custID, -1, custClass);
 
-      if (barbID == -1)                                        // If a chair was not found:
+   int barbID = assignBarber(custID, service);                 // Look for an open service chair
+   if (barbID == -1)                                           // Every service chair is taken
+   {
+      int reason = -1;
+      if (skill_barbers_[service] == 0) {                      // Nobody here performs the service
+         reason = kDropNoSkill;
+      }
+      else if (chairs() == 0) {                                     // No waiting chairs, only service chairs
+         reason = kDropNoServiceChair;
+      }
+      else if (class_waiting_[custClass] >= class_chairs_[custClass]) {
+         reason = kDropClassFull;                              // Class used up its share
+      }
+      else if (waiting_customers_ > chairs()) {                // Still draining after a shrink
+         reason = kDropNoWaitingChair;
+      }
+      else if (waiting_customers_ == chairs() && !displaceBelow(custClass)) {
+         reason = kDropNoWaitingChair;                         // Full of customers of this class or higher
+      }
+      if (reason != -1)
       {
-         waiting_customers_++;                                 // Increment waiting customer count
-         print(custID, "takes a waiting chair. # waiting seats available = " 
-                     + int2string(max_waiting_cust_ - waiting_customers_));
-         pthread_cond_wait(&cond_customers_waiting_, &mutex_); // Wait
-
-         barbID = assignBarber(custID);                        // Look for an open service chair
-         if (barbID == -1)          
-         {
-            print(custID, "leaves the shop because of no available service chairs.");
-            ++cust_drops_;
-            waiting_customers_--;
-
-            pthread_mutex_unlock(&mutex_);
-            return barbID;
+         dropCustomer(custID, custClass, reason);
+         event(kEventLeave, custID, -1, 0);
+         return -1;                                            // -1 means the customer leaves the shop
+      }
+
+      ticket->custID = custID;                                 // Take a waiting chair
+      ticket->custClass = custClass;
+      ticket->service = service;
+      ticket->barbID = -1;
+      ticket->displaced = false;
+      ticket->reneged = false;
+      ticket->wait_start_ns = nowNanos();
+      ticket->timer.owner = ticket;
+      ticket->timer.scheduled = false;
+      enqueue(ticket);
+      countWaiting(1);                                         // Increment waiting customer count
+      event(kEventWait, custID, -1, chairs() - waiting_customers_);
+      if (patience_ns > 0) {                                   // Patience counts from the waiting chair
+         wheel_.schedule(&ticket->timer, ticket->wait_start_ns + patience_ns);
+         if (timekeeper_ == NULL) {
+            timekeeper_ = ticket;
          }
-         waiting_customers_--;                                 // Decrement waiting customer count
       }
+      return kVisitQueued;
    }
-   print(custID, "moves to service chair[" 
-                  + int2string(barbID + 1)
-                  + string("], # waiting seats available = ") 
-                  + int2string(max_waiting_cust_ - waiting_customers_));
+   recordWait(0);
+   event(kEventSeat, custID, barbID, chairs() - waiting_customers_);
 
    in_service_[barbID] = true;
+   chair_completions_[barbID] = ticket->completions;
 
    // wake up the barber just in case if he is sleeping
-   pthread_cond_signal(&cond_barber_sleeping_[barbID]);
-
-   pthread_mutex_unlock(&mutex_);
+   cond_barber_sleeping_[barbID].signal();
    return barbID;
 }
 
-// --------------------------- int assignBarber(int)
+// --------------------------- int awaitTicket(WaitTicket*, bool*)
+// The waiter whose ticket is timekeeper_ waits with a deadline and
+//   expires every patient waiter on the way
+//
+// pre: mutex_ is held; admit() returned kVisitQueued for ticket
+// param: ticket   The customer's waiting chair
+// param: reneged  Optional: receives whether the customer ran out of patience
+// return: ID of the barber serving the customer or -1
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::awaitTicket(WaitTicket* ticket, bool* reneged)
+{
+   // Wait to be called in, displaced or to run out of patience
+   while (ticket->barbID == -1 && !ticket->displaced && !ticket->reneged) {
+      if (timekeeper_ == ticket) {                             // Keep time for every patient waiter
+         ticket->cond.wait_until(mutex_, wheel_.next_tick_ns());
+         expireWaiters(nowNanos());
+      }
+      else {
+         ticket->cond.wait(mutex_);
+      }
+   }
+   if (timekeeper_ == ticket) {                                // Leaving: someone else keeps time
+      timekeeper_ = NULL;
+      appointTimekeeper();
+   }
+   if (reneged != NULL) {
+      *reneged = ticket->reneged;
+   }
+   if (ticket->displaced || ticket->reneged) {                 // Drop or renege was already logged
+      event(kEventLeave, ticket->custID, -1, 0);
+      return -1;
+   }
+   return ticket->barbID;                                      // The barber seated us (see byeCustomer)
+}
+
+// --------------------------- int bookAppointment(int, uint64_t, uint64_t)
+// Reserves the slot [start_ns, end_ns) with one barber
+//
+// pre: None
+// param: barbID    Barber to book
+// param: start_ns  Monotonic time the appointment is due
+// param: end_ns    Monotonic time after which the slot is missed
+// return: Appointment ID for visitAppointment(), or -1 if the slot is
+//   invalid, over or overlaps another appointment of the barber
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::bookAppointment(int barbID, uint64_t start_ns, uint64_t end_ns)
+{
+   mutex_.lock();
+   int apptID = book_.book(barbID, start_ns, end_ns, nowNanos());
+   mutex_.unlock();
+   return apptID;
+}
+
+// --------------------------- bool cancelAppointment(int)
+// pre: None
+// param: apptID  ID returned by bookAppointment()
+// return: false if the appointment was already used, cancelled or purged
+// post: The slot is free for other bookings
+//
+template <typename Sync, int Barbers, int Chairs>
+bool BasicShop<Sync, Barbers, Chairs>::cancelAppointment(int apptID)
+{
+   mutex_.lock();
+   bool cancelled = book_.cancel(apptID);
+   mutex_.unlock();
+   return cancelled;
+}
+
+// --------------------------- int visitAppointment(int, int)
+// First method of a customer with an appointment, instead of visitShop()
+// Uses up the appointment. If the barber's chair is empty the customer
+//   sits down at once, even before the slot is due; otherwise they check
+//   in and wait for their barber, who calls them in ahead of any waiting
+//   customer once the slot is due. Checked-in customers do not take a
+//   waiting chair.
+// A customer arriving after the slot has ended, or with an unknown
+//   appointment, is dropped (kDropMissedAppointment).
+//
+// pre: None
+// param: custID  ID of the customer calling this method
+// param: apptID  ID returned by bookAppointment()
+// return: ID of the barber serving the customer or -1 if they were dropped
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::visitAppointment(int custID, int apptID)
+{
+   mutex_.lock();
+   event(kEventArrive, custID, -1, kClassAppointment);
+
+   Appointment appt;
+   bool booked = book_.lookup(apptID, &appt);
+   if (booked) {
+      book_.cancel(apptID);                                    // The slot is used up either way
+   }
+   if (!booked || nowNanos() >= appt.end_ns) {                 // Unknown, cancelled or too late
+      dropCustomer(custID, kClassAppointment, kDropMissedAppointment);
+      event(kEventLeave, custID, -1, 0);
+      mutex_.unlock();
+      return -1;
+   }
+
+   int barbID = appt.barbID;
+   if (customer_in_chair_[barbID] == 0 && shift_[barbID] == kBarberOn) {  // Our barber is free: sit down
+      occupyChair(barbID, custID);
+      event(kEventSeat, custID, barbID, chairs() - waiting_customers_);
+      in_service_[barbID] = true;
+      chair_completions_[barbID] = NULL;
+      cond_barber_sleeping_[barbID].signal();
+      mutex_.unlock();
+      return barbID;
+   }
+   if (shift_[barbID] != kBarberOn && checked_in_[barbID] == NULL) {
+      dropCustomer(custID, kClassAppointment, kDropBarberAway);  // Nobody would call us in
+      event(kEventLeave, custID, -1, 0);
+      mutex_.unlock();
+      return -1;
+   }
+
+   WaitTicket ticket;                                          // Check in with the barber
+   ticket.custID = custID;
+   ticket.custClass = kClassAppointment;
+   ticket.service = 0;                                         // The barber was booked, not a service
+   ticket.barbID = -1;
+   ticket.completions = NULL;
+   ticket.due_ns = appt.start_ns;
+   WaitTicket** link = &checked_in_[barbID];                   // Keep the barber's list by due_ns
+   while (*link != NULL && (*link)->due_ns <= ticket.due_ns) {
+      link = &(*link)->next;
+   }
+   ticket.next = *link;
+   *link = &ticket;
+   event(kEventCheckIn, custID, barbID, apptID);
+
+   while (ticket.barbID == -1) {                               // Wait to be called in
+      ticket.cond.wait(mutex_);
+   }
+   mutex_.unlock();                                            // The barber seated us (see byeCustomer)
+   return ticket.barbID;
+}
+
+// --------------------------- void dropCustomer(int, int, int)
+// Logs a drop and counts it against the customer's class
+//
+// pre: mutex_ is held
+// param: custID     ID of the dropped customer
+// param: custClass  CustomerClass of the customer
+// param: reason     ShopDropReason
+// post: cust_drops_ and class_drops_[custClass] are incremented
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::dropCustomer(int custID, int custClass, int reason)
+{
+   event(kEventDrop, custID, -1, reason);
+   ++cust_drops_;
+   ++class_drops_[custClass];
+}
+
+// --------------------------- bool displaceBelow(int)
+// Frees a waiting chair for a customer of custClass by dropping the
+//   newest waiter of the lowest class below it
+//
+// pre: mutex_ is held
+// param: custClass  CustomerClass of the customer that needs a chair
+// post: The displaced customer is woken and leaves without service
+// return: false if no lower class customer was waiting
+//
+template <typename Sync, int Barbers, int Chairs>
+bool BasicShop<Sync, Barbers, Chairs>::displaceBelow(int custClass)
+{
+   unsigned lower = waiting_mask_ & ~((2u << custClass) - 1);  // Classes after custClass with waiters
+   if (lower == 0) {
+      return false;
+   }
+   int victim_class = 31 - __builtin_clz(lower);               // Lowest of them
+   WaitTicket* victim = NULL;                                  // Newest waiter has waited the least
+   for (uint32_t services = service_mask_[victim_class]; services != 0; services &= services - 1) {
+      WaitTicket* tail = queue_tail_[__builtin_ctz(services)][victim_class];
+      if (victim == NULL || tail->seq > victim->seq) {
+         victim = tail;
+      }
+   }
+   unlink(victim);
+   countWaiting(-1);
+   dropCustomer(victim->custID, victim_class, kDropDisplaced);
+   victim->displaced = true;
+   wakeTicket(victim);
+   return true;
+}
+
+// --------------------------- WaitTicket* nextWaiter(uint32_t)
+// Removes and returns the waiter a barber should call in next: the oldest
+//   customer the barber is qualified for, of the class picked by strict
+//   or weighted priority
+// Classes and services are found through waiting_mask_ and service_mask_
+//   rather than by scanning queues
+//
+// pre: mutex_ is held
+// param: skills  Skill set of the barber
+// return: The ticket, or NULL if nobody the barber can serve is waiting
+//
+template <typename Sync, int Barbers, int Chairs>
+typename BasicShop<Sync, Barbers, Chairs>::WaitTicket* BasicShop<Sync, Barbers, Chairs>::nextWaiter(uint32_t skills)
+{
+   unsigned qualified = 0;                                     // Classes with waiters for these skills
+   for (unsigned classes = waiting_mask_; classes != 0; classes &= classes - 1) {
+      int c = __builtin_ctz(classes);
+      if (service_mask_[c] & skills) {
+         qualified |= 1u << c;
+      }
+   }
+   if (qualified == 0) {
+      return NULL;
+   }
+   unsigned ready = qualified;                                 // Strict: highest class with waiters
+   if (weight_mask_ != 0) {
+      ready = qualified & credit_mask_;
+      if (ready == 0) {                                        // Round is over for every waiting class
+         for (int c = 0; c < kNumClasses; c++) {
+            class_credit_[c] = class_weight_[c];
+         }
+         credit_mask_ = weight_mask_;
+         ready = qualified & credit_mask_;
+         if (ready == 0) {                                     // Only unweighted classes are waiting
+            ready = qualified;
+         }
+      }
+   }
+   int custClass = __builtin_ctz(ready);
+   if (class_credit_[custClass] > 0 && --class_credit_[custClass] == 0) {
+      credit_mask_ &= ~(1u << custClass);
+   }
+
+   WaitTicket* ticket = NULL;                                  // Oldest head among the barber's services
+   for (uint32_t services = service_mask_[custClass] & skills; services != 0; services &= services - 1) {
+      WaitTicket* head = queue_head_[__builtin_ctz(services)][custClass];
+      if (ticket == NULL || head->seq < ticket->seq) {
+         ticket = head;
+      }
+   }
+   unlink(ticket);
+   return ticket;
+}
+
+// --------------------------- WaitTicket* nextCustomer(int)
+// Removes and returns the customer barbID should call in next: a due
+//   appointment of the barber, else nextWaiter(uint32_t), else the barber's
+//   earliest appointment even though it is not due yet
+// A retiring barber only calls in his appointments
+// Waiting customers returned here no longer count as waiting
+//
+// pre: mutex_ is held
+// param: barbID  Barber whose chair just became free
+// return: The ticket, or NULL if nobody is waiting for barbID
+//
+template <typename Sync, int Barbers, int Chairs>
+typename BasicShop<Sync, Barbers, Chairs>::WaitTicket* BasicShop<Sync, Barbers, Chairs>::nextCustomer(int barbID)
+{
+   WaitTicket* appt = checked_in_[barbID];
+   uint64_t now = nowNanos();
+   if (shift_[barbID] == kBarberOn && (appt == NULL || appt->due_ns > now)) {
+      WaitTicket* next = nextWaiter(skills_[barbID]);          // No appointment due: walk-ins first
+      if (next != NULL) {
+         countWaiting(-1);
+         recordWait(now - next->wait_start_ns);
+         return next;
+      }
+   }
+   if (appt != NULL) {
+      checked_in_[barbID] = appt->next;
+   }
+   return appt;
+}
+
+// --------------------------- void enqueue(WaitTicket*)
+// Appends a ticket to its service and class queue
+//
+// pre: mutex_ is held
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::enqueue(WaitTicket* ticket)
+{
+   int c = ticket->custClass;
+   int s = ticket->service;
+   ticket->seq = wait_seq_++;
+   ticket->prev = queue_tail_[s][c];
+   ticket->next = NULL;
+   if (queue_tail_[s][c] != NULL) {
+      queue_tail_[s][c]->next = ticket;
+   }
+   else {
+      queue_head_[s][c] = ticket;
+      service_mask_[c] |= 1u << s;
+   }
+   queue_tail_[s][c] = ticket;
+   class_waiting_[c]++;
+   waiting_mask_ |= 1u << c;
+}
+
+// --------------------------- void unlink(WaitTicket*)
+// Removes a ticket from its service and class queue
+//
+// pre: mutex_ is held; ticket is queued
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::unlink(WaitTicket* ticket)
+{
+   int c = ticket->custClass;
+   int s = ticket->service;
+   if (ticket->prev != NULL) {
+      ticket->prev->next = ticket->next;
+   }
+   else {
+      queue_head_[s][c] = ticket->next;
+   }
+   if (ticket->next != NULL) {
+      ticket->next->prev = ticket->prev;
+   }
+   else {
+      queue_tail_[s][c] = ticket->prev;
+   }
+   if (queue_head_[s][c] == NULL) {
+      service_mask_[c] &= ~(1u << s);
+   }
+   if (--class_waiting_[c] == 0) {
+      waiting_mask_ &= ~(1u << c);
+   }
+   wheel_.cancel(&ticket->timer);                              // No-op unless patient and still timed
+}
+
+// --------------------------- void expireWaiters(uint64_t)
+// Makes every waiter whose patience ran out by now_ns renege
+//
+// pre: mutex_ is held
+// param: now_ns  Current monotonic time
+// post: Expired waiters have left their queues and are signaled
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::expireWaiters(uint64_t now_ns)
+{
+   TimerNode* node = wheel_.expire(now_ns);
+   while (node != NULL) {
+      TimerNode* next = node->next;
+      WaitTicket* ticket = (WaitTicket*)node->owner;
+      unlink(ticket);
+      countWaiting(-1);
+      ++reneged_;
+      ticket->reneged = true;
+      event(kEventRenege, ticket->custID, -1, chairs() - waiting_customers_);
+      ticket->cond.signal();
+      node = next;
+   }
+}
+
+// --------------------------- void appointTimekeeper()
+// Hands the timekeeper role to a patient waiter, if there is one
+//
+// pre: mutex_ is held; timekeeper_ is NULL
+// post: The new timekeeper is signaled so it starts timing
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::appointTimekeeper()
+{
+   TimerNode* node = wheel_.any();
+   if (node != NULL) {
+      timekeeper_ = (WaitTicket*)node->owner;
+      timekeeper_->cond.signal();
+   }
+}
+
+// --------------------------- int assignBarber(int, int)
 // A factored out function from the visitShop(int) method
-// Searches through barber chairs and assigns custID to the
-//   first empty chair found
+// Looks up a barber with an empty chair and the skill for service in
+//   free_[service] and assigns custID to that chair
 // Returns -1 if no chairs are available, returns the chair ID otherwise
 // 
-// pre: None
-// param: custID  ID of customer to assign to an open chair
+// pre: mutex_ is held
+// param: custID   ID of customer to assign to an open chair
+// param: service  Service type the customer wants
 // post: custID is assigned to a barber chair
 // return: -1 or ID of the barber whose chair the customer is in
 //
-int Shop::assignBarber(int custID)
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::assignBarber(int custID, int service)
 {
-   for (int barbID = 0; barbID < max_working_barb_; barbID++) {// Iterate through barbers 
+   int barbID = free_[service].first();                        // Lowest free barber with the skill
+   if (barbID != -1) {
+      occupyChair(barbID, custID);                             // Assign custID to that chair
+   }
+   return barbID;
+}
 
-      if (customer_in_chair_[barbID] == 0) {                   // until one with an empty chair is found
-         customer_in_chair_[barbID] = custID;                  // Assign custID to that chair
-         sleeping_barbs_--;
-         return barbID;                                        // Return ID of barber at the chair
+// --------------------------- void occupyChair(int, int)
+// Seats a customer in a barber's empty chair
+//
+// pre: mutex_ is held; the chair is empty
+// param: barbID  Barber whose chair it is
+// param: custID  Customer sitting down
+// post: The barber is no longer free for any of his skills
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::occupyChair(int barbID, int custID)
+{
+   customer_in_chair_[barbID] = custID;
+   for (uint32_t skills = skills_[barbID]; skills != 0; skills &= skills - 1) {
+      free_[__builtin_ctz(skills)].clear(barbID);
+   }
+}
+
+// --------------------------- void freeChair(int)
+// Empties a barber's chair
+//
+// pre: mutex_ is held
+// param: barbID  Barber whose chair it is
+// post: The barber is free for each of his skills
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::freeChair(int barbID)
+{
+   customer_in_chair_[barbID] = 0;
+   for (uint32_t skills = skills_[barbID]; shift_[barbID] == kBarberOn && skills != 0; skills &= skills - 1) {
+      free_[__builtin_ctz(skills)].set(barbID);                // Retiring barbers take no walk-ins
+   }
+}
+
+// --------------------------- void callIn(int, WaitTicket*)
+// Seats a waiting or checked-in customer in barbID's chair and wakes them
+//
+// pre: mutex_ is held; the chair is not free_ (occupied, or barbID is not
+//   kBarberOn); ticket is no longer queued
+// param: barbID  Barber calling the customer in
+// param: ticket  Customer to seat
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::callIn(int barbID, WaitTicket* ticket)
+{
+   customer_in_chair_[barbID] = ticket->custID;
+   in_service_[barbID] = true;
+   chair_completions_[barbID] = ticket->completions;
+   event(kEventSeat, ticket->custID, barbID, chairs() - waiting_customers_);
+   ticket->barbID = barbID;
+   wakeTicket(ticket);
+}
+
+// --------------------------- void wakeTicket(WaitTicket*)
+// Tells a waiting customer that barbID or displaced was set: signals
+//   their thread, or for a tryVisitShop() visit pushes kVisitSeated or
+//   kVisitDropped (logging the Leave their thread would have)
+//
+// pre: mutex_ is held; ticket is no longer queued
+// param: ticket  The customer's waiting chair
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::wakeTicket(WaitTicket* ticket)
+{
+   if (ticket->completions == NULL) {
+      ticket->cond.signal();
+   }
+   else if (ticket->displaced) {
+      event(kEventLeave, ticket->custID, -1, 0);
+      complete(ticket->completions, ticket->custID, kVisitDropped, -1);
+   }
+   else {
+      complete(ticket->completions, ticket->custID, kVisitSeated, ticket->barbID);
+   }
+}
+
+// --------------------------- void complete(CompletionQueue*, ...)
+// The caller sizes the queue so it is never full (see tryVisitShop()).
+//   A full queue is a caller bug: the poller may be blocked on mutex_,
+//   so waiting for room would hang the shop and dropping the completion
+//   would leak the visit; abort with a message instead.
+// The queue's eventfd is only noted here and written by unlockAndNotify()
+//   once mutex_ is released, so barbers never queue up behind a syscall.
+//   It is still written after the push, so a poller that reads the
+//   eventfd before draining the queue never misses a completion.
+//
+// pre: mutex_ is held; queue has room (see tryVisitShop())
+// param: queue   The visit's completion queue
+// param: custID  ID of the customer
+// param: kind    VisitCompletionKind
+// param: barbID  Barber serving the customer, -1 if dropped
+// post: The completion is on queue, or the process aborted
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::complete(CompletionQueue* queue, int custID, int kind, int barbID)
+{
+   ShopCompletion completion;
+   completion.custID = custID;
+   completion.kind = kind;
+   completion.barbID = barbID;
+   completion.start_ns = (kind == kVisitDone) ? service_start_ns_[barbID] : 0;
+   completion.end_ns = (kind == kVisitDone) ? service_end_ns_[barbID] : 0;
+   if (!queue->tryPush(completion)) {
+      cerr << "Shop: completion queue full (capacity " << queue->capacity() << "), customer[" << custID
+           << "] visit lost; see tryVisitShop()" << endl;
+      abort();
+   }
+   int fd = queue->get_notify_fd();
+   if (fd >= 0 && find(notify_fds_.begin(), notify_fds_.end(), fd) == notify_fds_.end()) {
+      notify_fds_.push_back(fd);                               // Once per queue, however many pushes
+   }
+}
+
+// --------------------------- void unlockAndNotify()
+// Every method that can reach complete() releases mutex_ through here,
+//   and so does visitShop() before it waits. The noted eventfds are
+//   swapped into a per-thread list under the mutex, so the member's
+//   storage is reused and no other thread writes them twice.
+//
+// pre: mutex_ is held
+// post: mutex_ is released and every noted eventfd was written
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::unlockAndNotify()
+{
+   if (notify_fds_.empty()) {
+      mutex_.unlock();
+      return;
+   }
+   static thread_local vector<int> fds;
+   fds.swap(notify_fds_);
+   notifying_++;                                               // Before unlocking: see awaitNotifies()
+   mutex_.unlock();
+   for (size_t i = 0; i < fds.size(); i++) {
+      uint64_t one = 1;
+      if (write(fds[i], &one, sizeof(one)) < 0 && errno != EAGAIN) {  // EAGAIN: the counter is full,
+         cerr << "Shop: could not notify completion fd " << fds[i]    //   so the poller is due to wake
+              << ": " << strerror(errno) << endl;
       }
    }
+   fds.clear();
+   notifying_--;
+}
+
+// --------------------------- void countWaiting(int)
+// Changes waiting_customers_, integrating occupancy_ up to now first
+//
+// pre: mutex_ is held
+// param: delta  +1 when a customer sits down to wait, -1 when one leaves
+//   the waiting room
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::countWaiting(int delta)
+{
+   accrueOccupancy();
+   waiting_customers_ += delta;
+   if (metrics_ != NULL) {                                     // Before the Seat, Drop or Renege it causes
+      metrics_->add((delta > 0) ? kMetricWaited : kMetricUnwaited);
+   }
+}
 
-   return -1;
+// --------------------------- void accrueOccupancy()
+// pre: mutex_ is held
+// post: occupancy_ is integrated up to now
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::accrueOccupancy()
+{
+   uint64_t now = nowNanos();
+   uint64_t elapsed = now - occupancy_.time_ns;
+   occupancy_.waiting_ns += elapsed * waiting_customers_;
+   occupancy_.chairs_ns += elapsed * chairs();
+   occupancy_.time_ns = now;
+}
+
+// --------------------------- void setActivity(int, int, uint64_t)
+// Accrues the barber's current activity up to now_ns and starts another
+//
+// pre: mutex_ is held; now_ns is not before his current activity started
+// param: barbID    Barber whose activity changes
+// param: activity  BarberActivity he starts
+// param: now_ns    When it starts
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::setActivity(int barbID, int activity, uint64_t now_ns)
+{
+   BarberTime& time = barber_time_[barbID];
+   uint64_t elapsed = now_ns - activity_since_ns_[barbID];
+   switch (time.activity) {
+   case kActivitySleeping: time.sleeping_ns += elapsed; sleeping_barbs_--; break;
+   case kActivityServing:  time.serving_ns += elapsed;                     break;
+   case kActivityCheckout: time.checkout_ns += elapsed;                    break;
+   }
+   if (activity == kActivitySleeping) {
+      sleeping_barbs_++;
+   }
+   time.activity = activity;
+   activity_since_ns_[barbID] = now_ns;
+}
+
+// --------------------------- void recordWait(uint64_t)
+// pre: mutex_ is held
+// param: wait_ns  Wait of one walk-in customer
+// post: The wait is counted in wait_hist_
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::recordWait(uint64_t wait_ns)
+{
+   int bucket = (wait_ns == 0) ? 0 : 64 - __builtin_clzll(wait_ns);
+   wait_hist_[(bucket < kWaitBuckets) ? bucket : kWaitBuckets - 1]++;
+   if (metrics_ != NULL) {
+      metrics_->addWait(wait_ns);
+   }
 }
 
 // --------------------------- void leaveShop(int, int)
 // Second customer method.
 // Uses mutex start to finish with a wait call for the barber to finish service
 // Customer then pays barber and signals him
+// The barber is held until payment, so the service times read back here
+//   always belong to this customer's haircut
 //
 // pre: barberID is a valid return value from a preceding call to visitShop(int)
 // param: custID    ID of the customer calling this method
 // param: barberID  ID of the barber serving this customer
+// param: start_ns  Optional: receives the monotonic time service started
+// param: end_ns    Optional: receives the monotonic time service ended
 // post: Customer thread has set and signaled "paid" for their barber
 //
-void Shop::leaveShop(int custID, int barberID)
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::leaveShop(int custID, int barberID, uint64_t* start_ns, uint64_t* end_ns)
 {
    int barbID = barberID;
-   pthread_mutex_lock(&mutex_);
+   mutex_.lock();
 
    // Wait for service to be completed
-   print(custID, "wait for barber[" 
-                  + int2string(barbID + 1)
-                  + string("] to be done with hair-cut"));
+   event(kEventAwait, custID, barbID, 0);
    while (in_service_[barbID] == true)    {
-      pthread_cond_wait(&cond_customer_served_[barbID], &mutex_);
+      cond_customer_served_[barbID].wait(mutex_);
+   }
+   if (start_ns != NULL) {                                     // Report service times before paying
+      *start_ns = service_start_ns_[barbID];
+   }
+   if (end_ns != NULL) {
+      *end_ns = service_end_ns_[barbID];
    }
 
    // Pay the barber and signal barber appropriately
    money_paid_[barbID] = true;
-   pthread_cond_signal(&cond_barber_paid_[barbID]);
-   print(custID, "says good-bye to barber[" 
-                  + int2string(barbID + 1) 
-                  + string("]"));
+   cond_barber_paid_[barbID].signal();
+   event(kEventPay, custID, barbID, 0);
+   event(kEventLeave, custID, barbID, 0);
+
+   mutex_.unlock();
+}
+
+// --------------------------- int addBarber(uint32_t)
+// Puts another barber to work while the shop is open; the caller then
+//   runs a barber thread with the returned ID
+// If a waiting customer needs his skills he is seated right away
+//
+// pre: None
+// param: skills  Services the barber can perform (see set_barber_skills())
+// return: ID of the new barber, or -1 if max_barbers are already working
+//   or still finishing
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::addBarber(uint32_t skills)
+{
+   mutex_.lock();
+   int barbID = 0;
+   while (barbID < barbers() && shift_[barbID] != kBarberOff) {
+      barbID++;
+   }
+   if (barbID == barbers()) {
+      mutex_.unlock();
+      return -1;
+   }
+   shift_[barbID] = kBarberOn;
+   setActivity(barbID, kActivitySleeping, nowNanos());
+   skills_[barbID] = skills;
+   working_barbs_++;
+   for (uint32_t s = skills; s != 0; s &= s - 1) {
+      skill_barbers_[__builtin_ctz(s)]++;
+   }
+   event(kEventHire, 0, barbID, (int)skills);
+
+   WaitTicket* next = nextWaiter(skills);                      // Someone may be waiting for him
+   if (next != NULL) {
+      countWaiting(-1);
+      recordWait(nowNanos() - next->wait_start_ns);
+      callIn(barbID, next);
+   }
+   else {
+      freeChair(barbID);
+   }
+   unlockAndNotify();
+   return barbID;
+}
+
+// --------------------------- bool retireBarber(int)
+// Takes a barber off the floor: he gets no more walk-ins, finishes his
+//   current customer and checked-in appointments, and then his
+//   helloCustomer() returns 0. Waiting customers whose service nobody
+//   else performs are dropped (kDropNoSkill).
+//
+// pre: None
+// param: barbID  Barber to retire
+// return: false if the barber was not working
+//
+template <typename Sync, int Barbers, int Chairs>
+bool BasicShop<Sync, Barbers, Chairs>::retireBarber(int barbID)
+{
+   mutex_.lock();
+   if (barbID < 0 || barbID >= barbers() || shift_[barbID] != kBarberOn) {
+      mutex_.unlock();
+      return false;
+   }
+   shift_[barbID] = kBarberRetiring;
+   working_barbs_--;
+   event(kEventRetire, 0, barbID, 0);
+   for (uint32_t skills = skills_[barbID]; skills != 0; skills &= skills - 1) {
+      int s = __builtin_ctz(skills);
+      free_[s].clear(barbID);
+      if (--skill_barbers_[s] > 0) {
+         continue;
+      }
+      for (int c = 0; c < kNumClasses; c++) {                  // Nobody left to serve them
+         while (queue_head_[s][c] != NULL) {
+            WaitTicket* ticket = queue_head_[s][c];
+            unlink(ticket);
+            countWaiting(-1);
+            dropCustomer(ticket->custID, c, kDropNoSkill);
+            ticket->displaced = true;
+            wakeTicket(ticket);
+         }
+      }
+   }
+   cond_barber_sleeping_[barbID].signal();                     // Let him go if he is asleep
+   unlockAndNotify();
+   return true;
+}
 
-   pthread_mutex_unlock(&mutex_);
+// --------------------------- bool resizeWaitingRoom(int)
+// Changes the number of waiting chairs while the shop is open
+// Growing admits waiters at once. Shrinking below the customers waiting
+//   evicts nobody: arrivals are turned away (kDropNoWaitingChair) until
+//   enough waiters have been called in or reneged. Class limits set with
+//   set_class_chairs() are kept as they are.
+//
+// pre: None
+// param: num_chairs  New number of waiting chairs
+// return: false if num_chairs is negative or the shop is fixed-size
+//
+template <typename Sync, int Barbers, int Chairs>
+bool BasicShop<Sync, Barbers, Chairs>::resizeWaitingRoom(int num_chairs)
+{
+   if (Barbers > 0 || num_chairs < 0) {                        // Chairs is a compile-time constant
+      return false;
+   }
+   mutex_.lock();
+   accrueOccupancy();                                          // The old size counts up to now
+   max_waiting_cust_.store(num_chairs, memory_order_relaxed);  // Readers of the limit hold mutex_
+   event(kEventResize, 0, -1, num_chairs);                     //   or only want a recent value
+   mutex_.unlock();
+   return true;
 }
 
-// --------------------------- void helloCustomer(int)
+// --------------------------- int helloCustomer(int)
 // First barber method.
 // Uses mutex start to finish with a wait call for a customer to sit in his chair
 // Waits for a customer to come get them, sleeps if there are no waiting customers
@@ -289,69 +1257,389 @@ void Shop::leaveShop(int custID, int barberID)
 // pre: barbID >= 0
 // param: barbID  ID value to be used for this barber thread
 // post: Haircut service begins for the customer in this barber's chair
+// return: ID of the customer being served, or 0 once the shop is closed
+//   or the barber has retired
 //
-void Shop::helloCustomer(int barbID)
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::helloCustomer(int barbID)
 {
-   pthread_mutex_lock(&mutex_);
+   int custID;
+   mutex_.lock();
 
    // If no customers then barber can sleep
-   if (waiting_customers_ == 0 && customer_in_chair_[barbID] == 0) {
-      print(-(barbID + 1), "sleeps because of no customers.");
-      sleeping_barbs_++;
-      pthread_cond_wait(&cond_barber_sleeping_[barbID], &mutex_);
+   if (waiting_customers_ == 0 && customer_in_chair_[barbID] == 0 && !closed_
+       && shift_[barbID] == kBarberOn) {
+      event(kEventSleep, 0, barbID, 0);
+      cond_barber_sleeping_[barbID].wait(mutex_);
+      SHOP_PROBE3(wakeup, 0, barbID, 0);
+      if (metrics_ != NULL) {
+         metrics_->add(kMetricWakeups);
+      }
    }
 
-   while (customer_in_chair_[barbID] == 0)                     // Check if a customer sat down
-   {
-      pthread_cond_wait(&cond_barber_sleeping_[barbID], &mutex_);
+   while (customer_in_chair_[barbID] == 0 && !closed_ && shift_[barbID] == kBarberOn)
+   {                                                           // Check if a customer sat down
+      cond_barber_sleeping_[barbID].wait(mutex_);
    }
 
-   print(-(barbID + 1), "starts a hair-cut service for customer[" 
-                         + int2string(customer_in_chair_[barbID]) 
-                         + string("]"));
+   custID = customer_in_chair_[barbID];
+   if (custID == 0) {                                          // Closed or retired with an empty chair
+      setActivity(barbID, kActivityAway, nowNanos());
+      if (shift_[barbID] == kBarberRetiring) {
+         shift_[barbID] = kBarberOff;                          // The ID can be given out again
+         event(kEventOffShift, 0, barbID, 0);
+      }
+      mutex_.unlock();
+      return 0;
+   }
+   service_start_ns_[barbID] = nowNanos();
+   setActivity(barbID, kActivityServing, service_start_ns_[barbID]);
+   event(kEventStart, custID, barbID, 0);
 
-   pthread_mutex_unlock(&mutex_);
+   mutex_.unlock();                                            // Unlock
+   return custID;
 }
 
 // --------------------------- void byeCustomer(int)
 // Second barber method.
 // Uses mutex start to finish with a wait call for a customer to pay
 // Completes the haircut service then requests payment from customer
-// Once he receives confirmation the barber clears his chair and signals
-//   another customer to sit
+// Once he receives confirmation the barber clears his chair and hands it
+//   to the next customer: a checked-in appointment that is due, else the
+//   next waiting customer (see nextWaiter(uint32_t)), else an early appointment
 // 
 // pre: A customer is waiting for this barber's haircut to finish
 // param: barbID  ID value of this barber thread
 // post: Customer associated with this barber is released and a new one is signaled
 //
-void Shop::byeCustomer(int barbID)
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::byeCustomer(int barbID)
 {
-   pthread_mutex_lock(&mutex_); // lock
+   mutex_.lock(); // lock
 
    // Hair Cut-Service is done so signal customer and wait for payment
    in_service_[barbID] = false;
-   print(-(barbID + 1), "says he's done with a hair-cut service for customer[" 
-                         + int2string(customer_in_chair_[barbID]) 
-                         + string("]"));
+   service_end_ns_[barbID] = nowNanos();
+   setActivity(barbID, kActivityCheckout, service_end_ns_[barbID]);
+   event(kEventDone, customer_in_chair_[barbID], barbID, 0);
    money_paid_[barbID] = false;
 
-   pthread_cond_signal(&cond_customer_served_[barbID]);        // Signal customer to pay for haircut
-   pthread_cond_wait(&cond_barber_paid_[barbID], &mutex_);
+   if (chair_completions_[barbID] != NULL) {                   // No thread to pay: take it ourselves
+      int custID = customer_in_chair_[barbID];
+      money_paid_[barbID] = true;
+      event(kEventPay, custID, barbID, 0);
+      event(kEventLeave, custID, barbID, 0);
+      complete(chair_completions_[barbID], custID, kVisitDone, barbID);
+      chair_completions_[barbID] = NULL;
+   }
+   cond_customer_served_[barbID].signal();                     // Signal customer to pay for haircut
+   while (!money_paid_[barbID]) {
+      cond_barber_paid_[barbID].wait(mutex_);
+   }
 
    //Signal to customer to get next one
-   customer_in_chair_[barbID] = 0;
-   print(-(barbID + 1), "calls in another customer");
-   sleeping_barbs_++;
-   pthread_cond_signal(&cond_customers_waiting_);
+   setActivity(barbID, kActivitySleeping, nowNanos());
+   event(kEventNext, 0, barbID, 0);
+
+   WaitTicket* next = nextCustomer(barbID);
+   if (next != NULL) {                                         // Seat them here and now, so no arrival
+      callIn(barbID, next);                                    //   can take the chair in between
+   }
+   else {
+      freeChair(barbID);
+   }
+
+   unlockAndNotify();  // unlock
+}
+
+// --------------------------- void closeShop()
+// Closes the shop for the day
+// Sleeping barbers are woken, and helloCustomer(int) returns 0 instead of
+//   waiting once the barber's chair is empty, so barber threads can leave
+//   their loop and be joined
+//
+// pre: Every customer thread has left the shop
+// post: Barbers stop waiting for customers
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::closeShop()
+{
+   mutex_.lock();
+   closed_ = true;
+   for (int i = 0; i < barbers(); i++) {
+      cond_barber_sleeping_[i].broadcast();
+   }
+   mutex_.unlock();
+}
 
-   pthread_mutex_unlock(&mutex_);  // unlock
+// --------------------------- void awaitNotifies()
+// A completion is pushed and its eventfd noted in one critical section,
+//   and unlockAndNotify() counts itself in before that section ends, so
+//   taking mutex_ once is enough to see every writer still owed
+//
+// pre: None
+// post: No completion queue's eventfd is still to be written for a
+//   completion already pushed
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::awaitNotifies()
+{
+   mutex_.lock();
+   mutex_.unlock();
+   while (notifying_.load() != 0) {
+      sched_yield();                                           // A write or two: not worth a condition
+   }
 }
 
 // --------------------------- int get_cust_drops()
 // pre: None
 // return: cust_drops_
 //
-int Shop::get_cust_drops() const
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_cust_drops() const
+{
+   mutex_.lock();
+   int drops = cust_drops_;
+   mutex_.unlock();
+   return drops;
+}
+
+// --------------------------- int get_reneged()
+// pre: None
+// return: Customers who ran out of patience in a waiting chair
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_reneged() const
+{
+   mutex_.lock();
+   int reneged = reneged_;
+   mutex_.unlock();
+   return reneged;
+}
+
+// --------------------------- int get_working_barbers()
+// pre: None
+// return: Barbers working and not retiring
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_working_barbers() const
+{
+   mutex_.lock();
+   int working = working_barbs_;
+   mutex_.unlock();
+   return working;
+}
+
+// --------------------------- int get_waiting()
+// pre: None
+// return: Customers in waiting chairs right now
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_waiting() const
+{
+   mutex_.lock();
+   int waiting = waiting_customers_;
+   mutex_.unlock();
+   return waiting;
+}
+
+// --------------------------- void get_wait_histogram(uint64_t*)
+// Waits of walk-in customers from arrival to service chair so far,
+//   including the ones seated at once
+//
+// pre: None
+// param: counts  Receives kWaitBuckets counts; bucket b holds waits
+//   below 2^b ns (bucket 0: no wait)
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::get_wait_histogram(uint64_t* counts) const
+{
+   mutex_.lock();
+   for (int b = 0; b < kWaitBuckets; b++) {
+      counts[b] = wait_hist_[b];
+   }
+   mutex_.unlock();
+}
+
+// --------------------------- int get_sleeping_barbers()
+// pre: None
+// return: Barbers on shift waiting for a customer right now
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_sleeping_barbers() const
+{
+   mutex_.lock();
+   int sleeping = sleeping_barbs_;
+   mutex_.unlock();
+   return sleeping;
+}
+
+// --------------------------- void get_barber_time(int, BarberTime*)
+// pre: 0 <= barbID < the shop's most barbers
+// param: barbID  Barber to read
+// param: time    Receives his time on shift up to now
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::get_barber_time(int barbID, BarberTime* time) const
+{
+   mutex_.lock();
+   *time = barber_time_[barbID];
+   uint64_t elapsed = nowNanos() - activity_since_ns_[barbID];
+   switch (time->activity) {
+   case kActivitySleeping: time->sleeping_ns += elapsed; break;
+   case kActivityServing:  time->serving_ns += elapsed;  break;
+   case kActivityCheckout: time->checkout_ns += elapsed; break;
+   }
+   mutex_.unlock();
+}
+
+// --------------------------- int get_chairs()
+// Reads the waiting room size without taking the mutex
+//
+// pre: None
+// return: Waiting chairs right now
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_chairs() const
+{
+   return chairs();
+}
+
+// --------------------------- void get_occupancy(ShopOccupancy*)
+// pre: None
+// param: occupancy  Receives the waiting room use up to now
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::get_occupancy(ShopOccupancy* occupancy) const
+{
+   mutex_.lock();
+   uint64_t now = nowNanos();
+   uint64_t elapsed = now - occupancy_.time_ns;
+   occupancy->time_ns = now;
+   occupancy->waiting_ns = occupancy_.waiting_ns + elapsed * waiting_customers_;
+   occupancy->chairs_ns = occupancy_.chairs_ns + elapsed * chairs();
+   occupancy->waiting = waiting_customers_;
+   occupancy->chairs = chairs();
+   mutex_.unlock();
+}
+
+// --------------------------- int get_class_drops(int)
+// pre: 0 <= custClass < kNumClasses
+// return: Customers of custClass who did not receive a service
+//
+template <typename Sync, int Barbers, int Chairs>
+int BasicShop<Sync, Barbers, Chairs>::get_class_drops(int custClass) const
+{
+   mutex_.lock();
+   int drops = class_drops_[custClass];
+   mutex_.unlock();
+   return drops;
+}
+
+// --------------------------- void set_class_chairs(int, int)
+// Limits the waiting chairs customers of one class may hold at a time
+// Every class may use every waiting chair by default
+//
+// pre: Called before any thread uses this Shop; 0 <= custClass < kNumClasses
+// param: custClass  CustomerClass to limit
+// param: chairs     Waiting chairs the class may hold
+// post: Customers of custClass are dropped when the class holds chairs
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::set_class_chairs(int custClass, int chairs)
+{
+   class_chairs_[custClass] = chairs;
+}
+
+// --------------------------- void set_barber_skills(int, uint32_t)
+// Sets the services a barber can perform, one bit per service type
+// Every barber can only perform service 0 by default
+//
+// pre: Called before any thread uses this Shop; 0 <= barbID < barbers
+// param: barbID  Barber to change
+// param: skills  Bit s set if the barber can perform service s
+// post: The barber serves walk-ins of exactly these services
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::set_barber_skills(int barbID, uint32_t skills)
+{
+   for (int s = 0; shift_[barbID] == kBarberOn && s < kMaxServices; s++) {
+      if (skills_[barbID] & (1u << s)) {
+         skill_barbers_[s]--;
+         free_[s].clear(barbID);
+      }
+      if (skills & (1u << s)) {
+         skill_barbers_[s]++;
+         free_[s].set(barbID);                                 // Chairs are empty before opening
+      }
+   }
+   skills_[barbID] = skills;
+}
+
+// --------------------------- void set_class_weight(int, int)
+// Switches from strict to weighted priority: in every round barbers call
+//   in up to weight customers of each class, highest class first, and
+//   classes with weight 0 only when no weighted class is waiting
+// All weights are 0 by default, which means strict priority
+//
+// pre: Called before any thread uses this Shop; 0 <= custClass < kNumClasses
+// param: custClass  CustomerClass to weigh
+// param: weight     Customers called in per round, >= 0
+// post: Priority is weighted if any class has a weight
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::set_class_weight(int custClass, int weight)
+{
+   class_weight_[custClass] = weight;
+   class_credit_[custClass] = weight;
+   if (weight > 0) {
+      weight_mask_ |= 1u << custClass;
+   }
+   else {
+      weight_mask_ &= ~(1u << custClass);
+   }
+   credit_mask_ = weight_mask_;
+}
+
+// --------------------------- void set_event_log(EventLog*)
+// Attaches a binary event log that every state transition is written to
+//
+// pre: Called before any thread uses this Shop
+// param: log  Open EventLog that outlives this Shop's threads, or NULL
+// post: Transitions are appended to log
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::set_event_log(EventLog* log)
+{
+   event_log_ = log;
+}
+
+// --------------------------- void set_metrics(ShopMetrics*)
+// Attaches sharded counters that every state transition is added to
+//
+// pre: Called before any thread uses this Shop
+// param: metrics  ShopMetrics that outlive this Shop's threads, or NULL
+// post: Transitions are counted in metrics
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::set_metrics(ShopMetrics* metrics)
+{
+   metrics_ = metrics;
+   if (metrics_ != NULL) {
+      metrics_->add(kMetricShiftStarts, working_barbs_);       // The barbers the shop opens with
+   }
+}
+
+// --------------------------- void set_print(bool)
+// Turns the console output of state transitions on or off
+// Printing is on by default
+//
+// pre: Called before any thread uses this Shop
+// param: enabled  Whether transitions are printed
+// post: Transitions are printed only if enabled
+//
+template <typename Sync, int Barbers, int Chairs>
+void BasicShop<Sync, Barbers, Chairs>::set_print(bool enabled)
 {
-   return cust_drops_;
+   print_enabled_ = enabled;
 }
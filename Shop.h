@@ -12,6 +12,57 @@
  * The Shop class is a monitor for barber and customer threads
  * Shop coordinates the interactions between these threads
  *   using various signals, condition variables, and a mutex
+ * BasicShop takes the mutex and condition variable types from a
+ *   synchronization policy (see Sync.h); Shop is the pthread version.
+ *   The policies are explicitly instantiated in Shop.cpp.
+ * BasicShop<Sync, Barbers, Chairs> with Barbers > 0 is sized at compile
+ *   time: its arrays live inside the object and its loops have constant
+ *   bounds. FixedShop<Barbers, Chairs> is the pthread version. Only the
+ *   build's production size, SHOP_FIXED_BARBERS x SHOP_FIXED_CHAIRS, is
+ *   instantiated.
+ * Customers belong to a CustomerClass. Waiting customers queue per class
+ *   and barbers call in the highest class first (strict priority) or by
+ *   weighted round robin; a customer who finds the waiting room full takes
+ *   the chair of the newest waiter of the lowest class below their own.
+ * A customer may bring limited patience and renege (leave unserved) if
+ *   no barber calls them in before it runs out. Deadlines sit in a
+ *   TimerWheel; only one waiter at a time (the timekeeper) sleeps with a
+ *   timeout and expires everyone's deadlines, so the cost does not grow
+ *   with the number of patient waiters.
+ * Customers may also book a time slot with a barber in advance (see
+ *   AppointmentBook). Checked-in appointment customers wait for their own
+ *   barber without taking a waiting chair; once the slot is due the
+ *   barber calls them in ahead of every waiting customer, and until then
+ *   walk-ins fill the gaps.
+ * Customers ask for a service type and barbers have a skill set (one bit
+ *   per service). Free barbers are kept in one Bitmap per skill, so a
+ *   qualified barber is found without scanning the barbers, and waiters
+ *   queue per service within their class. By default every barber only
+ *   has skill 0, the plain haircut.
+ * Barbers can be hired and retired while the shop is open. Every
+ *   per-barber array is sized for the most barbers that can work at a
+ *   time, so nothing moves under running threads; a retiring barber
+ *   finishes his customer (and checked-in appointments) and then leaves
+ *   his helloCustomer() loop. Autoscaler hires and retires barbers from
+ *   the waiting room occupancy and the wait-time histogram.
+ * The waiting room can be resized while customers wait. The limit is an
+ *   atomic written under the mutex, so admission reads it with the lock
+ *   it already holds and get_chairs() reads it without any. Shrinking
+ *   turns new waiters away until the room has drained below the new size;
+ *   nobody already waiting is evicted. Occupancy is integrated over time
+ *   (see get_occupancy()).
+ * Transitions can also be counted in ShopMetrics, which any thread can
+ *   read at any time without taking the mutex (see set_metrics()), and
+ *   traced with perf or bpftrace through USDT probes (see ShopProbes.h).
+ * Every barber's time on shift is split into sleeping (waiting for a
+ *   customer), serving and checkout (waiting to be paid) on the monotonic
+ *   clock (see get_barber_time()), which is what staffing is sized from.
+ * Besides the blocking visitShop()/leaveShop() pair, a customer can be
+ *   driven without a thread of their own: tryVisitShop() never waits, and
+ *   the rest of the visit (called in, done and paid, or dropped) arrives
+ *   as ShopCompletions on a CompletionQueue the caller polls. The barber
+ *   takes payment himself for such a customer, so an event loop with a
+ *   few threads can keep many visits in flight.
  * 
  * Assumptions:
  * The driver using this class calls the below methods in an appropriate
@@ -21,72 +72,393 @@
 
 #ifndef Shop_H_
 #define Shop_H_
+#include <array>
+#include <atomic>
 #include <pthread.h>
+#include <stdint.h>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <vector>
+#include "AppointmentBook.h"
+#include "Bitmap.h"
+#include "EventLog.h"
+#include "Metrics.h"
+#include "MpmcRing.h"
+#include "Sync.h"
+#include "TimerWheel.h"
 
 using namespace std;
 
 #define kDefaultNumChairs 3 	// the default number of chairs for waiting = 3 
 #define kDefaultBarbers 1  // the default number of barbers = 1 
+#define kPatienceTickUs 1000    // resolution of patience deadlines
+#define kMaxServices 32         // service types, one skill bit each in a barber's skill set
+#define kVisitQueued -2         // visitShopBatch(): the customer took a waiting chair
 
-class Shop
+// Customer priority classes, highest first
+enum CustomerClass
+{
+   kClassVip = 0,
+   kClassAppointment = 1,
+   kClassWalkIn = 2,
+   kNumClasses
+};
+
+#ifndef SHOP_FIXED_BARBERS       // production size of FixedShop, set by the build
+#define SHOP_FIXED_BARBERS 4
+#endif
+#ifndef SHOP_FIXED_CHAIRS
+#define SHOP_FIXED_CHAIRS 4
+#endif
+
+// ShopOccupancy struct
+// Waiting room use integrated over time since the shop opened; the mean
+//   occupancy between two snapshots a and b is
+//   (b.waiting_ns - a.waiting_ns) / (b.chairs_ns - a.chairs_ns)
+struct ShopOccupancy
+{
+   uint64_t time_ns;           // When the snapshot was taken
+   uint64_t waiting_ns;        // Sum over time of waiting customers x ns
+   uint64_t chairs_ns;         // Sum over time of waiting chairs x ns
+   int waiting;                // Waiting customers at time_ns
+   int chairs;                 // Waiting chairs at time_ns
+};
+
+// BarberTime struct
+// One barber's time on shift since the shop opened, by activity; time
+//   off shift is not counted. Utilization is serving_ns / total
+struct BarberTime
+{
+   uint64_t sleeping_ns;       // Waiting for a customer, until his haircut starts
+   uint64_t serving_ns;        // From helloCustomer() returning to byeCustomer()
+   uint64_t checkout_ns;       // Waiting for the customer to pay
+   int activity;               // What he is doing now: BarberActivity
+};
+
+// BarberActivity enum
+// What a barber is doing, see BarberTime
+enum BarberActivity
+{
+   kActivityAway,              // Off shift
+   kActivitySleeping,
+   kActivityServing,
+   kActivityCheckout
+};
+
+// VisitCompletionKind enum
+// What a ShopCompletion reports
+enum VisitCompletionKind
+{
+   kVisitSeated,               // A barber called the waiting customer in; service starts
+   kVisitDone,                 // Service is over and paid for; the visit is finished
+   kVisitDropped               // The waiting customer was displaced or nobody left has the skill
+};
+
+// ShopCompletion struct
+// One step of a visit started with tryVisitShop()
+struct ShopCompletion
+{
+   int custID;
+   int kind;                   // VisitCompletionKind
+   int barbID;                 // Barber serving the customer, -1 if dropped
+   uint64_t start_ns;          // kVisitDone: monotonic time service started
+   uint64_t end_ns;            // kVisitDone: monotonic time service ended
+};
+
+// CompletionQueue class
+// Completions of the tryVisitShop() visits of one caller, in the order
+//   the shop saw them; a visit puts at most two on it (Seated, then Done)
+// With a notify fd (an eventfd) the shop also adds 1 to it once it has
+//   released its mutex after pushing, so an event loop can sleep in epoll
+//   instead of polling
+class CompletionQueue : public MpmcRing<ShopCompletion>
 {
 public:
+   CompletionQueue(size_t capacity, int notify_fd = -1) :
+      MpmcRing<ShopCompletion>(capacity),
+      notify_fd_(notify_fd) {};
+   int get_notify_fd() const { return notify_fd_; };
+private:
+   int notify_fd_;
+};
+
+// ShopArray class
+// One entry per barber: inline std::array storage when N > 0, a heap
+// array sized by allocate() when N == 0
+template <typename T, int N>
+class ShopArray
+{
+public:
+   void allocate(int) {};
+   T& operator[](int i) { return items_[i]; };
+   const T& operator[](int i) const { return items_[i]; };
+private:
+   array<T, N> items_;
+};
+
+template <typename T>
+class ShopArray<T, 0>
+{
+public:
+   ShopArray() : items_(NULL) {};
+   ~ShopArray() { delete []items_; };
+   void allocate(int n) { items_ = new T[(n > 0) ? n : 0]; };
+   T& operator[](int i) { return items_[i]; };
+   const T& operator[](int i) const { return items_[i]; };
+private:
+   T* items_;
+   ShopArray(const ShopArray&);
+   ShopArray& operator=(const ShopArray&);
+};
+
+template <typename Sync, int Barbers = 0, int Chairs = 0>
+class BasicShop
+{
+   static_assert(Barbers >= 0 && Chairs >= 0, "a shop cannot have negative capacity");
+   static_assert(Barbers > 0 || Chairs == 0, "a runtime-sized shop takes its chairs at runtime");
+
+public:
+   typedef typename Sync::mutex_type mutex_type;
+   typedef typename Sync::cond_type cond_type;
+
    // --------------------------- Parameter constructor
    // Uses init() to initialize all array values and mutex/conditions
    // Sets max barbers and chairs to default values if parameter is invalid
+   // A fixed-size shop ignores the parameters and uses Barbers and Chairs
    // 
    // pre: None
-   // param: num_barbers  Maximum allowed number of barbers working at a time
+   // param: num_barbers  Number of barbers working when the shop opens
    // param: num_chairs   Maximum number of waiting customers
+   // param: max_barbers  Most barbers that can work at a time (see addBarber()),
+   //   at least num_barbers
    // post: Shop object can be passed threads of customers and barbers
    //
-   Shop(int num_barbers, int num_chairs);
+   BasicShop(int num_barbers, int num_chairs, int max_barbers = 0);
 
    // --------------------------- Default constructor
    // Uses init() to initialize all array values and mutex/conditions
-   // Sets max barbers and chairs to default values
+   // Sets max barbers and chairs to default values, or to Barbers and Chairs
+   //   for a fixed-size shop
    // 
    // pre: None
    // post: Shop object can be passed threads of customers and barbers
    //
-   Shop();
+   BasicShop();
 
    // --------------------------- Destructor
-   // Deletes the dynamically allocated arrays in this class (6 total)
+   // The arrays in this class free themselves (see ShopArray)
    //
-   ~Shop();
+   ~BasicShop();
 
-   // --------------------------- int visitShop(int)
-   // First customer method, closely tied with assignBarber(int).
+   // --------------------------- int visitShop(int, int, int, uint64_t, bool*)
+   // First customer method, closely tied with assignBarber(int, int).
    // Uses mutex start to finish with a wait call in the case that there are
    //   waiting chairs but no available barber.
-   // All paths lead to assignBarber(int) which returns an available barber's ID
-   // This barber is then set as in service and woken if sleeping
+   // A free service chair of a barber with the skill for the service is taken
+   //   right away, otherwise the customer queues in a waiting chair of their
+   //   service and class until a qualified barber calls them in. When
+   //   every waiting chair is taken, the newest waiter of the lowest class
+   //   below custClass is displaced (dropped) to make room.
+   // A customer with patience reneges if they are still waiting once it has
+   //   run out (up to kPatienceTickUs late); reneging is not a drop.
    // Unlike barbID, custID is not used for any indexing so the runtime value will
    //   be the same as the printout value.
    //
    // pre: Calling method either ensures against or handles the case of not finding an open barber
-   // param: custID  ID of the customer calling this method
-   // return: Returns the ID of the first available barber found or -1 if none were found
+   // param: custID     ID of the customer calling this method
+   // param: custClass  CustomerClass of the customer
+   // param: service    Service type the customer wants, 0 <= service < kMaxServices
+   // param: patience_ns  Longest wait in a waiting chair, 0 to wait forever
+   // param: reneged    Optional: receives whether the customer ran out of patience
+   // return: Returns the ID of the barber serving the customer or -1 if they
+   //   were dropped or reneged
+   //
+   int visitShop(int custID, int custClass = kClassWalkIn, int service = 0,
+                 uint64_t patience_ns = 0, bool* reneged = NULL);
+
+   // WaitTicket struct
+   // A customer in a waiting chair, or checked in for an appointment; lives
+   //   on the customer's stack in visitShop() or visitAppointment(), or
+   //   with the caller of visitShopBatch() until awaitVisit() returns.
+   //   Only the shop reads or writes its fields.
+   struct WaitTicket
+   {
+      int custID;
+      int custClass;
+      int service;                           // Service type the customer wants
+      uint64_t seq;                          // Order of arrival in the waiting room
+      uint64_t wait_start_ns;                // When the customer sat down to wait
+      int barbID;                            // Set when a barber calls the customer in, -1 before
+      bool displaced;                        // Set when dropped while waiting: a higher class
+                                             //   customer took the chair, or nobody left has the skill
+      bool reneged;                          // Set when the customer's patience ran out
+      cond_type cond;                        // Signaled when barbID, displaced or reneged is set
+      TimerNode timer;                       // Patience deadline, scheduled if patient
+      CompletionQueue* completions;          // tryVisitShop(): where the visit is reported, else NULL
+      uint64_t due_ns;                       // Appointments: when the slot starts
+      WaitTicket* prev;                      // Older waiter of the same service and class
+      WaitTicket* next;                      // Newer waiter of the same service and class
+                                             //   (appointments: later one of the barber)
+   };
+
+   // --------------------------- int visitShopBatch(const int*, int, int*, WaitTicket**, ...)
+   // visitShop() for a burst of customers arriving together: each one is
+   //   seated, given a waiting chair or dropped as visitShop() would, in
+   //   order, but under one acquisition of mutex_. Each barber seated is
+   //   signaled as he is seated.
+   // A customer given a waiting chair has not been served yet: their
+   //   thread calls awaitVisit() with their visit to wait for a barber.
+   //
+   // pre: n >= 0; every array has n entries; 0 <= services[i] < kMaxServices
+   // param: custIDs      IDs of the customers, in order of arrival
+   // param: n            Number of customers
+   // param: results      Receives per customer the barber seating them,
+   //   -1 if dropped or kVisitQueued if they took a waiting chair
+   // param: visits       Per customer storage for the waiting chair, kept
+   //   alive by the caller until awaitVisit() returns; the visits need not
+   //   be contiguous (a customer's can live in their own record)
+   // param: custClasses  Optional: CustomerClass per customer, else walk-ins
+   // param: services     Optional: service type per customer, else 0
+   // param: patience_ns  Optional: patience per customer, else none
+   // return: Customers that took a waiting chair
+   //
+   int visitShopBatch(const int* custIDs, int n, int* results, WaitTicket** visits,
+                      const int* custClasses = NULL, const int* services = NULL,
+                      const uint64_t* patience_ns = NULL);
+
+   // --------------------------- int awaitVisit(WaitTicket*, bool*)
+   // Second half of visitShop() for a customer visitShopBatch() queued:
+   //   waits to be called in, displaced or to run out of patience
+   // Call it soon after visitShopBatch(): while a patient customer's thread
+   //   is not waiting here, they cannot keep time for the other patient waiters
+   //
+   // pre: visitShopBatch() returned kVisitQueued for this visit
+   // param: visit    The customer's entry of visits
+   // param: reneged  Optional: receives whether the customer ran out of patience
+   // return: ID of the barber serving the customer or -1 if they were
+   //   dropped or reneged
+   //
+   int awaitVisit(WaitTicket* visit, bool* reneged = NULL);
+
+   // --------------------------- int tryVisitShop(int, WaitTicket*, CompletionQueue*, int, int)
+   // visitShop() without waiting: the customer is seated, given a waiting
+   //   chair or dropped, and the call returns at once. The rest of the
+   //   visit is pushed on completions by the barber threads:
+   //   - seated now: kVisitDone once the haircut is over
+   //   - queued: kVisitSeated when a barber calls them in, then kVisitDone;
+   //     or kVisitDropped if they are displaced
+   //   - dropped: nothing
+   // The customer does not call leaveShop(): the barber takes payment
+   //   himself when the haircut is over. There is no patience; a caller
+   //   that wants one keeps its own deadlines.
+   // completions must hold two entries per visit the caller has in flight
+   //   on it; the shop aborts if it ever finds the queue full, since the
+   //   barber pushing holds the mutex and cannot wait for the caller to poll.
+   //
+   // pre: completions has room for every completion still to come
+   // param: custID       ID of the customer
+   // param: visit        Storage for the visit, kept alive by the caller
+   //   until its kVisitDone or kVisitDropped is popped
+   // param: completions  Where the rest of the visit is reported
+   // param: custClass    CustomerClass of the customer
+   // param: service      Service type the customer wants
+   // return: ID of the barber seating the customer, -1 if dropped or
+   //   kVisitQueued if they took a waiting chair
    //
-   int visitShop(int custID);
+   int tryVisitShop(int custID, WaitTicket* visit, CompletionQueue* completions,
+                    int custClass = kClassWalkIn, int service = 0);
 
    // --------------------------- void leaveShop(int, int)
    // Second customer method.
    // Uses mutex start to finish with a wait call for the barber to finish service
    // Customer then pays barber and signals him
+   // The barber is held until payment, so the service times read back here
+   //   always belong to this customer's haircut
    //
    // pre: barberID is a valid return value from a preceding call to visitShop(int)
    // param: custID    ID of the customer calling this method
    // param: barberID  ID of the barber serving this customer
+   // param: start_ns  Optional: receives the monotonic time service started
+   // param: end_ns    Optional: receives the monotonic time service ended
    // post: Customer thread has set and signaled "paid" for their barber
    //
-   void leaveShop(int custID, int barberID);
+   void leaveShop(int custID, int barberID, uint64_t* start_ns = NULL, uint64_t* end_ns = NULL);
+
+   // --------------------------- int bookAppointment(int, uint64_t, uint64_t)
+   // Reserves the slot [start_ns, end_ns) with one barber
+   //
+   // pre: None
+   // param: barbID    Barber to book
+   // param: start_ns  Monotonic time the appointment is due
+   // param: end_ns    Monotonic time after which the slot is missed
+   // return: Appointment ID for visitAppointment(), or -1 if the slot is
+   //   invalid, over or overlaps another appointment of the barber
+   //
+   int bookAppointment(int barbID, uint64_t start_ns, uint64_t end_ns);
+
+   // --------------------------- bool cancelAppointment(int)
+   // pre: None
+   // param: apptID  ID returned by bookAppointment()
+   // return: false if the appointment was already used, cancelled or purged
+   // post: The slot is free for other bookings
+   //
+   bool cancelAppointment(int apptID);
+
+   // --------------------------- int visitAppointment(int, int)
+   // First method of a customer with an appointment, instead of visitShop()
+   // Uses up the appointment. If the barber's chair is empty the customer
+   //   sits down at once, even before the slot is due; otherwise they check
+   //   in and wait for their barber, who calls them in ahead of any waiting
+   //   customer once the slot is due. Checked-in customers do not take a
+   //   waiting chair.
+   // A customer arriving after the slot has ended, or with an unknown
+   //   appointment, is dropped (kDropMissedAppointment).
+   //
+   // pre: None
+   // param: custID  ID of the customer calling this method
+   // param: apptID  ID returned by bookAppointment()
+   // return: ID of the barber serving the customer or -1 if they were dropped
+   //
+   int visitAppointment(int custID, int apptID);
+
+   // --------------------------- int addBarber(uint32_t)
+   // Puts another barber to work while the shop is open; the caller then
+   //   runs a barber thread with the returned ID
+   // If a waiting customer needs his skills he is seated right away
+   //
+   // pre: None
+   // param: skills  Services the barber can perform (see set_barber_skills())
+   // return: ID of the new barber, or -1 if max_barbers are already working
+   //   or still finishing
+   //
+   int addBarber(uint32_t skills = 1);
 
-   // --------------------------- void helloCustomer(int)
+   // --------------------------- bool retireBarber(int)
+   // Takes a barber off the floor: he gets no more walk-ins, finishes his
+   //   current customer and checked-in appointments, and then his
+   //   helloCustomer() returns 0. Waiting customers whose service nobody
+   //   else performs are dropped (kDropNoSkill).
+   //
+   // pre: None
+   // param: barbID  Barber to retire
+   // return: false if the barber was not working
+   //
+   bool retireBarber(int barbID);
+
+   // --------------------------- bool resizeWaitingRoom(int)
+   // Changes the number of waiting chairs while the shop is open
+   // Growing admits waiters at once. Shrinking below the customers waiting
+   //   evicts nobody: arrivals are turned away (kDropNoWaitingChair) until
+   //   enough waiters have been called in or reneged. Class limits set with
+   //   set_class_chairs() are kept as they are.
+   //
+   // pre: None
+   // param: num_chairs  New number of waiting chairs
+   // return: false if num_chairs is negative or the shop is fixed-size
+   //
+   bool resizeWaitingRoom(int num_chairs);
+
+   // --------------------------- int helloCustomer(int)
    // First barber method.
    // Uses mutex start to finish with a wait call for a customer to sit in his chair
    // Waits for a customer to come get them, sleeps if there are no waiting customers
@@ -98,21 +470,46 @@ public:
    // pre: barbID >= 0
    // param: barbID  ID value to be used for this barber thread
    // post: Haircut service begins for the customer in this barber's chair
+   // return: ID of the customer being served, or 0 once the shop is closed
+   //   or the barber has retired
    //
-   void helloCustomer(int barbID);
+   int helloCustomer(int barbID);
    
    // --------------------------- void byeCustomer(int)
    // Second barber method.
    // Uses mutex start to finish with a wait call for a customer to pay
    // Completes the haircut service then requests payment from customer
-   // Once he receives confirmation the barber clears his chair and signals
-   //   another customer to sit
+   // Once he receives confirmation the barber clears his chair and hands it
+   //   to the next customer: a checked-in appointment that is due, else the
+   //   next waiting customer (see nextWaiter(uint32_t)), else an early appointment
    // 
    // pre: A customer is waiting for this barber's haircut to finish
    // param: barbID  ID value of this barber thread
    // post: Customer associated with this barber is released and a new one is signaled
    //
    void byeCustomer(int barbID);
+
+   // --------------------------- void closeShop()
+   // Closes the shop for the day
+   // Sleeping barbers are woken, and helloCustomer(int) returns 0 instead of
+   //   waiting once the barber's chair is empty, so barber threads can leave
+   //   their loop and be joined
+   //
+   // pre: Every customer thread has left the shop
+   // post: Barbers stop waiting for customers
+   //
+   void closeShop();
+
+   // --------------------------- void awaitNotifies()
+   // Waits until the shop has written every eventfd it owes for the
+   //   completions pushed so far, so a poller that drained its last
+   //   completion may close its eventfd
+   //
+   // pre: None
+   // post: No completion queue's eventfd is still to be written for a
+   //   completion already pushed
+   //
+   void awaitNotifies();
    
    // --------------------------- int get_cust_drops()
    // pre: None
@@ -120,71 +517,420 @@ public:
    //
    int get_cust_drops() const;
 
+   // --------------------------- int get_class_drops(int)
+   // pre: 0 <= custClass < kNumClasses
+   // return: Customers of custClass who did not receive a service
+   //
+   int get_class_drops(int custClass) const;
+
+   // --------------------------- int get_reneged()
+   // pre: None
+   // return: Customers who ran out of patience in a waiting chair
+   //
+   int get_reneged() const;
+
+   // --------------------------- int get_working_barbers()
+   // pre: None
+   // return: Barbers working and not retiring
+   //
+   int get_working_barbers() const;
+
+   // --------------------------- int get_waiting()
+   // pre: None
+   // return: Customers in waiting chairs right now
+   //
+   int get_waiting() const;
+
+   // --------------------------- void get_wait_histogram(uint64_t*)
+   // Waits of walk-in customers from arrival to service chair so far,
+   //   including the ones seated at once
+   //
+   // pre: None
+   // param: counts  Receives kWaitBuckets counts; bucket b holds waits
+   //   below 2^b ns (bucket 0: no wait)
+   //
+   void get_wait_histogram(uint64_t* counts) const;
+
+   // --------------------------- int get_sleeping_barbers()
+   // pre: None
+   // return: Barbers on shift waiting for a customer right now
+   //
+   int get_sleeping_barbers() const;
+
+   // --------------------------- void get_barber_time(int, BarberTime*)
+   // pre: 0 <= barbID < the shop's most barbers
+   // param: barbID  Barber to read
+   // param: time    Receives his time on shift up to now
+   //
+   void get_barber_time(int barbID, BarberTime* time) const;
+
+   // --------------------------- int get_chairs()
+   // Reads the waiting room size without taking the mutex
+   //
+   // pre: None
+   // return: Waiting chairs right now
+   //
+   int get_chairs() const;
+
+   // --------------------------- void get_occupancy(ShopOccupancy*)
+   // pre: None
+   // param: occupancy  Receives the waiting room use up to now
+   //
+   void get_occupancy(ShopOccupancy* occupancy) const;
+
+   // --------------------------- void set_class_chairs(int, int)
+   // Limits the waiting chairs customers of one class may hold at a time
+   // Every class may use every waiting chair by default
+   //
+   // pre: Called before any thread uses this Shop; 0 <= custClass < kNumClasses
+   // param: custClass  CustomerClass to limit
+   // param: chairs     Waiting chairs the class may hold
+   // post: Customers of custClass are dropped when the class holds chairs
+   //
+   void set_class_chairs(int custClass, int chairs);
+
+   // --------------------------- void set_barber_skills(int, uint32_t)
+   // Sets the services a barber can perform, one bit per service type
+   // Every barber can only perform service 0 by default
+   //
+   // pre: Called before any thread uses this Shop; 0 <= barbID < barbers
+   // param: barbID  Barber to change
+   // param: skills  Bit s set if the barber can perform service s
+   // post: The barber serves walk-ins of exactly these services
+   //
+   void set_barber_skills(int barbID, uint32_t skills);
+
+   // --------------------------- void set_class_weight(int, int)
+   // Switches from strict to weighted priority: in every round barbers call
+   //   in up to weight customers of each class, highest class first, and
+   //   classes with weight 0 only when no weighted class is waiting
+   // All weights are 0 by default, which means strict priority
+   //
+   // pre: Called before any thread uses this Shop; 0 <= custClass < kNumClasses
+   // param: custClass  CustomerClass to weigh
+   // param: weight     Customers called in per round, >= 0
+   // post: Priority is weighted if any class has a weight
+   //
+   void set_class_weight(int custClass, int weight);
+
+   // --------------------------- void set_event_log(EventLog*)
+   // Attaches a binary event log that every state transition is written to
+   //
+   // pre: Called before any thread uses this Shop
+   // param: log  Open EventLog that outlives this Shop's threads, or NULL
+   // post: Transitions are appended to log
+   //
+   void set_event_log(EventLog* log);
+
+   // --------------------------- void set_metrics(ShopMetrics*)
+   // Attaches sharded counters that every state transition is added to
+   //
+   // pre: Called before any thread uses this Shop
+   // param: metrics  ShopMetrics that outlive this Shop's threads, or NULL
+   // post: Transitions are counted in metrics
+   //
+   void set_metrics(ShopMetrics* metrics);
+
+   // --------------------------- void set_print(bool)
+   // Turns the console output of state transitions on or off
+   // Printing is on by default
+   //
+   // pre: Called before any thread uses this Shop
+   // param: enabled  Whether transitions are printed
+   // post: Transitions are printed only if enabled
+   //
+   void set_print(bool enabled);
+
 private:
-   const int max_waiting_cust_;              // Max number of threads that can wait
+   atomic<int> max_waiting_cust_;            // Max number of threads that can wait; written under mutex_
    const int max_working_barb_;              // Max number of barbers
    int waiting_customers_;                   // Current number of occupied waiting chairs
-   int sleeping_barbs_;                      // Currently available barbers
+   int sleeping_barbs_;                      // Barbers kActivitySleeping
+   int working_barbs_;                       // Barbers kBarberOn
    int cust_drops_;                          // Number of missed customers because shop was full
-   int* customer_in_chair_;                  // Array of customer IDs for barber chairs
-   bool* in_service_;                        // Array of barber chair usage bools
-   bool* money_paid_;                        // Array of bools for final transaction
+   ShopArray<int, Barbers> customer_in_chair_;        // Array of customer IDs for barber chairs
+   ShopArray<bool, Barbers> in_service_;              // Array of barber chair usage bools
+   ShopArray<bool, Barbers> money_paid_;              // Array of bools for final transaction
+   ShopArray<uint64_t, Barbers> service_start_ns_;    // Array of times each barber started service
+   ShopArray<uint64_t, Barbers> service_end_ns_;      // Array of times each barber finished service
+   ShopArray<CompletionQueue*, Barbers> chair_completions_;  // tryVisitShop() customer's queue, else NULL
+   vector<int> notify_fds_;                  // Eventfds of queues pushed to since mutex_ was taken
+   atomic<int> notifying_;                   // Threads writing eventfds after unlocking mutex_
+   EventLog* event_log_;                     // Binary log of transitions or NULL
+   ShopMetrics* metrics_;                    // Counters of transitions or NULL
+   bool print_enabled_;                      // Whether transitions are printed
+   bool closed_;                             // Set by closeShop()
+
+   // Where a barber is in his shift
+   enum BarberShift
+   {
+      kBarberOff,                            // Not working; his ID can be given to a new barber
+      kBarberOn,                             // Working
+      kBarberRetiring                        // Finishing his customers before leaving
+   };
+
+   WaitTicket* queue_head_[kMaxServices][kNumClasses];  // Oldest waiter of each service and class
+   WaitTicket* queue_tail_[kMaxServices][kNumClasses];  // Newest waiter of each service and class
+   uint32_t service_mask_[kNumClasses];      // Bit s set while class c has waiters for service s
+   uint64_t wait_seq_;                       // Next WaitTicket::seq
+   int class_waiting_[kNumClasses];          // Waiting chairs held by each class
+   int class_chairs_[kNumClasses];           // Waiting chairs each class may hold
+   int class_weight_[kNumClasses];           // Weighted priority: customers per round
+   int class_credit_[kNumClasses];           // Weighted priority: customers left this round
+   int class_drops_[kNumClasses];            // Dropped customers of each class
+   unsigned waiting_mask_;                   // Bit c set while class c has waiters
+   unsigned weight_mask_;                    // Bit c set if class c has a weight
+   unsigned credit_mask_;                    // Bit c set while class c has credit left
+   TimerWheel wheel_;                        // Patience deadlines of waiting customers
+   WaitTicket* timekeeper_;                  // Waiter that sleeps with a timeout, or NULL
+   int reneged_;                             // Customers who ran out of patience
+   uint64_t wait_hist_[kWaitBuckets];        // Walk-in waits, see get_wait_histogram()
+   ShopOccupancy occupancy_;                 // Integrated up to occupancy_.time_ns
+   ShopArray<int, Barbers> shift_;                    // Per barber: BarberShift
+   ShopArray<BarberTime, Barbers> barber_time_;       // Per barber: accrued up to activity_since_ns_
+   ShopArray<uint64_t, Barbers> activity_since_ns_;   // Per barber: when his activity started
+   AppointmentBook book_;                    // Booked and not yet used appointments
+   ShopArray<WaitTicket*, Barbers> checked_in_;       // Per barber: checked-in appointments by due_ns
+   ShopArray<uint32_t, Barbers> skills_;              // Per barber: services it can perform
+   int skill_barbers_[kMaxServices];         // Barbers with each skill
+   Bitmap free_[kMaxServices];               // Per skill: barbers with the skill and an empty chair
 
    // Mutexes and condition variables to coordinate threads
    // mutex_ is used in conjuction with all conditional variables
-   pthread_mutex_t mutex_;
-   pthread_cond_t  cond_customers_waiting_;  // For barbers to signal customers in waiting chairs
+   mutable mutex_type mutex_;
 
    // Array of onditions for each barber
-   pthread_cond_t* cond_customer_served_;    // For barber's final transaction
-   pthread_cond_t* cond_barber_paid_;        // For customer's final transaction
-   pthread_cond_t* cond_barber_sleeping_;    // For barber's sleep
+   ShopArray<cond_type, Barbers> cond_customer_served_;  // For barber's final transaction
+   ShopArray<cond_type, Barbers> cond_barber_paid_;      // For customer's final transaction
+   ShopArray<cond_type, Barbers> cond_barber_sleeping_;  // For barber's sleep
+
+   BasicShop(const BasicShop&);
+   BasicShop& operator=(const BasicShop&);
+
+   // --------------------------- int barbers() / int chairs()
+   // Number of barbers and waiting chairs; compile-time constants in a
+   //   fixed-size shop, so loops over the barbers can be unrolled
+   //
+   int barbers() const { return (Barbers > 0) ? Barbers : max_working_barb_; };
+   int chairs() const { return (Barbers > 0) ? Chairs : max_waiting_cust_.load(memory_order_relaxed); };
 
    // --------------------------- void init()
    // Initializes every element of every array used in this class
-   //   as well as the mutex and condition variables
+   // The mutex and condition variables initialize themselves
    // 
    // pre: None
    // post: This Shop object is initialized and ready for operation
    //
    void init();
    
-   // --------------------------- string int2string(int)
-   // Uses a stringstream to convert an int into a string
-   // 
-   // pre: None
-   // param: i  int to be converted
-   // return: string containing i
-   //
-   string int2string(int i);
-   
-   // --------------------------- void print(int, string)
-   // Prints a preformatted output based on the ID passed in
-   // If the person is negative their ID is of a barber, otherwise
-   //   it is of a customer
+   // --------------------------- void event(int, int, int, int)
+   // Records a state transition of a customer or barber
+   // The transition is appended to the event log if one is attached, and
+   //   printed in the preformatted output (see formatEvent) unless printing
+   //   was turned off with set_print(false)
    // Output format is as follows:
-   //   customer[person]:  message
+   //   customer[custID]:  message
    //      OR 
-   //   barber [-person]:  message
+   //   barber  [barbID + 1]:  message
    // 
    // pre: None
-   // param: person   ID of thread printing message
-   // param: message  Message being output for that thread
-   // post: Message is output to console as indicated above
+   // param: type    ShopEventType of the transition
+   // param: custID  ID of the customer involved, 0 if none
+   // param: barbID  ID of the barber involved, -1 if none
+   // param: arg     Type-specific argument (see ShopEventType)
+   // post: Transition is logged and/or output to console as indicated above
    //
-   void print(int person, string message);
+   void event(int type, int custID, int barbID, int arg);
    
-   // --------------------------- int assignBarber(int)
+   // --------------------------- int assignBarber(int, int)
    // A factored out function from the visitShop(int) method
-   // Searches through barber chairs and assigns custID to the
-   //   first empty chair found
+   // Looks up a barber with an empty chair and the skill for service in
+   //   free_[service] and assigns custID to that chair
    // Returns -1 if no chairs are available, returns the chair ID otherwise
    // 
-   // pre: None
-   // param: custID  ID of customer to assign to an open chair
+   // pre: mutex_ is held
+   // param: custID   ID of customer to assign to an open chair
+   // param: service  Service type the customer wants
    // post: custID is assigned to a barber chair
    // return: -1 or ID of the barber whose chair the customer is in
    //
-   int assignBarber(int custID);
+   int assignBarber(int custID, int service);
+
+   // --------------------------- void occupyChair(int, int) / void freeChair(int)
+   // Seat a customer in a barber's empty chair, or empty it, and keep the
+   //   barber's bits in free_ up to date
+   //
+   // pre: mutex_ is held
+   //
+   void occupyChair(int barbID, int custID);
+   void freeChair(int barbID);
+
+   // --------------------------- void callIn(int, WaitTicket*)
+   // Seats a waiting or checked-in customer in barbID's chair and wakes them
+   //
+   // pre: mutex_ is held; the chair is not free_ (occupied, or barbID is not
+   //   kBarberOn); ticket is no longer queued
+   // param: barbID  Barber calling the customer in
+   // param: ticket  Customer to seat
+   //
+   void callIn(int barbID, WaitTicket* ticket);
+
+   // --------------------------- void countWaiting(int)
+   // Changes waiting_customers_, integrating occupancy_ up to now first
+   //
+   // pre: mutex_ is held
+   // param: delta  +1 when a customer sits down to wait, -1 when one leaves
+   //   the waiting room
+   //
+   void countWaiting(int delta);
+
+   // --------------------------- void accrueOccupancy()
+   // pre: mutex_ is held
+   // post: occupancy_ is integrated up to now
+   //
+   void accrueOccupancy();
+
+   // --------------------------- void setActivity(int, int, uint64_t)
+   // Accrues the barber's current activity up to now_ns and starts another
+   //
+   // pre: mutex_ is held; now_ns is not before his current activity started
+   // param: barbID    Barber whose activity changes
+   // param: activity  BarberActivity he starts
+   // param: now_ns    When it starts
+   //
+   void setActivity(int barbID, int activity, uint64_t now_ns);
+
+   // --------------------------- void recordWait(uint64_t)
+   // pre: mutex_ is held
+   // param: wait_ns  Wait of one walk-in customer
+   // post: The wait is counted in wait_hist_
+   //
+   void recordWait(uint64_t wait_ns);
+
+   // --------------------------- int admit(int, int, int, uint64_t, WaitTicket*)
+   // Seats, queues or drops one arriving customer (see visitShop())
+   //
+   // pre: mutex_ is held
+   // param: custID       ID of the customer
+   // param: custClass    CustomerClass of the customer
+   // param: service      Service type the customer wants
+   // param: patience_ns  Longest wait in a waiting chair, 0 to wait forever
+   // param: ticket       Storage for the waiting chair
+   // return: ID of the barber seating the customer, -1 if dropped or
+   //   kVisitQueued if ticket is now in a waiting queue
+   //
+   int admit(int custID, int custClass, int service, uint64_t patience_ns, WaitTicket* ticket);
+
+   // --------------------------- int awaitTicket(WaitTicket*, bool*)
+   // Waits until a queued customer is called in, displaced or reneges
+   //
+   // pre: mutex_ is held; admit() returned kVisitQueued for ticket
+   // param: ticket   The customer's waiting chair
+   // param: reneged  Optional: receives whether the customer ran out of patience
+   // return: ID of the barber serving the customer or -1
+   //
+   int awaitTicket(WaitTicket* ticket, bool* reneged);
+
+   // --------------------------- void wakeTicket(WaitTicket*)
+   // Tells a waiting customer that barbID or displaced was set: signals
+   //   their thread, or for a tryVisitShop() visit pushes kVisitSeated or
+   //   kVisitDropped (logging the Leave their thread would have)
+   //
+   // pre: mutex_ is held; ticket is no longer queued
+   // param: ticket  The customer's waiting chair
+   //
+   void wakeTicket(WaitTicket* ticket);
+
+   // --------------------------- void complete(CompletionQueue*, ...)
+   // pre: mutex_ is held; queue has room (see tryVisitShop())
+   // post: The completion is on queue, or the process aborted
+   //
+   void complete(CompletionQueue* queue, int custID, int kind, int barbID);
+
+   // --------------------------- void unlockAndNotify()
+   // Releases mutex_, then writes the eventfds complete() noted
+   //
+   // pre: mutex_ is held
+   // post: mutex_ is released and every noted eventfd was written
+   //
+   void unlockAndNotify();
+
+   // --------------------------- void dropCustomer(int, int, int)
+   // Logs a drop and counts it against the customer's class
+   //
+   // pre: mutex_ is held
+   // param: custID     ID of the dropped customer
+   // param: custClass  CustomerClass of the customer
+   // param: reason     ShopDropReason
+   // post: cust_drops_ and class_drops_[custClass] are incremented
+   //
+   void dropCustomer(int custID, int custClass, int reason);
+
+   // --------------------------- bool displaceBelow(int)
+   // Frees a waiting chair for a customer of custClass by dropping the
+   //   newest waiter of the lowest class below it
+   //
+   // pre: mutex_ is held
+   // param: custClass  CustomerClass of the customer that needs a chair
+   // post: The displaced customer is woken and leaves without service
+   // return: false if no lower class customer was waiting
+   //
+   bool displaceBelow(int custClass);
+
+   // --------------------------- WaitTicket* nextWaiter(uint32_t)
+   // Removes and returns the waiter a barber should call in next: the oldest
+   //   customer the barber is qualified for, of the class picked by strict
+   //   or weighted priority
+   // Classes and services are found through waiting_mask_ and service_mask_
+   //   rather than by scanning queues
+   //
+   // pre: mutex_ is held
+   // param: skills  Skill set of the barber
+   // return: The ticket, or NULL if nobody the barber can serve is waiting
+   //
+   WaitTicket* nextWaiter(uint32_t skills);
+
+   // --------------------------- void enqueue(WaitTicket*) / void unlink(WaitTicket*)
+   // Append a ticket to, or remove it from, its service and class queue
+   //
+   // pre: mutex_ is held
+   //
+   void enqueue(WaitTicket* ticket);
+   void unlink(WaitTicket* ticket);
+
+   // --------------------------- WaitTicket* nextCustomer(int)
+   // Removes and returns the customer barbID should call in next: a due
+   //   appointment of the barber, else nextWaiter(uint32_t), else the barber's
+   //   earliest appointment even though it is not due yet
+   // A retiring barber only calls in his appointments
+   // Waiting customers returned here no longer count as waiting
+   //
+   // pre: mutex_ is held
+   // param: barbID  Barber whose chair just became free
+   // return: The ticket, or NULL if nobody is waiting for barbID
+   //
+   WaitTicket* nextCustomer(int barbID);
+
+   // --------------------------- void expireWaiters(uint64_t)
+   // Makes every waiter whose patience ran out by now_ns renege
+   //
+   // pre: mutex_ is held
+   // param: now_ns  Current monotonic time
+   // post: Expired waiters have left their queues and are signaled
+   //
+   void expireWaiters(uint64_t now_ns);
+
+   // --------------------------- void appointTimekeeper()
+   // Hands the timekeeper role to a patient waiter, if there is one
+   //
+   // pre: mutex_ is held; timekeeper_ is NULL
+   // post: The new timekeeper is signaled so it starts timing
+   //
+   void appointTimekeeper();
 };
+
+typedef BasicShop<PthreadSync> Shop;
+
+template <int Barbers, int Chairs>
+using FixedShop = BasicShop<PthreadSync, Barbers, Chairs>;
 #endif
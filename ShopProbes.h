@@ -0,0 +1,79 @@
+/** @file ShopProbes.h
+ *
+ * ShopProbes.h file:
+ * Header-only USDT (SystemTap SDT) static probes for tracing a running
+ *   shop with perf or bpftrace, without a rebuild, e.g.
+ *     perf probe -x driver sdt_shop:seat
+ *     bpftrace -e 'usdt:./driver:shop:seat { @[arg1] = count(); }'
+ *   (list them with readelf -n driver or bpftrace -l 'usdt:./driver:*')
+ * A probe site is a single nop plus an ELF note that tells the tracer
+ *   where the nop is and where its arguments live; a tracer that attaches
+ *   turns the nop into a breakpoint. Nothing is evaluated otherwise.
+ * If <sys/sdt.h> is installed it is used. Else, on x86-64 and AArch64
+ *   ELF targets, the same .note.stapsdt layout is emitted here. Anywhere
+ *   else, or with SHOP_NO_PROBES defined, the probes compile to nothing.
+ * Arguments must be integers or pointers; they are read from wherever the
+ *   compiler keeps them at the probe site (register, stack or constant).
+ *
+ * Assumptions:
+ * GCC or Clang extended asm
+ */
+
+#ifndef ShopProbes_H_
+#define ShopProbes_H_
+
+#if defined(SHOP_NO_PROBES)
+#define SHOP_PROBE3(name, a1, a2, a3) do {} while (0)
+
+#elif defined(__has_include) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SHOP_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(shop, name, a1, a2, a3)
+
+#elif defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define SHOP_SDT_S(x) #x
+#define SHOP_SDT_STR(x) SHOP_SDT_S(x)
+
+// Size of an argument as the tracer reads it, negative if signed
+#define SHOP_SDT_SIZE(x) ((int)sizeof(x) * (((__typeof__(x))-1 < (__typeof__(x))0) ? -1 : 1))
+
+// Operand list: "n" puts the size in the template as a constant (%n
+//   prints it negated, hence the minus), "nor" lets the compiler pick a
+//   constant, memory operand or register for the value
+#define SHOP_SDT_ARG(n, x) [s##n] "n" (-SHOP_SDT_SIZE(x)), [a##n] "nor" (x)
+
+// --------------------------- SHOP_PROBE3(name, a1, a2, a3)
+// Emits a nop and a stapsdt note for probe shop:name with three arguments
+// The .stapsdt.base section lets tools correct the note's addresses if
+//   the binary was prelinked
+//
+#define SHOP_PROBE3(name, a1, a2, a3)                                            \
+   __asm__ __volatile__(                                                         \
+      "990: nop\n"                                                               \
+      ".pushsection .note.stapsdt,\"?\",\"note\"\n"                              \
+      ".balign 4\n"                                                              \
+      ".4byte 992f-991f, 994f-993f, 3\n"                                         \
+      "991: .asciz \"stapsdt\"\n"                                                \
+      "992: .balign 4\n"                                                         \
+      "993: .8byte 990b\n"                                                       \
+      ".8byte _.stapsdt.base\n"                                                  \
+      ".8byte 0\n"                                                               \
+      ".asciz \"shop\"\n"                                                        \
+      ".asciz \"" SHOP_SDT_STR(name) "\"\n"                                      \
+      ".asciz \"%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3]\"\n"                      \
+      "994: .balign 4\n"                                                         \
+      ".popsection\n"                                                            \
+      ".ifndef _.stapsdt.base\n"                                                 \
+      ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"    \
+      ".weak _.stapsdt.base\n"                                                   \
+      ".hidden _.stapsdt.base\n"                                                 \
+      "_.stapsdt.base: .space 1\n"                                               \
+      ".size _.stapsdt.base, 1\n"                                                \
+      ".popsection\n"                                                            \
+      ".endif\n"                                                                 \
+      :: SHOP_SDT_ARG(1, a1), SHOP_SDT_ARG(2, a2), SHOP_SDT_ARG(3, a3))
+
+#else
+#define SHOP_PROBE3(name, a1, a2, a3) do {} while (0)
+#endif
+
+#endif
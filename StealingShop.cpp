@@ -0,0 +1,395 @@
+/** @file StealingShop.cpp
+ *
+ * StealingShop.cpp file:
+ * Barbershop monitor with a queue and a mutex per barber; idle barbers
+ *   steal waiting customers from each other's queues
+ *
+ * Assumptions:
+ * Barber IDs are 0 .. num_barbers - 1 and each runs on one thread
+ * Every customer thread has left before closeShop()
+ */
+
+#include "StealingShop.h"
+#include "Clock.h"
+
+// --------------------------- Parameter constructor
+// pre: None
+// param: num_barbers  Barbers (kDefaultBarbers if not positive)
+// param: num_chairs   Waiting chairs (kDefaultNumChairs if negative)
+// post: Every barber's queue is empty and no barber sleeps yet
+//
+StealingShop::StealingShop(int num_barbers, int num_chairs) :
+   num_barbers_((num_barbers > 0) ? num_barbers : kDefaultBarbers),
+   num_chairs_((num_chairs >= 0) ? num_chairs : kDefaultNumChairs),
+   queued_(0),
+   sleeping_(0),
+   drops_(0),
+   steals_(0),
+   closed_(false)
+{
+   desks_ = new Desk[num_barbers_];
+   for (int i = 0; i < num_barbers_; i++) {
+      desks_[i].queued = 0;
+      desks_[i].woken = false;
+      desks_[i].customer_in_chair = 0;
+      desks_[i].in_service = false;
+      desks_[i].money_paid = false;
+      for (int b = 0; b < kWaitBuckets; b++) {
+         desks_[i].wait_hist[b] = 0;
+      }
+   }
+   sleeper_words_ = (num_barbers_ + 63) / 64;
+   sleepers_ = new atomic<uint64_t>[sleeper_words_];
+   for (int w = 0; w < sleeper_words_; w++) {
+      sleepers_[w] = 0;
+   }
+}
+
+// --------------------------- Destructor
+// pre: No thread uses the shop
+//
+StealingShop::~StealingShop()
+{
+   delete []sleepers_;
+   delete []desks_;
+}
+
+// --------------------------- int visitShop(int)
+// Takes a queue slot, joins a barber's queue and waits on that desk
+//   until some barber sets the ticket's barbID
+//
+// pre: custID > 0
+// param: custID  ID of the customer
+// return: Barber who called the customer in, -1 if turned away
+//
+int StealingShop::visitShop(int custID)
+{
+   int queued = queued_.load();
+   do {
+      if (queued >= num_chairs_ + sleeping_.load()) {
+         drops_++;
+         return -1;
+      }
+   } while (!queued_.compare_exchange_weak(queued, queued + 1));
+
+   Ticket ticket;
+   ticket.custID = custID;
+   ticket.barbID = -1;
+   ticket.wait_start_ns = nowNanos();
+   int sleeper = claimSleeper();
+   ticket.desk = (sleeper >= 0) ? sleeper : shorterQueue(custID);
+
+   Desk& desk = desks_[ticket.desk];
+   desk.mutex.lock();
+   desk.queue.push_back(&ticket);
+   desk.queued.fetch_add(1);                                   // Before the sleepers are read below
+   if (sleeper >= 0) {
+      desk.woken = true;
+      desk.cond_barber_sleeping.signal();
+   }
+   desk.mutex.unlock();
+
+   if (sleeper < 0) {                                          // A barber may have gone to sleep
+      int thief = claimSleeper();                              //   without seeing this ticket
+      if (thief >= 0) {
+         wake(thief);
+      }
+   }
+
+   desk.mutex.lock();
+   while (ticket.barbID < 0) {
+      ticket.cond.wait(desk.mutex);
+   }
+   desk.mutex.unlock();
+   return ticket.barbID;
+}
+
+// --------------------------- void leaveShop(int, int)
+// Same handshake as Shop: wait for service to end, then pay
+//
+// pre: barbID was returned by visitShop(custID)
+// param: custID  ID of the customer
+// param: barbID  Barber serving the customer
+// post: The barber is paid
+//
+void StealingShop::leaveShop(int custID, int barbID)
+{
+   Desk& desk = desks_[barbID];
+   desk.mutex.lock();
+   while (desk.in_service) {
+      desk.cond_customer_served.wait(desk.mutex);
+   }
+   desk.money_paid = true;
+   desk.cond_barber_paid.signal();
+   desk.mutex.unlock();
+}
+
+// --------------------------- int helloCustomer(int)
+// Own queue first, then the other queues, then sleep
+// Before sleeping the barber sets his bit and looks at every queue once
+//   more; a customer who pushed before the bit was set is seen there,
+//   and one who pushes after it finds the bit and wakes him
+//
+// pre: 0 <= barbID < number of barbers
+// param: barbID  ID of the barber
+// return: ID of the customer in his chair, 0 once the shop is closed
+//
+int StealingShop::helloCustomer(int barbID)
+{
+   Desk& desk = desks_[barbID];
+   atomic<uint64_t>& word = sleepers_[barbID / 64];
+   uint64_t bit = (uint64_t)1 << (barbID % 64);
+
+   while (true) {
+      desk.mutex.lock();
+      if (!desk.queue.empty()) {
+         Ticket* ticket = desk.queue.front();
+         desk.queue.pop_front();
+         desk.queued.fetch_sub(1);
+         int custID = ticket->custID;
+         callIn(barbID, ticket, true);
+         desk.mutex.unlock();
+         return custID;
+      }
+      desk.mutex.unlock();
+
+      Ticket* ticket = steal(barbID);
+      if (ticket != NULL) {
+         int custID = ticket->custID;
+         callIn(barbID, ticket, false);
+         return custID;
+      }
+      if (closed_) {
+         return 0;
+      }
+
+      desk.mutex.lock();
+      desk.woken = false;
+      word.fetch_or(bit);
+      sleeping_++;
+      if (!anyQueued() && !closed_) {
+         while (!desk.woken && !closed_) {
+            desk.cond_barber_sleeping.wait(desk.mutex);
+         }
+      }
+      if (word.fetch_and(~bit) & bit) {                        // Not claimed by a customer
+         sleeping_--;
+      }
+      desk.mutex.unlock();
+   }
+}
+
+// --------------------------- void byeCustomer(int)
+// Same handshake as Shop: end service, then wait to be paid
+//
+// pre: helloCustomer(barbID) returned a customer
+// param: barbID  ID of the barber
+// post: The chair is empty
+//
+void StealingShop::byeCustomer(int barbID)
+{
+   Desk& desk = desks_[barbID];
+   desk.mutex.lock();
+   desk.in_service = false;
+   desk.cond_customer_served.signal();
+   while (!desk.money_paid) {
+      desk.cond_barber_paid.wait(desk.mutex);
+   }
+   desk.money_paid = false;
+   desk.customer_in_chair = 0;
+   desk.mutex.unlock();
+}
+
+// --------------------------- void closeShop()
+// pre: Every customer thread has left the shop
+// post: Every sleeping barber is woken and helloCustomer() returns 0
+//
+void StealingShop::closeShop()
+{
+   closed_ = true;
+   for (int i = 0; i < num_barbers_; i++) {
+      desks_[i].mutex.lock();
+      desks_[i].cond_barber_sleeping.broadcast();
+      desks_[i].mutex.unlock();
+   }
+}
+
+// --------------------------- int get_cust_drops() / get_steals()
+// pre: None
+// return: Customers turned away, customers called in by a barber
+//   other than the one whose queue they joined
+//
+int StealingShop::get_cust_drops() const
+{
+   return drops_.load();
+}
+
+int StealingShop::get_steals() const
+{
+   return steals_.load();
+}
+
+// --------------------------- void get_wait_histogram(uint64_t*)
+// Sums every desk's histogram, one desk at a time
+//
+// pre: None
+// param: counts  Receives kWaitBuckets counts; bucket b holds waits
+//   below 2^b ns (bucket 0: no wait)
+//
+void StealingShop::get_wait_histogram(uint64_t* counts) const
+{
+   for (int b = 0; b < kWaitBuckets; b++) {
+      counts[b] = 0;
+   }
+   for (int i = 0; i < num_barbers_; i++) {
+      desks_[i].mutex.lock();
+      for (int b = 0; b < kWaitBuckets; b++) {
+         counts[b] += desks_[i].wait_hist[b];
+      }
+      desks_[i].mutex.unlock();
+   }
+}
+
+// --------------------------- int claimSleeper()
+// Clears the lowest sleeping bit; the customer that clears it owns the
+//   wakeup, so two customers never wake the same barber
+//
+// pre: None
+// return: A sleeping barber whose bit this call cleared, -1 if none
+//
+int StealingShop::claimSleeper()
+{
+   for (int w = 0; w < sleeper_words_; w++) {
+      uint64_t bits = sleepers_[w].load();
+      while (bits != 0) {
+         uint64_t bit = bits & (~bits + 1);
+         if (sleepers_[w].fetch_and(~bit) & bit) {
+            sleeping_--;
+            return w * 64 + __builtin_ctzll(bit);
+         }
+         bits = sleepers_[w].load();                           // Lost it to another customer
+      }
+   }
+   return -1;
+}
+
+// --------------------------- int shorterQueue(int)
+// Power of two choices: nearly as even as the shortest queue, without
+//   reading every queue
+//
+// pre: None
+// param: custID  Seeds the calling thread's random numbers on first use
+// return: The barber with the shorter queue of two picked at random
+//
+int StealingShop::shorterQueue(int custID) const
+{
+   static thread_local uint32_t seed = 0;
+   if (seed == 0) {
+      seed = (uint32_t)custID * 2654435761u | 1;
+   }
+   seed ^= seed << 13;                                         // xorshift32
+   seed ^= seed >> 17;
+   seed ^= seed << 5;
+   int first = (int)(seed % (uint32_t)num_barbers_);
+   int second = (int)((seed >> 16) % (uint32_t)num_barbers_);
+   return (desks_[second].queued.load(memory_order_relaxed) < desks_[first].queued.load(memory_order_relaxed))
+      ? second : first;
+}
+
+// --------------------------- void wake(int)
+// pre: barbID was returned by claimSleeper()
+// post: The barber is woken
+//
+void StealingShop::wake(int barbID)
+{
+   Desk& desk = desks_[barbID];
+   desk.mutex.lock();
+   desk.woken = true;
+   desk.cond_barber_sleeping.signal();
+   desk.mutex.unlock();
+}
+
+// --------------------------- bool anyQueued()
+// pre: None
+// return: true if some barber's queue is not empty
+//
+bool StealingShop::anyQueued() const
+{
+   for (int i = 0; i < num_barbers_; i++) {
+      if (desks_[i].queued.load() > 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// --------------------------- Ticket* steal(int)
+// Visits the other desks starting after barbID, so thieves spread out,
+//   and locks only the ones whose queue looks non-empty
+//
+// pre: barbID's desk mutex is not held
+// param: barbID  Barber looking for work
+// return: The oldest ticket of another barber's queue, NULL if all are empty
+//
+StealingShop::Ticket* StealingShop::steal(int barbID)
+{
+   for (int i = 1; i < num_barbers_; i++) {
+      Desk& victim = desks_[(barbID + i) % num_barbers_];
+      if (victim.queued.load(memory_order_relaxed) == 0) {
+         continue;
+      }
+      Ticket* ticket = NULL;
+      victim.mutex.lock();
+      if (!victim.queue.empty()) {
+         ticket = victim.queue.front();
+         victim.queue.pop_front();
+         victim.queued.fetch_sub(1);
+      }
+      victim.mutex.unlock();
+      if (ticket != NULL) {
+         steals_++;
+         return ticket;
+      }
+   }
+   return NULL;
+}
+
+// --------------------------- void callIn(int, Ticket*, bool)
+// The chair is set up before the customer learns his barber, so his
+//   leaveShop() always finds the haircut in progress
+// Only one desk mutex is held at a time: a stolen ticket's desk is
+//   locked again, after the barber's own, to wake the customer
+//
+// pre: ticket was removed from its queue; barbID's desk mutex is held
+//   if and only if locked
+// param: barbID  Barber calling the customer in
+// param: ticket  Customer to seat
+// param: locked  Whether the caller holds the barber's desk, which is
+//   then also the ticket's desk
+// post: The customer is in barbID's chair and woken
+//
+void StealingShop::callIn(int barbID, Ticket* ticket, bool locked)
+{
+   Desk& desk = desks_[barbID];
+   Desk& home = desks_[ticket->desk];
+   uint64_t wait_ns = nowNanos() - ticket->wait_start_ns;
+   int bucket = (wait_ns == 0) ? 0 : 64 - __builtin_clzll(wait_ns);
+   queued_--;
+
+   if (!locked) {
+      desk.mutex.lock();
+   }
+   desk.customer_in_chair = ticket->custID;
+   desk.in_service = true;
+   desk.money_paid = false;
+   desk.wait_hist[(bucket < kWaitBuckets) ? bucket : kWaitBuckets - 1]++;
+   if (!locked) {
+      desk.mutex.unlock();
+      home.mutex.lock();
+   }
+   ticket->barbID = barbID;                                    // The ticket may be gone after this
+   ticket->cond.signal();
+   if (!locked) {
+      home.mutex.unlock();
+   }
+}
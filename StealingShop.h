@@ -0,0 +1,204 @@
+/** @file StealingShop.h
+ *
+ * StealingShop.h file:
+ * A barbershop monitor without a shop-wide mutex, for many barbers
+ * Every barber has a desk: his own mutex, a queue of customers waiting
+ *   for him and the chair handshake of Shop (service, then payment). An
+ *   arriving customer joins the queue of a sleeping barber if there is
+ *   one, else the shorter of two randomly chosen queues, and waits on
+ *   that desk. A barber calls in the oldest customer of his own queue;
+ *   if it is empty he steals the oldest customer of another barber's
+ *   queue, and only if every queue is empty does he go to sleep. So
+ *   customers and barbers only meet on one barber's mutex at a time and
+ *   nothing is shared by every thread but a few atomic counters.
+ * The queues are not Chase-Lev deques: those have one owner that pushes,
+ *   while here any customer pushes. They are short mutex-guarded deques;
+ *   the per-queue lengths are atomic so stealing barbers skip empty
+ *   queues without locking them.
+ * A barber announces that he sleeps in an atomic bitmap and then checks
+ *   every queue once more; a customer pushes and then checks the bitmap.
+ *   Both are sequentially consistent, so either the barber sees the
+ *   customer or the customer sees (and wakes) the barber.
+ * Admission: a customer is turned away when the queued customers would
+ *   outnumber the waiting chairs plus the sleeping barbers. Unlike Shop
+ *   there are no customer classes, service types, appointments, patience
+ *   or event log; this is the plain walk-in shop, for comparing the
+ *   single waiting room with per-barber queues (see shopbench).
+ *
+ * Assumptions:
+ * Barber IDs are 0 .. num_barbers - 1 and each runs on one thread
+ * Every customer thread has left before closeShop()
+ */
+
+#ifndef StealingShop_H_
+#define StealingShop_H_
+#include <atomic>
+#include <deque>
+#include <stdint.h>
+#include "Shop.h"
+
+using namespace std;
+
+class StealingShop
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: None
+   // param: num_barbers  Barbers (kDefaultBarbers if not positive)
+   // param: num_chairs   Waiting chairs (kDefaultNumChairs if negative)
+   // post: Every barber's queue is empty
+   //
+   StealingShop(int num_barbers, int num_chairs);
+
+   // --------------------------- Destructor
+   // pre: No thread uses the shop
+   //
+   ~StealingShop();
+
+   // --------------------------- int visitShop(int)
+   // Queues the customer at one barber's desk and waits to be called in
+   //
+   // pre: custID > 0
+   // param: custID  ID of the customer
+   // return: Barber who called the customer in, -1 if turned away
+   //
+   int visitShop(int custID);
+
+   // --------------------------- void leaveShop(int, int)
+   // Waits for the haircut to finish and pays
+   //
+   // pre: barbID was returned by visitShop(custID)
+   // param: custID  ID of the customer
+   // param: barbID  Barber serving the customer
+   //
+   void leaveShop(int custID, int barbID);
+
+   // --------------------------- int helloCustomer(int)
+   // Calls in the next customer from his own queue or another barber's,
+   //   sleeping while every queue is empty
+   //
+   // pre: 0 <= barbID < number of barbers
+   // param: barbID  ID of the barber
+   // return: ID of the customer in his chair, 0 once the shop is closed
+   //
+   int helloCustomer(int barbID);
+
+   // --------------------------- void byeCustomer(int)
+   // Finishes the haircut and waits to be paid
+   //
+   // pre: helloCustomer(barbID) returned a customer
+   // param: barbID  ID of the barber
+   //
+   void byeCustomer(int barbID);
+
+   // --------------------------- void closeShop()
+   // pre: Every customer thread has left the shop
+   // post: helloCustomer() returns 0 instead of sleeping
+   //
+   void closeShop();
+
+   // --------------------------- int get_cust_drops() / get_steals()
+   // pre: None
+   // return: Customers turned away, customers called in by a barber
+   //   other than the one whose queue they joined
+   //
+   int get_cust_drops() const;
+   int get_steals() const;
+
+   // --------------------------- void get_wait_histogram(uint64_t*)
+   // Waits from joining a queue to being called in, as in Shop
+   //
+   // pre: None
+   // param: counts  Receives kWaitBuckets counts; bucket b holds waits
+   //   below 2^b ns (bucket 0: no wait)
+   //
+   void get_wait_histogram(uint64_t* counts) const;
+
+private:
+   // Ticket struct
+   // A queued customer; lives on the customer's stack in visitShop()
+   struct Ticket
+   {
+      int custID;
+      int desk;                              // Barber whose queue the customer joined
+      int barbID;                            // Set when a barber calls the customer in, -1 before
+      uint64_t wait_start_ns;
+      PthreadCond cond;                      // Signaled under desk's mutex when barbID is set
+   };
+
+   // Desk struct
+   // Everything of one barber; all but queued is guarded by mutex
+   struct Desk
+   {
+      PthreadMutex mutex;
+      deque<Ticket*> queue;                  // Customers waiting for this barber, oldest first
+      atomic<int> queued;                    // queue.size(), read without the mutex
+      bool woken;                            // Set by the customer who woke him
+      int customer_in_chair;
+      bool in_service;
+      bool money_paid;
+      PthreadCond cond_barber_sleeping;
+      PthreadCond cond_customer_served;
+      PthreadCond cond_barber_paid;
+      uint64_t wait_hist[kWaitBuckets];      // Waits of the customers he called in
+   };
+
+   int num_barbers_;
+   int num_chairs_;
+   Desk* desks_;
+   atomic<uint64_t>* sleepers_;              // Bit b set while barber b sleeps
+   int sleeper_words_;
+   atomic<int> queued_;                      // Customers admitted and not yet called in
+   atomic<int> sleeping_;                    // Bits set in sleepers_
+   atomic<int> drops_;
+   atomic<int> steals_;
+   atomic<bool> closed_;
+
+   // --------------------------- int claimSleeper()
+   // pre: None
+   // return: A sleeping barber whose bit this call cleared, -1 if none
+   //
+   int claimSleeper();
+
+   // --------------------------- int shorterQueue(int)
+   // pre: None
+   // param: custID  Seeds the random choice
+   // return: The barber with the shorter queue of two picked at random
+   //
+   int shorterQueue(int custID) const;
+
+   // --------------------------- void wake(int)
+   // pre: barbID was returned by claimSleeper()
+   // post: The barber is woken
+   //
+   void wake(int barbID);
+
+   // --------------------------- bool anyQueued()
+   // pre: None
+   // return: true if some barber's queue is not empty
+   //
+   bool anyQueued() const;
+
+   // --------------------------- Ticket* steal(int)
+   // pre: None
+   // param: barbID  Barber looking for work
+   // return: The oldest ticket of another barber's queue, NULL if all are empty
+   //
+   Ticket* steal(int barbID);
+
+   // --------------------------- void callIn(int, Ticket*, bool)
+   // Seats the ticket's customer in barbID's chair and wakes them
+   //
+   // pre: ticket was removed from its queue; barbID's desk mutex is held
+   //   if and only if locked
+   // param: barbID  Barber calling the customer in
+   // param: ticket  Customer to seat
+   // param: locked  Whether the caller holds the barber's desk, which is
+   //   then also the ticket's desk
+   //
+   void callIn(int barbID, Ticket* ticket, bool locked);
+
+   StealingShop(const StealingShop&);
+   StealingShop& operator=(const StealingShop&);
+};
+#endif
@@ -0,0 +1,345 @@
+/** @file Sync.h
+ *
+ * Sync.h file:
+ * Synchronization policies for the Shop monitor
+ * A policy is a struct naming a mutex type and a condition variable type:
+ *   mutex_type  lock(), unlock()
+ *   cond_type   wait(mutex_type&), wait_until(mutex_type&, deadline_ns),
+ *               signal(), broadcast()
+ *   name()      short name used in benchmark output
+ * Both types are default constructible and clean up after themselves,
+ *   so the monitor can keep them in plain arrays
+ *
+ * Policies:
+ *   PthreadSync  pthread_mutex_t / pthread_cond_t (the original Shop)
+ *   StdSync      std::mutex / std::condition_variable
+ *   SpinSync     test-and-test-and-set spinlock / FutexCond
+ *   TicketSync   FIFO ticket lock / FutexCond
+ *   FutexSync    three-state futex mutex / FutexCond
+ * Spinning locks fall back to sched_yield() after a short spin, so they
+ *   stay usable when threads outnumber cores
+ *
+ * Assumptions:
+ * Linux (futex system call)
+ * Like the monitor itself, signal() and broadcast() are called with the
+ *   associated mutex held
+ * Condition variables may wake up spuriously, so callers wait in a loop
+ * wait_until() deadlines are nanoseconds on the monotonic clock (see Clock.h)
+ */
+
+#ifndef Sync_H_
+#define Sync_H_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits.h>
+#include <linux/futex.h>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define kSpinsBeforeYield 64  // busy-wait iterations before a spinning lock yields the CPU
+
+// --------------------------- void cpuRelax()
+// Tells the CPU we are in a spin-wait loop
+//
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#elif defined(__aarch64__)
+   __asm__ __volatile__("yield");
+#endif
+}
+
+// --------------------------- void futexWait(atomic<uint32_t>*, uint32_t)
+// Sleeps while *word == expected (returns at once if it already differs)
+//
+inline void futexWait(atomic<uint32_t>* word, uint32_t expected)
+{
+   syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+// --------------------------- void futexWaitUntil(atomic<uint32_t>*, uint32_t, uint64_t)
+// Like futexWait(), but gives up at the monotonic time deadline_ns
+//
+inline void futexWaitUntil(atomic<uint32_t>* word, uint32_t expected, uint64_t deadline_ns)
+{
+   struct timespec deadline;
+   deadline.tv_sec = deadline_ns / 1000000000;
+   deadline.tv_nsec = deadline_ns % 1000000000;
+   syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT_BITSET_PRIVATE, expected, &deadline, NULL,
+           FUTEX_BITSET_MATCH_ANY);
+}
+
+// --------------------------- void futexWake(atomic<uint32_t>*, int)
+// Wakes up to count threads sleeping on word
+//
+inline void futexWake(atomic<uint32_t>* word, int count)
+{
+   syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// PthreadMutex class
+// pthread_mutex_t with a constructor and destructor
+class PthreadMutex
+{
+public:
+   PthreadMutex() { pthread_mutex_init(&mutex_, NULL); };
+   ~PthreadMutex() { pthread_mutex_destroy(&mutex_); };
+   void lock() { pthread_mutex_lock(&mutex_); };
+   void unlock() { pthread_mutex_unlock(&mutex_); };
+   pthread_mutex_t* native() { return &mutex_; };
+private:
+   pthread_mutex_t mutex_;
+   PthreadMutex(const PthreadMutex&);
+   PthreadMutex& operator=(const PthreadMutex&);
+};
+
+// PthreadCond class
+// pthread_cond_t on the monotonic clock with a constructor and destructor
+class PthreadCond
+{
+public:
+   PthreadCond()
+   {
+      pthread_condattr_t attr;
+      pthread_condattr_init(&attr);
+      pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+      pthread_cond_init(&cond_, &attr);
+      pthread_condattr_destroy(&attr);
+   };
+   ~PthreadCond() { pthread_cond_destroy(&cond_); };
+   void wait(PthreadMutex& mutex) { pthread_cond_wait(&cond_, mutex.native()); };
+   void wait_until(PthreadMutex& mutex, uint64_t deadline_ns)
+   {
+      struct timespec deadline;
+      deadline.tv_sec = deadline_ns / 1000000000;
+      deadline.tv_nsec = deadline_ns % 1000000000;
+      pthread_cond_timedwait(&cond_, mutex.native(), &deadline);
+   };
+   void signal() { pthread_cond_signal(&cond_); };
+   void broadcast() { pthread_cond_broadcast(&cond_); };
+private:
+   pthread_cond_t cond_;
+   PthreadCond(const PthreadCond&);
+   PthreadCond& operator=(const PthreadCond&);
+};
+
+// StdCond class
+// std::condition_variable waiting directly on a locked std::mutex
+class StdCond
+{
+public:
+   void wait(std::mutex& mutex)
+   {
+      unique_lock<std::mutex> lock(mutex, adopt_lock);         // Already locked by the caller
+      cond_.wait(lock);
+      lock.release();                                          // Caller still owns the lock
+   };
+   void wait_until(std::mutex& mutex, uint64_t deadline_ns)
+   {
+      unique_lock<std::mutex> lock(mutex, adopt_lock);         // steady_clock is CLOCK_MONOTONIC
+      cond_.wait_until(lock, chrono::steady_clock::time_point(chrono::nanoseconds(deadline_ns)));
+      lock.release();
+   };
+   void signal() { cond_.notify_one(); };
+   void broadcast() { cond_.notify_all(); };
+private:
+   condition_variable cond_;
+};
+
+// SpinLock class
+// Test-and-test-and-set lock; waiters spin on a plain load so the cache
+// line is only written when the lock looks free
+class SpinLock
+{
+public:
+   SpinLock() : locked_(false) {};
+   void lock()
+   {
+      int spins = 0;
+      while (locked_.exchange(true, memory_order_acquire)) {
+         while (locked_.load(memory_order_relaxed)) {
+            if (++spins < kSpinsBeforeYield) {
+               cpuRelax();
+            }
+            else {
+               sched_yield();
+            }
+         }
+      }
+   };
+   void unlock() { locked_.store(false, memory_order_release); };
+private:
+   atomic<bool> locked_;
+};
+
+// TicketLock class
+// FIFO spinlock: threads take a ticket and enter in ticket order
+class TicketLock
+{
+public:
+   TicketLock() : next_ticket_(0), now_serving_(0) {};
+   void lock()
+   {
+      uint32_t ticket = next_ticket_.fetch_add(1, memory_order_relaxed);
+      int spins = 0;
+      while (now_serving_.load(memory_order_acquire) != ticket) {
+         if (++spins < kSpinsBeforeYield) {
+            cpuRelax();
+         }
+         else {
+            sched_yield();
+         }
+      }
+   };
+   void unlock()
+   {
+      now_serving_.store(now_serving_.load(memory_order_relaxed) + 1, memory_order_release);
+   };
+private:
+   atomic<uint32_t> next_ticket_;
+   atomic<uint32_t> now_serving_;
+};
+
+// FutexLock class
+// Three-state futex mutex (0 unlocked, 1 locked, 2 locked with waiters) from
+// Drepper's "Futexes Are Tricky"; unlock only enters the kernel if someone
+// may be sleeping
+class FutexLock
+{
+public:
+   FutexLock() : state_(0) {};
+   void lock()
+   {
+      uint32_t c = 0;
+      if (state_.compare_exchange_strong(c, 1, memory_order_acquire)) {
+         return;                                               // Uncontended
+      }
+      if (c != 2) {
+         c = state_.exchange(2, memory_order_acquire);
+      }
+      while (c != 0) {
+         futexWait(&state_, 2);
+         c = state_.exchange(2, memory_order_acquire);
+      }
+   };
+   void unlock()
+   {
+      if (state_.fetch_sub(1, memory_order_release) != 1) {    // There may be sleepers
+         state_.store(0, memory_order_release);
+         futexWake(&state_, 1);
+      }
+   };
+private:
+   atomic<uint32_t> state_;
+};
+
+// FutexCond class
+// Condition variable usable with any lock: waiters sleep on a sequence
+// number that signal() and broadcast() bump. Waiters are counted under the
+// lock so signalling an empty condition stays in user space.
+template <typename Lock>
+class FutexCond
+{
+public:
+   FutexCond() : seq_(0), waiters_(0) {};
+   void wait(Lock& lock)
+   {
+      uint32_t seq = seq_.load(memory_order_relaxed);
+      waiters_++;
+      lock.unlock();
+      futexWait(&seq_, seq);
+      lock.lock();
+      waiters_--;
+   };
+   void wait_until(Lock& lock, uint64_t deadline_ns)
+   {
+      uint32_t seq = seq_.load(memory_order_relaxed);
+      waiters_++;
+      lock.unlock();
+      futexWaitUntil(&seq_, seq, deadline_ns);
+      lock.lock();
+      waiters_--;
+   };
+   void signal()
+   {
+      if (waiters_ > 0) {
+         seq_.fetch_add(1, memory_order_relaxed);
+         futexWake(&seq_, 1);
+      }
+   };
+   void broadcast()
+   {
+      if (waiters_ > 0) {
+         seq_.fetch_add(1, memory_order_relaxed);
+         futexWake(&seq_, INT_MAX);
+      }
+   };
+private:
+   atomic<uint32_t> seq_;
+   int waiters_;                                               // Protected by the lock
+};
+
+// Policies by name, for command line options
+enum SyncKind { kSyncPthread, kSyncStd, kSyncSpin, kSyncTicket, kSyncFutex, kSyncKinds };
+static const char* const kSyncNames[kSyncKinds] = { "pthread", "std", "spin", "ticket", "futex" };
+
+// --------------------------- int syncKind(const char*)
+// pre: None
+// param: name  Policy name as printed by name()
+// return: The matching SyncKind, or -1 if there is none
+//
+inline int syncKind(const char* name)
+{
+   for (int i = 0; i < kSyncKinds; i++) {
+      if (strcmp(name, kSyncNames[i]) == 0) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+struct PthreadSync
+{
+   typedef PthreadMutex mutex_type;
+   typedef PthreadCond cond_type;
+   static const char* name() { return "pthread"; }
+};
+
+struct StdSync
+{
+   typedef std::mutex mutex_type;
+   typedef StdCond cond_type;
+   static const char* name() { return "std"; }
+};
+
+struct SpinSync
+{
+   typedef SpinLock mutex_type;
+   typedef FutexCond<SpinLock> cond_type;
+   static const char* name() { return "spin"; }
+};
+
+struct TicketSync
+{
+   typedef TicketLock mutex_type;
+   typedef FutexCond<TicketLock> cond_type;
+   static const char* name() { return "ticket"; }
+};
+
+struct FutexSync
+{
+   typedef FutexLock mutex_type;
+   typedef FutexCond<FutexLock> cond_type;
+   static const char* name() { return "futex"; }
+};
+#endif
@@ -0,0 +1,93 @@
+/** @file ThreadUtil.cpp
+ *
+ * ThreadUtil.cpp file:
+ * Helpers shared by the programs that spawn barber and customer threads
+ *
+ * Assumptions:
+ * Linux: resident set size is read from /proc/self/statm
+ */
+
+#include "ThreadUtil.h"
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// --------------------------- int initThreadAttr(pthread_attr_t*, size_t, size_t)
+// Initializes attr for a joinable thread with a small fixed-size stack
+// The stack size is rounded up to a whole number of pages and raised to
+//   PTHREAD_STACK_MIN if it is below it
+//
+// pre: attr is not initialized
+// param: attr      Attribute object to initialize
+// param: stack_kb  Requested stack size in KB (0 keeps the system default)
+// param: guard_kb  Requested guard region in KB (0 disables the guard page)
+// post: attr is initialized and must be released with pthread_attr_destroy
+// return: 0 on success or the error number from the failing pthread call
+//
+int initThreadAttr(pthread_attr_t* attr, size_t stack_kb, size_t guard_kb)
+{
+   int err = pthread_attr_init(attr);
+   if (err != 0) {
+      return err;
+   }
+
+   size_t page = (size_t)sysconf(_SC_PAGESIZE);
+   if (stack_kb > 0) {
+      size_t bytes = stack_kb * 1024;
+      if (bytes < (size_t)PTHREAD_STACK_MIN) {                 // Smaller stacks are rejected by glibc
+         bytes = PTHREAD_STACK_MIN;
+      }
+      bytes = (bytes + page - 1) / page * page;                // Round up to whole pages
+
+      err = pthread_attr_setstacksize(attr, bytes);
+      if (err != 0) {
+         pthread_attr_destroy(attr);
+         return err;
+      }
+   }
+
+   err = pthread_attr_setguardsize(attr, (guard_kb * 1024 + page - 1) / page * page);
+   if (err != 0) {
+      pthread_attr_destroy(attr);
+   }
+   return err;
+}
+
+// --------------------------- int pinThread(pthread_t, int)
+// Restricts thread to one CPU, e.g. to run one event loop per core
+//
+// pre: None
+// param: thread  Thread to pin
+// param: cpu     CPU index, taken modulo the CPUs online
+// return: 0 on success or the error number from pthread_setaffinity_np
+//
+int pinThread(pthread_t thread, int cpu)
+{
+   long online = sysconf(_SC_NPROCESSORS_ONLN);
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(cpu % ((online > 0) ? online : 1), &set);
+   return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// --------------------------- long currentRssKB()
+// pre: None
+// return: Resident set size of this process in KB, or -1 if unavailable
+//
+long currentRssKB()
+{
+   FILE* statm = fopen("/proc/self/statm", "r");
+   if (statm == NULL) {
+      return -1;
+   }
+
+   long size_pages = 0;
+   long rss_pages = -1;
+   if (fscanf(statm, "%ld %ld", &size_pages, &rss_pages) != 2) {
+      rss_pages = -1;
+   }
+   fclose(statm);
+
+   return (rss_pages < 0) ? -1 : rss_pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
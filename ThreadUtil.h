@@ -0,0 +1,50 @@
+/** @file ThreadUtil.h
+ *
+ * ThreadUtil.h file:
+ * Helpers shared by the programs that spawn barber and customer threads
+ * Customer threads only need a few hundred bytes of stack, so the default
+ *   8 MB reservation limits how many of them fit in the address space
+ *   and makes thread creation slower than it needs to be
+ *
+ * Assumptions:
+ * Linux: resident set size is read from /proc/self/statm
+ */
+
+#ifndef ThreadUtil_H_
+#define ThreadUtil_H_
+#include <pthread.h>
+#include <stddef.h>
+
+#define kDefaultStackKB 64    // the default stack size for shop threads = 64 KB
+#define kDefaultGuardKB 4     // the default guard region below each stack = 4 KB
+
+// --------------------------- int initThreadAttr(pthread_attr_t*, size_t, size_t)
+// Initializes attr for a joinable thread with a small fixed-size stack
+// The stack size is rounded up to a whole number of pages and raised to
+//   PTHREAD_STACK_MIN if it is below it
+//
+// pre: attr is not initialized
+// param: attr      Attribute object to initialize
+// param: stack_kb  Requested stack size in KB (0 keeps the system default)
+// param: guard_kb  Requested guard region in KB (0 disables the guard page)
+// post: attr is initialized and must be released with pthread_attr_destroy
+// return: 0 on success or the error number from the failing pthread call
+//
+int initThreadAttr(pthread_attr_t* attr, size_t stack_kb, size_t guard_kb);
+
+// --------------------------- int pinThread(pthread_t, int)
+// Restricts thread to one CPU, e.g. to run one event loop per core
+//
+// pre: None
+// param: thread  Thread to pin
+// param: cpu     CPU index, taken modulo the CPUs online
+// return: 0 on success or the error number from pthread_setaffinity_np
+//
+int pinThread(pthread_t thread, int cpu);
+
+// --------------------------- long currentRssKB()
+// pre: None
+// return: Resident set size of this process in KB, or -1 if unavailable
+//
+long currentRssKB();
+#endif
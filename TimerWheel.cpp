@@ -0,0 +1,147 @@
+/** @file TimerWheel.cpp
+ *
+ * TimerWheel.cpp file:
+ * Hashed timing wheel for many coarse timeouts
+ *
+ * Assumptions:
+ * Not thread safe; the owner serializes every call (Shop holds its mutex)
+ */
+
+#include "TimerWheel.h"
+#include "Clock.h"
+
+// --------------------------- Parameter constructor
+// pre: tick_ns > 0
+// param: tick_ns  Resolution of the wheel
+// post: The wheel is empty and its current tick is now
+//
+TimerWheel::TimerWheel(uint64_t tick_ns) :
+   tick_ns_(tick_ns),
+   current_tick_(nowNanos() / tick_ns),
+   count_(0)
+{
+   for (int i = 0; i < kTimerWheelSlots; i++) {
+      slots_[i] = NULL;
+   }
+}
+
+// --------------------------- void schedule(TimerNode*, uint64_t)
+// pre: node is not scheduled; node->owner is set
+// param: node         Timer to add
+// param: deadline_ns  Monotonic time the timer should fire at
+// post: node is in the wheel
+//
+void TimerWheel::schedule(TimerNode* node, uint64_t deadline_ns)
+{
+   uint64_t tick = (deadline_ns + tick_ns_ - 1) / tick_ns_;    // Round up: never fire early
+   if (tick <= current_tick_) {
+      tick = current_tick_ + 1;                                // Already due: fire on the next tick
+   }
+   node->deadline_tick = tick;
+
+   TimerNode** slot = &slots_[tick & (kTimerWheelSlots - 1)];
+   node->prev = NULL;
+   node->next = *slot;
+   if (*slot != NULL) {
+      (*slot)->prev = node;
+   }
+   *slot = node;
+   node->scheduled = true;
+   count_++;
+}
+
+// --------------------------- void cancel(TimerNode*)
+// Removes a timer; does nothing if it is not scheduled
+//
+// pre: None
+// param: node  Timer to remove
+// post: node is not scheduled
+//
+void TimerWheel::cancel(TimerNode* node)
+{
+   if (!node->scheduled) {
+      return;
+   }
+   if (node->prev != NULL) {
+      node->prev->next = node->next;
+   }
+   else {
+      slots_[node->deadline_tick & (kTimerWheelSlots - 1)] = node->next;
+   }
+   if (node->next != NULL) {
+      node->next->prev = node->prev;
+   }
+   node->scheduled = false;
+   count_--;
+}
+
+// --------------------------- TimerNode* expire(uint64_t)
+// Advances the wheel to now_ns and removes every timer that is due
+// Each elapsed tick visits one slot; after a full revolution every slot
+//   has been visited, so longer gaps cost no more than that
+//
+// pre: None
+// param: now_ns  Current monotonic time
+// return: The expired timers linked through next, or NULL
+//
+TimerNode* TimerWheel::expire(uint64_t now_ns)
+{
+   uint64_t now_tick = now_ns / tick_ns_;
+   if (now_tick <= current_tick_) {
+      return NULL;
+   }
+   uint64_t steps = now_tick - current_tick_;
+   if (steps > kTimerWheelSlots) {
+      steps = kTimerWheelSlots;
+   }
+
+   TimerNode* expired = NULL;
+   for (uint64_t i = 1; i <= steps && count_ > 0; i++) {
+      TimerNode* node = slots_[(current_tick_ + i) & (kTimerWheelSlots - 1)];
+      while (node != NULL) {
+         TimerNode* next = node->next;
+         if (node->deadline_tick <= now_tick) {                // Later revolutions stay put
+            cancel(node);
+            node->next = expired;
+            expired = node;
+         }
+         node = next;
+      }
+   }
+   current_tick_ = now_tick;
+   return expired;
+}
+
+// --------------------------- TimerNode* any()
+// pre: None
+// return: A scheduled timer, preferring the nearest slots, or NULL if
+//   the wheel is empty
+//
+TimerNode* TimerWheel::any() const
+{
+   for (int i = 1; i <= kTimerWheelSlots && count_ > 0; i++) {
+      TimerNode* node = slots_[(current_tick_ + i) & (kTimerWheelSlots - 1)];
+      if (node != NULL) {
+         return node;
+      }
+   }
+   return NULL;
+}
+
+// --------------------------- uint64_t next_tick_ns()
+// pre: None
+// return: Monotonic time of the wheel's next tick
+//
+uint64_t TimerWheel::next_tick_ns() const
+{
+   return (current_tick_ + 1) * tick_ns_;
+}
+
+// --------------------------- int get_count()
+// pre: None
+// return: Number of scheduled timers
+//
+int TimerWheel::get_count() const
+{
+   return count_;
+}
@@ -0,0 +1,100 @@
+/** @file TimerWheel.h
+ *
+ * TimerWheel.h file:
+ * Hashed timing wheel for many coarse timeouts
+ * Timers are intrusive TimerNodes hashed into kTimerWheelSlots slots by
+ *   their deadline tick, so scheduling and cancelling are O(1) and
+ *   expiring costs one slot per elapsed tick plus the timers that fire.
+ *   Timers more than one revolution away stay in their slot until the
+ *   wheel comes around to their tick.
+ * Deadlines are rounded up to whole ticks, so a timer never fires early
+ *   and fires at most one tick late (after expire() is called).
+ *
+ * Assumptions:
+ * Not thread safe; the owner serializes every call (Shop holds its mutex)
+ * Times are nanoseconds on the monotonic clock (see Clock.h)
+ */
+
+#ifndef TimerWheel_H_
+#define TimerWheel_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define kTimerWheelSlots 256    // slots per revolution (power of 2)
+
+// TimerNode struct
+// Embedded in whatever carries the timeout; owner points back to it
+struct TimerNode
+{
+   void* owner;                // Object this timer belongs to
+   uint64_t deadline_tick;     // Tick the timer fires at
+   TimerNode* prev;            // Neighbors in the slot list
+   TimerNode* next;            //   (next also links expired timers)
+   bool scheduled;             // Whether the node is in the wheel
+};
+
+class TimerWheel
+{
+public:
+   // --------------------------- Parameter constructor
+   // pre: tick_ns > 0
+   // param: tick_ns  Resolution of the wheel
+   // post: The wheel is empty and its current tick is now
+   //
+   TimerWheel(uint64_t tick_ns);
+
+   // --------------------------- void schedule(TimerNode*, uint64_t)
+   // pre: node is not scheduled; node->owner is set
+   // param: node         Timer to add
+   // param: deadline_ns  Monotonic time the timer should fire at
+   // post: node is in the wheel
+   //
+   void schedule(TimerNode* node, uint64_t deadline_ns);
+
+   // --------------------------- void cancel(TimerNode*)
+   // Removes a timer; does nothing if it is not scheduled
+   //
+   // pre: None
+   // param: node  Timer to remove
+   // post: node is not scheduled
+   //
+   void cancel(TimerNode* node);
+
+   // --------------------------- TimerNode* expire(uint64_t)
+   // Advances the wheel to now_ns and removes every timer that is due
+   //
+   // pre: None
+   // param: now_ns  Current monotonic time
+   // return: The expired timers linked through next, or NULL
+   //
+   TimerNode* expire(uint64_t now_ns);
+
+   // --------------------------- TimerNode* any()
+   // pre: None
+   // return: A scheduled timer, preferring the nearest slots, or NULL if
+   //   the wheel is empty
+   //
+   TimerNode* any() const;
+
+   // --------------------------- uint64_t next_tick_ns()
+   // pre: None
+   // return: Monotonic time of the wheel's next tick
+   //
+   uint64_t next_tick_ns() const;
+
+   // --------------------------- int get_count()
+   // pre: None
+   // return: Number of scheduled timers
+   //
+   int get_count() const;
+
+private:
+   const uint64_t tick_ns_;                  // Length of a tick
+   uint64_t current_tick_;                   // Last tick expire() has processed
+   int count_;                               // Scheduled timers
+   TimerNode* slots_[kTimerWheelSlots];      // Timers by deadline_tick % kTimerWheelSlots
+
+   TimerWheel(const TimerWheel&);
+   TimerWheel& operator=(const TimerWheel&);
+};
+#endif
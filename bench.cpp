@@ -0,0 +1,246 @@
+/** @file bench.cpp
+ *
+ * bench.cpp file:
+ * Throughput benchmark for the Shop monitor
+ * Unlike driver, customer threads are reused: each one visits the shop
+ *   in a loop for a fixed time, and haircuts take no time, so the numbers
+ *   measure the monitor's synchronization rather than usleep()
+ * Every configuration is run once per synchronization policy (see Sync.h),
+ *   or only for the policy named on the command line. The pthread policy
+ *   is also run as the compile-time sized FixedShop at the build's
+ *   production size (sync column "fixed").
+ * Then, at high barber counts, the pthread shop's single waiting room is
+ *   compared with StealingShop's per-barber queues (sync columns "room"
+ *   and "steal").
+ * Every line of output is one configuration:
+ *   sync  barbers  chairs  customers  visits/s  served/s  drop%  p99_wait_us
+ * p99_wait_us is the 99th percentile wait of the customers served, to
+ *   the power of two bucket of the wait histogram that holds it.
+ *
+ * Assumptions:
+ * Runs on an otherwise idle machine; use a Release build for numbers
+ */
+
+#include <atomic>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+#include "Clock.h"
+#include "Shop.h"
+#include "StealingShop.h"
+
+using namespace std;
+
+// BenchParam class
+// Shared by every thread of one configuration
+template <typename ShopT>
+class BenchParam
+{
+public:
+   BenchParam(ShopT* shop) :
+      shop(shop),
+      stop(false),
+      visits(0) {};
+   ShopT* shop;
+   atomic<bool> stop;                                                      // Set when the run is over
+   atomic<long> visits;                                                    // Visits completed, served or not
+};
+
+template <typename ShopT> void* barber(void*);
+template <typename ShopT> void* customer(void*);
+
+// --------------------------- void quiet(...)
+// Turns off a shop's printing; StealingShop never prints
+//
+template <typename ShopT>
+static void quiet(ShopT& shop)
+{
+   shop.set_print(false);
+}
+
+static void quiet(StealingShop& shop)
+{
+}
+
+// --------------------------- double p99WaitUs(const uint64_t*)
+// pre: hist has kWaitBuckets counts (see Shop::get_wait_histogram())
+// return: Upper bound in us of the bucket holding the 99th percentile wait
+//
+static double p99WaitUs(const uint64_t* hist)
+{
+   uint64_t total = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      total += hist[b];
+   }
+   uint64_t seen = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      seen += hist[b];
+      if (total > 0 && seen * 100 >= total * 99) {
+         return (b == 0) ? 0 : (double)((uint64_t)1 << b) / 1000;
+      }
+   }
+   return 0;
+}
+
+// --------------------------- double runConfig<ShopT>(int, int, int, int, double*, double*)
+// Runs one configuration against a ShopT (any BasicShop, or StealingShop)
+//   and reports its throughput
+//
+// pre: num_barbers > 0, num_chairs >= 0, num_customers > 0
+// param: num_barbers    Barber threads
+// param: num_chairs     Waiting chairs
+// param: num_customers  Customer threads visiting in a loop
+// param: millis         Length of the run
+// param: drop_rate      Receives the fraction of visits that were dropped
+// param: p99_wait_us    Receives the 99th percentile wait (see p99WaitUs())
+// return: Visits per second
+//
+template <typename ShopT>
+static double runConfig(int num_barbers, int num_chairs, int num_customers, int millis,
+                        double* drop_rate, double* p99_wait_us)
+{
+   ShopT shop(num_barbers, num_chairs);
+   quiet(shop);
+   BenchParam<ShopT> param(&shop);
+
+   vector<pthread_t> barbers(num_barbers);
+   vector<pair<BenchParam<ShopT>*, int> > barber_args(num_barbers);
+   for (int i = 0; i < num_barbers; i++) {
+      barber_args[i] = make_pair(&param, i);
+      pthread_create(&barbers[i], NULL, barber<ShopT>, &barber_args[i]);
+   }
+
+   vector<pthread_t> customers(num_customers);
+   vector<pair<BenchParam<ShopT>*, int> > customer_args(num_customers);
+   uint64_t start_ns = nowNanos();
+   for (int i = 0; i < num_customers; i++) {
+      customer_args[i] = make_pair(&param, i + 1);
+      pthread_create(&customers[i], NULL, customer<ShopT>, &customer_args[i]);
+   }
+
+   sleepUntilNanos(start_ns + (uint64_t)millis * 1000000);
+   param.stop = true;
+   for (int i = 0; i < num_customers; i++) {
+      pthread_join(customers[i], NULL);
+   }
+   double seconds = (nowNanos() - start_ns) / 1e9;
+
+   shop.closeShop();
+   for (int i = 0; i < num_barbers; i++) {
+      pthread_join(barbers[i], NULL);
+   }
+
+   long visits = param.visits.load();
+   *drop_rate = (visits > 0) ? (double)shop.get_cust_drops() / visits : 0;
+   uint64_t hist[kWaitBuckets];
+   shop.get_wait_histogram(hist);
+   *p99_wait_us = p99WaitUs(hist);
+   return visits / seconds;
+}
+
+// --------------------------- void printRow(...)
+// Prints one line of results
+//
+static void printRow(const char* sync, int num_barbers, int num_chairs, int num_customers,
+                     double rate, double drop_rate, double p99_wait_us)
+{
+   cout << sync << "\t" << num_barbers << "\t" << num_chairs << "\t" << num_customers << "\t"
+        << (long)rate << "\t" << (long)(rate * (1 - drop_rate)) << "\t" 
+        << drop_rate * 100 << "\t" << p99_wait_us << endl;
+}
+
+int main(int argc, char* argv[])
+{
+   int millis = (argc > 1) ? atoi(argv[1]) : 500;
+   int only_sync = (argc > 2) ? syncKind(argv[2]) : -1;
+   if (millis < 1 || argc > 3 || (argc > 2 && only_sync < 0)) {
+      cout << "Usage: shopbench [millis_per_config [pthread|std|spin|ticket|futex]]" << endl;
+      return -1;
+   }
+
+   static const int kBarbers[] = { 1, 4, 16 };
+   static const int kCustomersPerBarber[] = { 1, 4, 16 };
+   static const int kManyBarbers[] = { 16, 64 };
+
+   cout << "sync\tbarbers\tchairs\tcustomers\tvisits/s\tserved/s\tdrop%\tp99_wait_us" << endl;
+   for (int sync = 0; sync < kSyncKinds; sync++) {
+      if (only_sync >= 0 && sync != only_sync) {
+         continue;
+      }
+      for (size_t b = 0; b < sizeof(kBarbers) / sizeof(kBarbers[0]); b++) {
+         for (size_t c = 0; c < sizeof(kCustomersPerBarber) / sizeof(kCustomersPerBarber[0]); c++) {
+            int num_barbers = kBarbers[b];
+            int num_chairs = num_barbers;
+            int num_customers = num_barbers * kCustomersPerBarber[c];
+
+            double drop_rate;
+            double p99;
+            double rate;
+            switch (sync) {
+            case kSyncStd:    rate = runConfig<BasicShop<StdSync> >(num_barbers, num_chairs, num_customers, millis, &drop_rate, &p99);     break;
+            case kSyncSpin:   rate = runConfig<BasicShop<SpinSync> >(num_barbers, num_chairs, num_customers, millis, &drop_rate, &p99);    break;
+            case kSyncTicket: rate = runConfig<BasicShop<TicketSync> >(num_barbers, num_chairs, num_customers, millis, &drop_rate, &p99);  break;
+            case kSyncFutex:  rate = runConfig<BasicShop<FutexSync> >(num_barbers, num_chairs, num_customers, millis, &drop_rate, &p99);   break;
+            default:          rate = runConfig<BasicShop<PthreadSync> >(num_barbers, num_chairs, num_customers, millis, &drop_rate, &p99); break;
+            }
+            printRow(kSyncNames[sync], num_barbers, num_chairs, num_customers, rate, drop_rate, p99);
+         }
+      }
+   }
+   if (only_sync < 0 || only_sync == kSyncPthread) {
+      for (size_t c = 0; c < sizeof(kCustomersPerBarber) / sizeof(kCustomersPerBarber[0]); c++) {
+         int num_customers = SHOP_FIXED_BARBERS * kCustomersPerBarber[c];
+         double drop_rate;
+         double p99;
+         double rate = runConfig<FixedShop<SHOP_FIXED_BARBERS, SHOP_FIXED_CHAIRS> >(
+            SHOP_FIXED_BARBERS, SHOP_FIXED_CHAIRS, num_customers, millis, &drop_rate, &p99);
+         printRow("fixed", SHOP_FIXED_BARBERS, SHOP_FIXED_CHAIRS, num_customers, rate, drop_rate, p99);
+      }
+      for (size_t b = 0; b < sizeof(kManyBarbers) / sizeof(kManyBarbers[0]); b++) {
+         for (size_t c = 0; c < sizeof(kCustomersPerBarber) / sizeof(kCustomersPerBarber[0]); c++) {
+            int num_barbers = kManyBarbers[b];
+            int num_customers = num_barbers * kCustomersPerBarber[c];
+            double drop_rate;
+            double p99;
+            double rate = runConfig<BasicShop<PthreadSync> >(num_barbers, num_barbers, num_customers, millis,
+                                                            &drop_rate, &p99);
+            printRow("room", num_barbers, num_barbers, num_customers, rate, drop_rate, p99);
+            rate = runConfig<StealingShop>(num_barbers, num_barbers, num_customers, millis, &drop_rate, &p99);
+            printRow("steal", num_barbers, num_barbers, num_customers, rate, drop_rate, p99);
+         }
+      }
+   }
+   return 0;
+}
+
+template <typename ShopT>
+void* barber(void* arg)
+{
+   pair<BenchParam<ShopT>*, int>* barber_arg = (pair<BenchParam<ShopT>*, int>*)arg;
+   ShopT& shop = *barber_arg->first->shop;
+   int barbID = barber_arg->second;
+
+   while (shop.helloCustomer(barbID) != 0) {                               // No service time
+      shop.byeCustomer(barbID);
+   }
+   return nullptr;
+}
+
+template <typename ShopT>
+void* customer(void* arg)
+{
+   pair<BenchParam<ShopT>*, int>* customer_arg = (pair<BenchParam<ShopT>*, int>*)arg;
+   BenchParam<ShopT>& param = *customer_arg->first;
+   int id = customer_arg->second;
+
+   long visits = 0;
+   while (!param.stop.load(memory_order_relaxed)) {
+      int barbID = param.shop->visitShop(id);
+      if (barbID != -1) {
+         param.shop->leaveShop(id, barbID);
+      }
+      visits++;
+   }
+   param.visits += visits;
+   return nullptr;
+}
@@ -15,10 +15,29 @@
  * Driver validates parameters before passing them into these methods
  */
 
+#include <algorithm>
+#include <errno.h>
+#include <getopt.h>
 #include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <vector>
+#include "Autoscaler.h"
+#include "Clock.h"
+#include "CustomerPool.h"
+#include "CustomerRecord.h"
+#include "EventLog.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "MetricsExporter.h"
+#include "Reactor.h"
+#include "Sampler.h"
+#include "Schedule.h"
 #include "Shop.h"
+#include "ThreadUtil.h"
 
 using namespace std;
 
@@ -27,7 +46,8 @@ void* customer(void*);
 
 // ThreadParam class
 // This class is used as a way to pass more
-// than one argument to a thread. 
+// than one argument to a barber thread.
+// Customer threads get a CustomerSlot from the CustomerPool instead.
 class ThreadParam
 {
 public:
@@ -40,24 +60,428 @@ public:
    int service_time;
 };
 
+// StartGate class
+// Holds customer threads in stress mode until all of them have been
+// created, so every customer thread is alive at the same time.
+class StartGate
+{
+public:
+   StartGate() : open_(false)
+   {
+      pthread_mutex_init(&mutex_, NULL);
+      pthread_cond_init(&cond_open_, NULL);
+   };
+   ~StartGate()
+   {
+      pthread_mutex_destroy(&mutex_);
+      pthread_cond_destroy(&cond_open_);
+   };
+   void wait()
+   {
+      pthread_mutex_lock(&mutex_);
+      while (!open_) {
+         pthread_cond_wait(&cond_open_, &mutex_);
+      }
+      pthread_mutex_unlock(&mutex_);
+   };
+   void open()
+   {
+      pthread_mutex_lock(&mutex_);
+      open_ = true;
+      pthread_cond_broadcast(&cond_open_);
+      pthread_mutex_unlock(&mutex_);
+   };
+private:
+   bool open_;
+   pthread_mutex_t mutex_;
+   pthread_cond_t cond_open_;
+};
+
+StartGate* stress_gate = NULL;                                             // Only set in stress mode
+CustomerPool* customer_pool = NULL;                                        // Recycles customer thread parameters
+CustomerRecord* customer_records = NULL;                                   // One trace record per customer ID
+uint64_t customer_patience_ns = 0;                                         // How long customers wait, 0 = forever
+
+// PeriodicReport class
+// Calls report() every interval from its own thread until stop()
+class PeriodicReport
+{
+public:
+   PeriodicReport(uint64_t interval_ns) :
+      interval_ns_(interval_ns),
+      stopping_(false) {};
+   virtual ~PeriodicReport() {};
+   bool start()
+   {
+      start_ns_ = nowNanos();
+      return pthread_create(&thread_, NULL, run, this) == 0;
+   };
+   void stop()
+   {
+      mutex_.lock();
+      stopping_ = true;
+      cond_stop_.signal();
+      mutex_.unlock();
+      pthread_join(thread_, NULL);
+   };
+protected:
+   virtual void report(uint64_t elapsed_ms) = 0;
+private:
+   static void* run(void* arg)
+   {
+      PeriodicReport* reporter = (PeriodicReport*)arg;
+      uint64_t next_ns = reporter->start_ns_ + reporter->interval_ns_;
+      reporter->mutex_.lock();
+      while (!reporter->stopping_) {
+         reporter->cond_stop_.wait_until(reporter->mutex_, next_ns);
+         if (reporter->stopping_ || nowNanos() < next_ns) {
+            continue;
+         }
+         next_ns += reporter->interval_ns_;
+         reporter->report((nowNanos() - reporter->start_ns_) / 1000000);
+      }
+      reporter->mutex_.unlock();
+      return nullptr;
+   };
+   uint64_t interval_ns_;
+   uint64_t start_ns_;
+   bool stopping_;                                                         // Guarded by mutex_
+   PthreadMutex mutex_;
+   PthreadCond cond_stop_;
+   pthread_t thread_;
+};
+
+// OccupancyReport class
+// Prints the waiting room occupancy averaged over each interval
+// (see ShopOccupancy)
+class OccupancyReport : public PeriodicReport
+{
+public:
+   OccupancyReport(Shop* shop, uint64_t interval_ns) :
+      PeriodicReport(interval_ns),
+      shop_(shop)
+   {
+      shop_->get_occupancy(&last_);
+   };
+protected:
+   void report(uint64_t elapsed_ms)
+   {
+      ShopOccupancy now;
+      shop_->get_occupancy(&now);
+      uint64_t chairs_ns = now.chairs_ns - last_.chairs_ns;
+      cout << "# occupancy at " << elapsed_ms << " ms: waiting = " << now.waiting << "/" << now.chairs
+           << ", mean = " << ((chairs_ns > 0) ? 100.0 * (now.waiting_ns - last_.waiting_ns) / chairs_ns : 0.0)
+           << "%" << endl;
+      last_ = now;
+   };
+private:
+   Shop* shop_;
+   ShopOccupancy last_;
+};
+
+// MetricsReport class
+// Prints a ShopMetrics snapshot every interval
+class MetricsReport : public PeriodicReport
+{
+public:
+   MetricsReport(const ShopMetrics* metrics, uint64_t interval_ns) :
+      PeriodicReport(interval_ns),
+      metrics_(metrics) {};
+protected:
+   void report(uint64_t elapsed_ms)
+   {
+      MetricsSnapshot snap;
+      metrics_->snapshot(&snap);
+      cout << "# metrics at " << elapsed_ms << " ms: arrivals = " << snap.arrivals
+           << ", waited = " << snap.waited << ", seated = " << snap.seated
+           << ", served = " << snap.served << ", dropped = " << snap.dropped
+           << ", reneged = " << snap.reneged << ", waiting = " << snap.waiting
+           << ", busy = " << snap.busy << ", sleeping = " << snap.sleeping << endl;
+   };
+private:
+   const ShopMetrics* metrics_;
+};
+
+// BarberCrew struct
+// Barber threads and their parameters, including barbers the autoscaler
+// hires while customers are arriving
+struct BarberCrew
+{
+   vector<ThreadParam> params;                                             // Indexed by barber ID
+   vector<pthread_t> threads;                                              // Every barber thread started
+   pthread_attr_t* attr;
+};
+
+// --------------------------- void startBarber(int, void*)
+// BarberStarter: starts the thread of barber barbID
+//
+// pre: context is the BarberCrew; only one thread starts barbers at a time
+// param: barbID   ID of the barber, below params.size()
+// param: context  BarberCrew that joins the thread later
+//
+static void startBarber(int barbID, void* context)
+{
+   BarberCrew* crew = (BarberCrew*)context;
+   pthread_t thread;
+   crew->params[barbID].id = barbID;                                       // A retired barber's thread is done with
+   if (pthread_create(&thread, crew->attr, barber, &crew->params[barbID]) == 0) { //   the slot before his ID is reused
+      crew->threads.push_back(thread);
+   }
+}
+
+// --------------------------- int admitBurst(Shop&, const vector<CustomerSlot*>&)
+// Lets a burst of arrivals into the shop with one visitShopBatch() call
+//
+// pre: The slots are filled in and have no thread yet
+// param: shop      The shop
+// param: arrivals  The burst, in order of arrival
+// post: Every slot is batched, with its result in admitted; the seat time
+//   of every customer seated right away is recorded
+// return: Customers of the burst that took a waiting chair
+//
+static int admitBurst(Shop& shop, const vector<CustomerSlot*>& arrivals)
+{
+   int n = (int)arrivals.size();
+   vector<int> ids(n);
+   vector<int> classes(n);
+   vector<uint64_t> patience(n, customer_patience_ns);
+   vector<Shop::WaitTicket*> visits(n);
+   vector<int> results(n);
+   for (int k = 0; k < n; k++) {
+      ids[k] = arrivals[k]->id;
+      classes[k] = arrivals[k]->customer_class;
+      visits[k] = &arrivals[k]->visit;
+   }
+   int waited = shop.visitShopBatch(&ids[0], n, &results[0], &visits[0], &classes[0], NULL, &patience[0]);
+   uint64_t seated_ns = nowNanos();
+   for (int k = 0; k < n; k++) {
+      arrivals[k]->batched = true;
+      arrivals[k]->admitted = results[k];
+      if (results[k] >= 0) {                                               // Seated now, not when the
+         customer_records[ids[k] - 1].seat_ns = seated_ns;                 //   thread gets to run
+      }
+   }
+   return waited;
+}
+
+// --------------------------- int drawClass(int, int)
+// pre: vip_percent + appointment_percent <= 100
+// param: vip_percent          Percent of customers who are VIPs
+// param: appointment_percent  Percent of customers with an appointment
+// return: CustomerClass of the next customer
+//
+static int drawClass(int vip_percent, int appointment_percent)
+{
+   int r = rand() % 100;
+   return (r < vip_percent) ? kClassVip
+        : (r < vip_percent + appointment_percent) ? kClassAppointment : kClassWalkIn;
+}
+
+static const struct option kLongOptions[] = {
+   { "stack-kb",        required_argument, NULL, 's' },
+   { "barber-stack-kb", required_argument, NULL, 'b' },
+   { "guard-kb",        required_argument, NULL, 'g' },
+   { "stress",          no_argument,       NULL, 'S' },
+   { "records",         required_argument, NULL, 'r' },
+   { "events",          required_argument, NULL, 'e' },
+   { "quiet",           no_argument,       NULL, 'q' },
+   { "schedule",        required_argument, NULL, 'c' },
+   { "vip",             required_argument, NULL, 'v' },
+   { "appointments",    required_argument, NULL, 'a' },
+   { "class-chairs",    required_argument, NULL, 'C' },
+   { "weights",         required_argument, NULL, 'w' },
+   { "patience-us",     required_argument, NULL, 'p' },
+   { "autoscale",       required_argument, NULL, 'A' },
+   { "burst",           required_argument, NULL, 'B' },
+   { "gap-us",          required_argument, NULL, 'G' },
+   { "reactors",        required_argument, NULL, 'E' },
+   { "resize",          required_argument, NULL, 'R' },
+   { "occupancy-ms",    required_argument, NULL, 'o' },
+   { "metrics-ms",      required_argument, NULL, 'm' },
+   { "metrics-listen",  required_argument, NULL, 'M' },
+   { "samples",         required_argument, NULL, 'x' },
+   { "sample-us",       required_argument, NULL, 'i' },
+   { NULL, 0, NULL, 0 }
+};
+
+static void usage()
+{
+   cout << "Usage: num_barbers num_chairs num_customers service_time [options]" << endl;
+   cout << "  --stack-kb N         customer thread stack size in KB (default "
+        << kDefaultStackKB << ")" << endl;
+   cout << "  --barber-stack-kb N  barber thread stack size in KB (default "
+        << kDefaultStackKB << ")" << endl;
+   cout << "  --guard-kb N         guard region below each stack in KB (default "
+        << kDefaultGuardKB << ")" << endl;
+   cout << "  --stress             create every customer up front and report RSS" << endl;
+   cout << "                       and creation time per thread" << endl;
+   cout << "  --records FILE       write a binary CustomerRecord per customer to FILE" << endl;
+   cout << "  --events FILE        write a binary ShopEvent per transition to FILE" << endl;
+   cout << "                       (render it with logview)" << endl;
+   cout << "  --quiet              do not print transitions" << endl;
+   cout << "  --schedule FILE      record arrivals and service times to FILE" << endl;
+   cout << "                       (run it again with replay)" << endl;
+   cout << "  --vip P              percent of customers who are VIPs (default 0)" << endl;
+   cout << "  --appointments P     percent of customers with an appointment (default 0)" << endl;
+   cout << "  --class-chairs V,A,W waiting chairs VIPs, appointments and walk-ins" << endl;
+   cout << "                       may hold (default every chair)" << endl;
+   cout << "  --weights V,A,W      weighted instead of strict class priority" << endl;
+   cout << "  --patience-us N      customers leave after waiting N us (default 0: never)" << endl;
+   cout << "  --autoscale MAX      hire up to MAX barbers while the waiting room is half" << endl;
+   cout << "                       full or the p99 wait is above 4 service times," << endl;
+   cout << "                       and retire them when it stays empty" << endl;
+   cout << "  --burst N            customers arrive in bursts of N at the same average rate;" << endl;
+   cout << "                       each burst is let in with one visitShopBatch() call" << endl;
+   cout << "  --gap-us N           arrivals (or bursts) are up to N us apart (default 1000)" << endl;
+   cout << "  --reactors N         play the customers on N event loop threads, one per core," << endl;
+   cout << "                       instead of a thread per customer (not with --burst)" << endl;
+   cout << "  --resize N           resize the waiting room to N chairs once half of the" << endl;
+   cout << "                       customers have arrived" << endl;
+   cout << "  --occupancy-ms N     print the waiting room occupancy every N ms" << endl;
+   cout << "  --metrics-ms N       print the shop's transition counters every N ms" << endl;
+   cout << "  --metrics-listen A   serve the metrics in Prometheus format on 127.0.0.1:PORT" << endl;
+   cout << "                       or a Unix socket path, e.g. curl http://A/metrics" << endl;
+   cout << "  --samples FILE       write the queue length, busy barbers and drop rate" << endl;
+   cout << "                       over time to FILE as CSV" << endl;
+   cout << "  --sample-us N        time between samples (default 1000)" << endl;
+}
+
+static const char* const kClassNames[kNumClasses] = { "vip", "appointment", "walk-in" };
+
+// --------------------------- bool parseClassList(const char*, int*)
+// Reads one non-negative value per CustomerClass, e.g. "2,2,4"
+//
+// pre: None
+// param: text    Comma separated values
+// param: values  Receives kNumClasses values
+// return: false if text is not a valid list
+//
+static bool parseClassList(const char* text, int* values)
+{
+   char end;
+   return sscanf(text, "%d,%d,%d%c", &values[0], &values[1], &values[2], &end) == kNumClasses
+          && values[0] >= 0 && values[1] >= 0 && values[2] >= 0;
+}
+
 int main(int argc, char* argv[])
 {
+   // Read options from command line
+   size_t customer_stack_kb = kDefaultStackKB;
+   size_t barber_stack_kb = kDefaultStackKB;
+   size_t guard_kb = kDefaultGuardKB;
+   bool stress = false;
+   string records_path;
+   string events_path;
+   bool quiet = false;
+   string schedule_path;
+   int vip_percent = 0;
+   int appointment_percent = 0;
+   int class_chairs[kNumClasses];
+   int class_weights[kNumClasses];
+   bool limit_classes = false;
+   bool weighted = false;
+   long patience_us = 0;
+   int autoscale_max = 0;
+   int burst = 0;
+   long gap_us = 1000;
+   int reactors = 0;
+   int resize_chairs = -1;
+   long occupancy_ms = 0;
+   long metrics_ms = 0;
+   string metrics_listen;
+   string samples_path;
+   long sample_us = 1000;
+
+   int opt;
+   while ((opt = getopt_long(argc, argv, "", kLongOptions, NULL)) != -1) {
+      switch (opt) {
+      case 's': customer_stack_kb = strtoul(optarg, NULL, 10); break;
+      case 'b': barber_stack_kb = strtoul(optarg, NULL, 10);   break;
+      case 'g': guard_kb = strtoul(optarg, NULL, 10);          break;
+      case 'S': stress = true;                                 break;
+      case 'r': records_path = optarg;                         break;
+      case 'e': events_path = optarg;                          break;
+      case 'q': quiet = true;                                  break;
+      case 'c': schedule_path = optarg;                        break;
+      case 'v': vip_percent = atoi(optarg);                    break;
+      case 'a': appointment_percent = atoi(optarg);            break;
+      case 'p': patience_us = atol(optarg);                    break;
+      case 'A': autoscale_max = atoi(optarg);                  break;
+      case 'B': burst = atoi(optarg);                          break;
+      case 'G': gap_us = atol(optarg);                         break;
+      case 'E': reactors = atoi(optarg);                       break;
+      case 'R': resize_chairs = atoi(optarg);
+                if (resize_chairs < 0) {
+                   usage();
+                   return -1;
+                }
+                break;
+      case 'o': occupancy_ms = atol(optarg);                   break;
+      case 'm': metrics_ms = atol(optarg);                     break;
+      case 'M': metrics_listen = optarg;                       break;
+      case 'x': samples_path = optarg;                         break;
+      case 'i': sample_us = atol(optarg);                      break;
+      case 'C': limit_classes = true;
+                if (!parseClassList(optarg, class_chairs)) {
+                   usage();
+                   return -1;
+                }
+                break;
+      case 'w': weighted = true;
+                if (!parseClassList(optarg, class_weights)) {
+                   usage();
+                   return -1;
+                }
+                break;
+      default:
+         usage();
+         return -1;
+      }
+   }
+   if (vip_percent < 0 || appointment_percent < 0 || vip_percent + appointment_percent > 100) {
+      cout << "Invalid parameter: --vip and --appointments must add up to at most 100" << endl;
+      return -1;
+   }
+   if (patience_us < 0) {
+      cout << "Invalid parameter: --patience-us must not be negative" << endl;
+      return -1;
+   }
+   customer_patience_ns = (uint64_t)patience_us * 1000;
+   if (sample_us <= 0) {
+      cout << "Invalid parameter: --sample-us must be greater than 0" << endl;
+      return -1;
+   }
+   if (autoscale_max < 0 || burst < 0 || occupancy_ms < 0 || metrics_ms < 0) {
+      cout << "Invalid parameter: --autoscale, --burst, --occupancy-ms and --metrics-ms must not be negative"
+           << endl;
+      return -1;
+   }
+   if (gap_us <= 0) {
+      cout << "Invalid parameter: --gap-us must be greater than 0" << endl;
+      return -1;
+   }
+   if (reactors < 0 || (reactors > 0 && (stress || patience_us > 0 || burst > 0))) {           // tryVisitShop() has no
+      cout << "Invalid parameter: --reactors must not be negative or combined with --stress,"  //   patience and
+           << " --patience-us or --burst" << endl;                                             //   no batch form
+      return -1;
+   }
 
    // Read arguments from command line
-   if (argc != 5) {
-      cout << "Usage: num_barbers num_chairs num_customers service_time" << endl;
+   if (argc - optind != 4) {
+      usage();
       return -1;
    }
+   char** args = argv + optind;
 
-   int num_barbers = atoi(argv[1]);
-   int num_chairs = atoi(argv[2]);
-   int num_customers = atoi(argv[3]);
-   int service_time = atoi(argv[4]);
+   int num_barbers = atoi(args[0]);
+   int num_chairs = atoi(args[1]);
+   int num_customers = atoi(args[2]);
+   int service_time = atoi(args[3]);
 
-   for (int i = 1; i < argc; i++) // Check that all values are 1 or greater (except waiting chairs which can be 0)
+   for (int i = 0; i < 4; i++) // Check that all values are 1 or greater (except waiting chairs which can be 0)
    {
-      if (i != 2 && atoi(argv[i]) < 1) {
-         cout << "Invalid parameter: " << argv[i] << endl;
+      if (i != 1 && atoi(args[i]) < 1) {
+         cout << "Invalid parameter: " << args[i] << endl;
          cout << "Parameter must be greater than 0." << endl;
          return -1;
       }
@@ -69,32 +493,388 @@ int main(int argc, char* argv[])
       return -1;
    }
 
+   pthread_attr_t barber_attr;
+   pthread_attr_t customer_attr;
+   int err = initThreadAttr(&barber_attr, barber_stack_kb, guard_kb);
+   if (err == 0) {
+      err = initThreadAttr(&customer_attr, customer_stack_kb, guard_kb);
+   }
+   if (err != 0) {
+      cout << "Invalid thread attributes: " << strerror(err) << endl;
+      return -1;
+   }
+
+   // Customers write their records straight into the mapping, which is
+   //   backed by the records file if one was requested
+   MappedFile records_file;
+   if (!records_file.open(records_path, sizeof(RecordFileHeader) 
+                                        + (size_t)num_customers * sizeof(CustomerRecord))) {
+      cout << "Could not map records file: " << strerror(errno) << endl;
+      return -1;
+   }
+   RecordFileHeader* header = (RecordFileHeader*)records_file.data();
+   memcpy(header->magic, kRecordMagic, sizeof(header->magic));
+   header->version = kRecordVersion;
+   header->record_size = sizeof(CustomerRecord);
+   header->count = num_customers;
+   customer_records = (CustomerRecord*)(header + 1);
+
    //Many barbers, one shop, many customers
-   pthread_t barber_threads[num_barbers];
-   pthread_t customer_threads[num_customers];
-   Shop shop(num_barbers, num_chairs);
+   vector<pthread_t> customer_threads(num_customers);
+   Shop shop(num_barbers, num_chairs, autoscale_max);
+   int max_barbers = max(num_barbers, autoscale_max);
+   shop.set_print(!quiet);
+   ShopMetrics metrics;                                                    // Counting costs one atomic add per
+   if (metrics_ms > 0 || !metrics_listen.empty()                           //   transition, so only when asked for
+       || !samples_path.empty()) {
+      shop.set_metrics(&metrics);
+   }
+   for (int c = 0; c < kNumClasses; c++) {
+      if (limit_classes) {
+         shop.set_class_chairs(c, class_chairs[c]);
+      }
+      if (weighted) {
+         shop.set_class_weight(c, class_weights[c]);
+      }
+   }
 
+   // About 10 transitions per customer, plus one segment for every thread
+   //   that can be logging at the same time
+   EventLog events;
+   if (!events_path.empty()) {
+      uint32_t segments = (uint32_t)(((uint64_t)num_customers * 10 + kEventSegmentEvents - 1) 
+                                     / kEventSegmentEvents)
+                        + max_barbers + (stress ? num_customers : max_barbers + num_chairs + 1) + reactors;
+      if (!events.open(events_path, segments)) {
+         cout << "Could not map events file: " << strerror(errno) << endl;
+         return -1;
+      }
+      shop.set_event_log(&events);
+   }
+
+   BarberCrew crew;                                                        // Barbers outlive every customer, so their
+   crew.params.assign(max_barbers, ThreadParam(&shop, 0, service_time));  //   parameters simply live in main()
+   crew.attr = &barber_attr;
    for (int i = 0; i < num_barbers; i++) {
-      ThreadParam* barber_param = new ThreadParam(&shop, i, service_time); // Barber ID is used for indexing, so "+ 1" was removed
-      pthread_create(&barber_threads[i], NULL, barber, barber_param);      //   It's added back right before printing
+      startBarber(i, &crew);                                               // Barber ID is used for indexing, so "+ 1" was removed
+   }                                                                       // It's added back right before printing
+
+   AutoscalerConfig scale_config;
+   scale_config.max_barbers = autoscale_max;
+   scale_config.high_waiting = max(1, num_chairs / 2);
+   scale_config.p99_ns = (uint64_t)service_time * 4000;
+   scale_config.idle_polls = 10;
+   scale_config.interval_ns = max((uint64_t)service_time * 1000, (uint64_t)1000000);
+   scale_config.skills = 1;
+   scale_config.start = startBarber;
+   scale_config.context = &crew;
+   Autoscaler scaler(&shop, scale_config);
+   if (autoscale_max > num_barbers && !scaler.start()) {
+      cout << "Could not start the autoscaler" << endl;
+      return -1;
+   }
+
+   ShopOccupancy opened;
+   shop.get_occupancy(&opened);
+   OccupancyReport occupancy_report(&shop, (uint64_t)occupancy_ms * 1000000);
+   if (occupancy_ms > 0 && !occupancy_report.start()) {
+      cout << "Could not start the occupancy report" << endl;
+      return -1;
+   }
+   MetricsReport metrics_report(&metrics, (uint64_t)metrics_ms * 1000000);
+   if (metrics_ms > 0 && !metrics_report.start()) {
+      cout << "Could not start the metrics report" << endl;
+      return -1;
+   }
+   MetricsExporter exporter(&shop, &metrics);
+   if (!metrics_listen.empty() && !exporter.start(metrics_listen)) {
+      cout << "Could not serve metrics on " << metrics_listen << ": " << strerror(errno) << endl;
+      return -1;
+   }
+   Sampler sampler(&shop, &metrics, samples_path.empty() ? 1 : kSamplerSlots, (uint64_t)sample_us * 1000);
+   if (!samples_path.empty() && !sampler.start()) {
+      cout << "Could not start the sampler" << endl;
+      return -1;
+   }
+
+   // Customers in the shop at once are bounded by chairs + barbers unless
+   //   every customer is created up front; the pool grows if it runs out
+   CustomerPool pool(stress ? num_customers : max_barbers + num_chairs + 1);
+   customer_pool = &pool;
+
+   StartGate gate;
+   if (stress) {
+      stress_gate = &gate;
+   }
+   long rss_before = currentRssKB();
+   uint64_t create_start = nowNanos();
+
+   // Reactors: the same arrivals, planned up front and played as events;
+   //   customer i + 1 goes to loop i % reactors, which runs on core i % reactors
+   int reactor_customers = 0;
+   vector<Reactor*> loops;
+   if (reactors > 0) {
+      vector<vector<ReactorArrival> > plans(reactors);
+      uint64_t arrival_ns = nowNanos();
+      uint64_t resize_ns = arrival_ns;
+      for (int i = 0; i < num_customers; i++) {
+         arrival_ns += (uint64_t)(rand() % gap_us) * 1000;
+         if (i == num_customers / 2) {
+            resize_ns = arrival_ns;
+         }
+         ReactorArrival arrival;
+         arrival.arrival_ns = arrival_ns;
+         arrival.custID = i + 1;
+         arrival.custClass = drawClass(vip_percent, appointment_percent);
+         plans[i % reactors].push_back(arrival);
+      }
+      int max_in_flight = 2 * (max_barbers + max(num_chairs, resize_chairs)); // Everyone the shop can hold,
+                                                                           //   plus as many finished visits
+      for (int r = 0; r < reactors; r++) {
+         loops.push_back(new Reactor(&shop, customer_records, max_in_flight));
+         if (!loops[r]->start(plans[r], r)) {
+            cout << "Could not start reactor[" << r + 1 << "]: " << strerror(errno) << endl;
+            return -1;
+         }
+      }
+      if (resize_chairs >= 0) {
+         sleepUntilNanos(resize_ns);
+         shop.resizeWaitingRoom(resize_chairs);
+      }
+      for (int r = 0; r < reactors; r++) {
+         if (!loops[r]->join()) {
+            cout << "Reactor[" << r + 1 << "] failed: " << strerror(errno) << endl;
+            return -1;
+         }
+      }
+      reactor_customers = num_customers;
+   }
+
+   bool batching = !stress && burst > 0;                                   // Admit each burst under one lock
+   vector<CustomerSlot*> arrivals;                                         // Batching: the burst so far
+   int batches = 0;
+   int batched = 0;
+   int batch_waited = 0;
+   int num_created = 0;
+   for (int i = reactor_customers; i < num_customers; i++) {
+      if (i == num_customers / 2 && resize_chairs >= 0) {                  // Waiters beyond the new size drain
+         shop.resizeWaitingRoom(resize_chairs);
+      }
+      if (!stress && burst == 0) {
+         usleep(rand() % gap_us);
+      }
+      else if (!stress && i % burst == 0) {                                // A whole burst arrives after one gap
+         usleep(rand() % (gap_us * burst));
+      }
+      CustomerSlot* slot = pool.acquire();
+      if (slot == NULL) {
+         cout << "Could not create customer[" << i + 1 << "]: customer pool is full" << endl;
+         for (size_t k = 0; k < arrivals.size(); k++) {                    // Not admitted yet
+            pool.release(arrivals[k]);
+         }
+         break;
+      }
+      slot->shop = &shop;
+      slot->id = i + 1;
+      slot->customer_class = drawClass(vip_percent, appointment_percent);
+      slot->arrival_ns = nowNanos();
+      slot->batched = false;
+
+      vector<CustomerSlot*> ready(1, slot);
+      if (batching) {
+         arrivals.push_back(slot);
+         if ((int)arrivals.size() < burst && i + 1 < num_customers) {     // The rest of the burst is coming
+            continue;
+         }
+         batch_waited += admitBurst(shop, arrivals);
+         batches++;
+         batched += (int)arrivals.size();
+         ready.swap(arrivals);
+         arrivals.clear();
+      }
+
+      bool failed = false;
+      for (size_t k = 0; k < ready.size(); k++) {
+         CustomerSlot* next = ready[k];
+         if (!failed) {
+            err = pthread_create(&customer_threads[next->id - 1], &customer_attr, customer, next);
+            if (err == 0) {
+               num_created++;
+               continue;
+            }
+            cout << "Could not create customer[" << next->id << "]: " << strerror(err) << endl;
+            failed = true;
+         }
+         if (next->batched) {                                              // Already in the shop: finish
+            customer(next);                                                //   the visit on this thread
+         }
+         else {
+            pool.release(next);
+         }
+      }
+      if (failed) {
+         break;
+      }
    }
 
-   for (int i = 0; i < num_customers; i++) {
-      usleep(rand() % 1000);
-      ThreadParam* customer_param = new ThreadParam(&shop, i + 1, 0);
-      pthread_create(&customer_threads[i], NULL, customer, customer_param);
+   if (stress) {
+      uint64_t create_ns = nowNanos() - create_start;
+      long rss_after = currentRssKB();
+      cout << "# simultaneous customer threads = " << num_created << endl;
+      cout << "# customer stack = " << customer_stack_kb << " KB, guard = " << guard_kb << " KB" << endl;
+      if (num_created > 0) {
+         cout << "# creation time per thread = " << create_ns / num_created << " ns" << endl;
+         cout << "# RSS = " << rss_after << " KB (" 
+              << (double)(rss_after - rss_before) * 1024 / num_created << " bytes per thread)" << endl;
+      }
+      gate.open();                                                         // Let every customer into the shop at once
    }
 
-   // Wait for customers to finish and cancel barber
-   for (int i = 0; i < num_customers; i++) {
+   // Wait for customers to finish and close the shop
+   for (int i = 0; i < num_created; i++) {
       pthread_join(customer_threads[i], NULL);
    }
+   num_created += reactor_customers;
 
-   for (int i = 0; i < num_barbers; i++) {
-      pthread_cancel(barber_threads[i]);
+   scaler.stop();                                                          // No more hires after this
+   if (occupancy_ms > 0) {
+      occupancy_report.stop();
+   }
+   if (metrics_ms > 0) {
+      metrics_report.stop();
+   }
+   exporter.stop();
+   sampler.stop();
+   shop.closeShop();
+   for (size_t i = 0; i < crew.threads.size(); i++) {                      // Barbers must be gone before the
+      pthread_join(crew.threads[i], NULL);                                 //   shop and its event log go away
+   }
+
+   if (!schedule_path.empty()) {                                           // Arrivals as they really happened
+      vector<ScheduleEntry> schedule(num_created);
+      for (int i = 0; i < num_created; i++) {
+         schedule[i].arrival_ns = customer_records[i].arrival_ns - customer_records[0].arrival_ns;
+         schedule[i].service_us = service_time;
+         schedule[i].customer_class = customer_records[i].customer_class;
+      }
+      if (!writeSchedule(schedule_path, schedule)) {
+         cout << "Could not write schedule file: " << schedule_path << endl;
+      }
    }
 
+   pthread_attr_destroy(&barber_attr);
+   pthread_attr_destroy(&customer_attr);
+
    cout << "# customers who didn't receive a service = " << shop.get_cust_drops() << endl;
+   if (customer_patience_ns > 0) {
+      cout << "# customers who ran out of patience = " << shop.get_reneged() << endl;
+   }
+   cout << "# customer pool slots = " << pool.get_capacity() << endl;
+   if (reactors > 0) {
+      uint64_t wakeups = 0;
+      uint64_t timer_events = 0;
+      uint64_t completion_events = 0;
+      uint64_t held = 0;
+      int peak = 0;
+      for (int r = 0; r < reactors; r++) {
+         wakeups += loops[r]->get_wakeups();
+         timer_events += loops[r]->get_timer_events();
+         completion_events += loops[r]->get_completion_events();
+         held += loops[r]->get_held();
+         peak = max(peak, loops[r]->get_peak_in_flight());
+         delete loops[r];
+      }
+      cout << "# reactors = " << reactors << ": epoll wakeups = " << wakeups << ", timer events = "
+           << timer_events << ", completion events = " << completion_events << ", arrivals held = " << held
+           << ", most visits in flight = " << peak << endl;
+   }
+   struct rusage cpu_use;                                                  // Threads vs reactors: what the
+   getrusage(RUSAGE_SELF, &cpu_use);                                       //   customers cost the machine
+   cout << "# process CPU = "
+        << (cpu_use.ru_utime.tv_sec + cpu_use.ru_stime.tv_sec) * 1000
+           + (cpu_use.ru_utime.tv_usec + cpu_use.ru_stime.tv_usec) / 1000
+        << " ms, context switches = " << cpu_use.ru_nvcsw + cpu_use.ru_nivcsw << endl;
+   if (batches > 0) {                                                      // Waiters lock again in awaitVisit()
+      cout << "# batched arrivals = " << batched << " in " << batches << " batches, " << batch_waited
+           << " waited; shop lock acquisitions = " << batches + batch_waited << " instead of " << batched
+           << " (saved " << batched - batches - batch_waited << ")" << endl;
+   }
+   if (occupancy_ms > 0 || resize_chairs >= 0) {
+      ShopOccupancy closed;
+      shop.get_occupancy(&closed);
+      uint64_t chairs_ns = closed.chairs_ns - opened.chairs_ns;
+      cout << "# mean waiting room occupancy = "
+           << ((chairs_ns > 0) ? 100.0 * (closed.waiting_ns - opened.waiting_ns) / chairs_ns : 0.0)
+           << "%" << endl;
+   }
+   if (autoscale_max > num_barbers) {
+      cout << "# barbers hired = " << scaler.get_hired() << ", retired = " << scaler.get_retired()
+           << ", most working = " << scaler.get_peak() << endl;
+   }
+
+   // Per class: drops and waits from arrival to service chair
+   for (int c = 0; c < kNumClasses; c++) {
+      int customers = 0;
+      vector<uint64_t> waits;
+      for (int i = 0; i < num_created; i++) {
+         if ((int)customer_records[i].customer_class != c) {
+            continue;
+         }
+         customers++;
+         if (customer_records[i].outcome == kOutcomeServed) {
+            waits.push_back(customer_records[i].seat_ns - customer_records[i].arrival_ns);
+         }
+      }
+      if (customers == 0) {
+         continue;
+      }
+      sort(waits.begin(), waits.end());
+      cout << "# " << kClassNames[c] << ": customers = " << customers
+           << ", dropped = " << shop.get_class_drops(c)
+           << " (" << 100.0 * shop.get_class_drops(c) / customers << "%)";
+      if (!waits.empty()) {
+         cout << ", wait p50 = " << waits[waits.size() / 2] / 1000 << " us, p99 = "
+              << waits[waits.size() * 99 / 100] / 1000 << " us";
+      }
+      cout << endl;
+   }
+
+   // Per barber: time on shift by activity, for sizing the staff
+   BarberTime total = BarberTime();
+   for (int b = 0; b < max_barbers; b++) {
+      BarberTime time;
+      shop.get_barber_time(b, &time);
+      uint64_t shift_ns = time.sleeping_ns + time.serving_ns + time.checkout_ns;
+      if (shift_ns == 0) {                                                 // Never hired
+         continue;
+      }
+      cout << "# barber[" << b + 1 << "]: sleeping = " << time.sleeping_ns / 1000000
+           << " ms, serving = " << time.serving_ns / 1000000 << " ms, checkout = "
+           << time.checkout_ns / 1000000 << " ms, utilization = " << 100.0 * time.serving_ns / shift_ns
+           << "%" << endl;
+      total.sleeping_ns += time.sleeping_ns;
+      total.serving_ns += time.serving_ns;
+      total.checkout_ns += time.checkout_ns;
+   }
+   uint64_t total_ns = total.sleeping_ns + total.serving_ns + total.checkout_ns;
+   cout << "# barbers: sleeping = " << total.sleeping_ns / 1000000 << " ms, serving = "
+        << total.serving_ns / 1000000 << " ms, checkout = " << total.checkout_ns / 1000000
+        << " ms, utilization = " << ((total_ns > 0) ? 100.0 * total.serving_ns / total_ns : 0.0) << "%" << endl;
+
+   if (!samples_path.empty()) {
+      cout << "# samples taken = " << sampler.get_taken() << ", kept = " << sampler.get_kept()
+           << ", missed ticks = " << sampler.get_missed() << ", sampler CPU = "
+           << ((sampler.get_taken() > 0) ? sampler.get_cpu_ns() / sampler.get_taken() : 0) << " ns per sample"
+           << endl;
+      if (!sampler.writeCsv(samples_path)) {
+         cout << "Could not write samples file: " << samples_path << endl;
+      }
+   }
+   if (!events_path.empty()) {
+      cout << "# events logged = " << events.get_events_logged() 
+           << ", dropped = " << events.get_events_dropped() << endl;
+      events.close();
+   }
    return 0;
 }
 
@@ -104,10 +884,8 @@ void* barber(void* arg)
    Shop& shop = *barber_param->shop;
    int barbID = barber_param->id;
    int service_time = barber_param->service_time;
-   delete barber_param;
 
-   while (true) {
-      shop.helloCustomer(barbID);                                          // Wait for a customer
+   while (shop.helloCustomer(barbID) != 0) {                               // Wait for a customer
       usleep(service_time);                                                // Perform haircut
       shop.byeCustomer(barbID);                                            // Receive payment & signal new customer
    }
@@ -116,14 +894,41 @@ void* barber(void* arg)
 
 void* customer(void* arg)
 {
-   ThreadParam* customer_param = (ThreadParam*)arg;
-   Shop& shop = *customer_param->shop;
-   int id = customer_param->id;
-   delete customer_param;
+   CustomerSlot* slot = (CustomerSlot*)arg;
+   Shop& shop = *slot->shop;
+   int id = slot->id;
 
-   int barbID = shop.visitShop(id);                                        // Get the barber ID of an open chair
+   if (stress_gate != NULL) {                                              // Stress mode: wait until every customer exists
+      stress_gate->wait();
+   }
+
+   CustomerRecord& record = customer_records[id - 1];
+   record.customer = id;
+   record.customer_class = slot->customer_class;
+   record.arrival_ns = slot->arrival_ns;
+
+   bool reneged = false;
+   int barbID;
+   if (!slot->batched) {
+      barbID = shop.visitShop(id, slot->customer_class, 0, customer_patience_ns, &reneged); // Get the barber ID of an open chair
+   }
+   else if (slot->admitted == kVisitQueued) {                              // Took a waiting chair in admitBurst()
+      barbID = shop.awaitVisit(&slot->visit, &reneged);
+   }
+   else {
+      barbID = slot->admitted;
+   }
    if (barbID != -1) {                                                     // If customer got a seat proceed with transaction
-      shop.leaveShop(id, barbID);
+      if (!slot->batched || slot->admitted == kVisitQueued) {              // admitBurst() timed direct seats
+         record.seat_ns = nowNanos();
+      }
+      shop.leaveShop(id, barbID, &record.start_ns, &record.end_ns);
    }
+
+   record.barber = barbID;
+   record.leave_ns = nowNanos();
+   record.outcome = (barbID != -1) ? kOutcomeServed : reneged ? kOutcomeReneged : kOutcomeDropped;
+
+   customer_pool->release(slot);                                           // Slot is recycled for a later arrival
    return nullptr;
 }
@@ -0,0 +1,88 @@
+/** @file logview.cpp
+ *
+ * logview.cpp file:
+ * Converts a binary event log written by driver --events back into text
+ * By default every event is rendered in the same format Shop prints,
+ *   in the order the events happened. With --raw every event (including
+ *   arrivals and departures) is written as one tab-separated row:
+ *   seq  time_us  type  customer  barber  arg
+ *   with time_us relative to the first event
+ *
+ * Assumptions:
+ * The log was written on a machine with the same byte order
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string.h>
+#include <vector>
+#include "EventLog.h"
+
+using namespace std;
+
+static const char* kTypeNames[kEventTypes] = {
+   "none", "arrive", "wait", "seat", "await", "start",
+   "done", "pay", "leave", "drop", "sleep", "next", "renege",
+   "checkin", "hire", "retire", "offshift", "resize"
+};
+
+int main(int argc, char* argv[])
+{
+   bool raw = (argc == 3 && strcmp(argv[1], "--raw") == 0);
+   if (argc != 2 && !raw) {
+      cout << "Usage: logview [--raw] events_file" << endl;
+      return -1;
+   }
+
+   ifstream in(argv[argc - 1], ios::binary);
+   EventFileHeader header;
+   if (!in.read((char*)&header, sizeof(header))) {
+      cout << "Could not read " << argv[argc - 1] << endl;
+      return -1;
+   }
+   if (memcmp(header.magic, kEventMagic, sizeof(header.magic)) != 0
+       || header.version != kEventVersion || header.event_size != sizeof(ShopEvent)) {
+      cout << argv[argc - 1] << " is not a version " << kEventVersion << " event log" << endl;
+      return -1;
+   }
+
+   // Threads fill their own segments, so events are only grouped by thread
+   //   in the file. Sequence numbers are dense, so they index the output.
+   vector<ShopEvent> ordered;
+   ShopEvent event;
+   while (in.read((char*)&event, sizeof(event))) {
+      if (event.type == kEventNone) {                          // Unused slot
+         continue;
+      }
+      if (event.seq > ordered.size()) {
+         ordered.resize(event.seq);
+      }
+      ordered[event.seq - 1] = event;
+   }
+
+   uint64_t first_ns = 0;
+   for (size_t i = 0; i < ordered.size(); i++) {
+      const ShopEvent& ev = ordered[i];
+      if (ev.type == kEventNone || ev.type >= kEventTypes) {   // Lost when the log ran out of segments
+         continue;
+      }
+      if (!raw) {
+         string line = formatEvent(ev);
+         if (!line.empty()) {
+            cout << line << "\n";
+         }
+         continue;
+      }
+
+      if (first_ns == 0) {
+         first_ns = ev.time_ns;
+      }
+      cout << ev.seq << "\t" << (ev.time_ns - first_ns) / 1000 << "\t" << kTypeNames[ev.type]
+           << "\t" << ev.customer << "\t" << ev.barber << "\t" << ev.arg << "\n";
+   }
+
+   if (header.events_dropped > 0) {
+      cerr << "# " << header.events_dropped << " events were dropped while logging" << endl;
+   }
+   return 0;
+}
@@ -0,0 +1,222 @@
+/** @file replay.cpp
+ *
+ * replay.cpp file:
+ * Feeds a schedule recorded by driver --schedule back into a Shop
+ * Customers arrive at the recorded offsets and every haircut takes the
+ *   recorded service time, both multiplied by --scale. A scale of 0 runs
+ *   the schedule at full speed: arrivals back to back and no service time,
+ *   which stresses the monitor itself.
+ * Running the same schedule against two builds compares monitor
+ *   implementations on an identical workload
+ *
+ * Assumptions:
+ * The schedule was written by driver --schedule (see Schedule.h)
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <getopt.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Clock.h"
+#include "CustomerRecord.h"
+#include "Schedule.h"
+#include "Shop.h"
+#include "ThreadUtil.h"
+
+using namespace std;
+
+void* barber(void*);
+void* customer(void*);
+
+// ReplayParam class
+// Shared by every thread of one replay. Barbers are passed a pointer into
+// barber_ids and customers a pointer to their own record.
+class ReplayParam
+{
+public:
+   ReplayParam(Shop* shop, const vector<ScheduleEntry>* schedule, double scale, int num_barbers) :
+      shop(shop),
+      schedule(schedule),
+      scale(scale),
+      records(schedule->size()),
+      barber_ids(num_barbers) {};
+   Shop* shop;
+   const vector<ScheduleEntry>* schedule;
+   double scale;
+   vector<CustomerRecord> records;                                         // Indexed by customer ID - 1
+   vector<int> barber_ids;
+};
+
+ReplayParam* replay = NULL;
+
+static const struct option kLongOptions[] = {
+   { "scale",  required_argument, NULL, 's' },
+   { "events", required_argument, NULL, 'e' },
+   { "quiet",  no_argument,       NULL, 'q' },
+   { NULL, 0, NULL, 0 }
+};
+
+static void usage()
+{
+   cout << "Usage: replay schedule_file num_barbers num_chairs [options]" << endl;
+   cout << "  --scale F     multiply arrival offsets and service times by F" << endl;
+   cout << "                (default 1, 0 replays at full speed)" << endl;
+   cout << "  --events FILE write a binary ShopEvent per transition to FILE" << endl;
+   cout << "  --quiet       do not print transitions" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+   // Read options from command line
+   double scale = 1.0;
+   string events_path;
+   bool quiet = false;
+
+   int opt;
+   while ((opt = getopt_long(argc, argv, "", kLongOptions, NULL)) != -1) {
+      switch (opt) {
+      case 's': scale = atof(optarg);   break;
+      case 'e': events_path = optarg;   break;
+      case 'q': quiet = true;           break;
+      default:
+         usage();
+         return -1;
+      }
+   }
+
+   // Read arguments from command line
+   if (argc - optind != 3) {
+      usage();
+      return -1;
+   }
+   char** args = argv + optind;
+   int num_barbers = atoi(args[1]);
+   int num_chairs = atoi(args[2]);
+
+   if (num_barbers < 1 || num_chairs < 0 || scale < 0) {
+      cout << "Invalid parameter: barbers must be > 0, chairs and scale >= 0" << endl;
+      return -1;
+   }
+
+   vector<ScheduleEntry> schedule;
+   if (!readSchedule(args[0], &schedule)) {
+      cout << "Could not read schedule file: " << args[0] << endl;
+      return -1;
+   }
+   int num_customers = (int)schedule.size();
+
+   Shop shop(num_barbers, num_chairs);
+   shop.set_print(!quiet);
+
+   EventLog events;
+   if (!events_path.empty()) {
+      uint32_t segments = (uint32_t)(((uint64_t)num_customers * 10 + kEventSegmentEvents - 1)
+                                     / kEventSegmentEvents)
+                        + num_barbers + num_barbers + num_chairs + 1;
+      if (!events.open(events_path, segments)) {
+         cout << "Could not map events file: " << strerror(errno) << endl;
+         return -1;
+      }
+      shop.set_event_log(&events);
+   }
+
+   ReplayParam param(&shop, &schedule, scale, num_barbers);
+   replay = &param;
+
+   pthread_attr_t attr;
+   initThreadAttr(&attr, kDefaultStackKB, kDefaultGuardKB);
+
+   vector<pthread_t> barber_threads(num_barbers);
+   vector<pthread_t> customer_threads(num_customers);
+
+   for (int i = 0; i < num_barbers; i++) {
+      param.barber_ids[i] = i;
+      pthread_create(&barber_threads[i], &attr, barber, &param.barber_ids[i]);
+   }
+
+   uint64_t start_ns = nowNanos();
+   int num_created = 0;
+   for (int i = 0; i < num_customers; i++) {
+      if (scale > 0) {
+         sleepUntilNanos(start_ns + (uint64_t)(schedule[i].arrival_ns * scale));
+      }
+      param.records[i].customer = i + 1;
+      param.records[i].customer_class = schedule[i].customer_class;
+      param.records[i].arrival_ns = nowNanos();
+      if (pthread_create(&customer_threads[i], &attr, customer, &param.records[i]) != 0) {
+         cout << "Could not create customer[" << i + 1 << "]" << endl;
+         break;
+      }
+      num_created++;
+   }
+
+   for (int i = 0; i < num_created; i++) {
+      pthread_join(customer_threads[i], NULL);
+   }
+   uint64_t elapsed_ns = nowNanos() - start_ns;
+
+   shop.closeShop();
+   for (int i = 0; i < num_barbers; i++) {
+      pthread_join(barber_threads[i], NULL);
+   }
+   pthread_attr_destroy(&attr);
+
+   // Summarize the run: waits are measured from arrival to service chair
+   vector<uint64_t> waits;
+   for (int i = 0; i < num_created; i++) {
+      if (param.records[i].outcome == kOutcomeServed) {
+         waits.push_back(param.records[i].seat_ns - param.records[i].arrival_ns);
+      }
+   }
+   sort(waits.begin(), waits.end());
+
+   cout << "# customers replayed = " << num_created << endl;
+   cout << "# customers who didn't receive a service = " << shop.get_cust_drops() << endl;
+   cout << "# elapsed = " << elapsed_ns / 1000 << " us" << endl;
+   if (!waits.empty()) {
+      cout << "# wait p50 = " << waits[waits.size() / 2] / 1000 << " us, p99 = "
+           << waits[waits.size() * 99 / 100] / 1000 << " us" << endl;
+   }
+   if (!events_path.empty()) {
+      cout << "# events logged = " << events.get_events_logged()
+           << ", dropped = " << events.get_events_dropped() << endl;
+   }
+   return 0;
+}
+
+void* barber(void* arg)
+{
+   int barbID = *(int*)arg;
+   Shop& shop = *replay->shop;
+
+   int custID;
+   while ((custID = shop.helloCustomer(barbID)) != 0) {                    // Wait for a customer
+      uint32_t service_us = (*replay->schedule)[custID - 1].service_us;    // Perform the recorded haircut
+      if (replay->scale > 0) {
+         sleepUntilNanos(nowNanos() + (uint64_t)(service_us * 1000.0 * replay->scale));
+      }
+      shop.byeCustomer(barbID);                                            // Receive payment & signal new customer
+   }
+   return nullptr;
+}
+
+void* customer(void* arg)
+{
+   CustomerRecord& record = *(CustomerRecord*)arg;
+   Shop& shop = *replay->shop;
+   int id = record.customer;
+
+   int barbID = shop.visitShop(id, record.customer_class);                 // Get the barber ID of an open chair
+   if (barbID != -1) {                                                     // If customer got a seat proceed with transaction
+      record.seat_ns = nowNanos();
+      shop.leaveShop(id, barbID, &record.start_ns, &record.end_ns);
+   }
+
+   record.barber = barbID;
+   record.leave_ns = nowNanos();
+   record.outcome = (barbID != -1) ? kOutcomeServed : kOutcomeDropped;
+   return nullptr;
+}
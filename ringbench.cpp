@@ -0,0 +1,235 @@
+/** @file ringbench.cpp
+ *
+ * ringbench.cpp file:
+ * Throughput benchmark and check of MpmcRing against a mutex-guarded ring
+ * Half of the threads push for a fixed time and the other half pop; one
+ *   thread alternates between the two. Every item carries its producer and
+ *   a sequence number, and every consumer checks that it sees each
+ *   producer's items in order and that no item is lost or seen twice, so
+ *   a short run is also a correctness test.
+ * Every line of output is one configuration:
+ *   queue  threads  ops/s  (one op is a push and its pop)
+ *
+ * Assumptions:
+ * Runs on an otherwise idle machine; use a Release build for numbers
+ */
+
+#include <atomic>
+#include <iostream>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include "Clock.h"
+#include "MpmcRing.h"
+#include "Sync.h"
+
+using namespace std;
+
+#define kRingSlots 1024         // ring size, about a large waiting room
+#define kProducerShift 40       // items are (producer << kProducerShift) | sequence
+
+// LockedRing class
+// The same bounded FIFO guarded by one pthread mutex, for comparison
+template <typename T>
+class LockedRing
+{
+public:
+   LockedRing(size_t capacity) : items_(capacity), head_(0), tail_(0) {};
+   bool tryPush(const T& item)
+   {
+      mutex_.lock();
+      bool ok = head_ - tail_ < items_.size();
+      if (ok) {
+         items_[head_++ % items_.size()] = item;
+      }
+      mutex_.unlock();
+      return ok;
+   };
+   bool tryPop(T* item)
+   {
+      mutex_.lock();
+      bool ok = head_ != tail_;
+      if (ok) {
+         *item = items_[tail_++ % items_.size()];
+      }
+      mutex_.unlock();
+      return ok;
+   };
+private:
+   vector<T> items_;
+   size_t head_;                                                           // Next item pushed
+   size_t tail_;                                                           // Next item popped
+   PthreadMutex mutex_;
+};
+
+// RingParam struct
+// Shared by every thread of one configuration
+template <typename RingT>
+struct RingParam
+{
+   RingT* ring;
+   int num_producers;
+   atomic<bool> stop;                                                      // Producers stop pushing
+   atomic<bool> drained;                                                   // Producers are joined
+   atomic<uint64_t> pushed;
+   atomic<uint64_t> popped;
+   atomic<bool> error;                                                     // An item was out of order
+};
+
+// --------------------------- bool take<RingT>(RingParam<RingT>&, vector<uint64_t>&)
+// Pops one item and checks it follows the last item of its producer
+//
+// param: param  The configuration
+// param: last   Per producer: sequence + 1 of the last item seen, 0 if none
+// return: false if the ring was empty
+//
+template <typename RingT>
+static bool take(RingParam<RingT>& param, vector<uint64_t>& last)
+{
+   uint64_t item;
+   if (!param.ring->tryPop(&item)) {
+      return false;
+   }
+   uint64_t producer = item >> kProducerShift;
+   uint64_t seq = item & (((uint64_t)1 << kProducerShift) - 1);
+   if (producer >= last.size() || seq < last[producer]) {
+      param.error = true;
+   }
+   else {
+      last[producer] = seq + 1;
+   }
+   return true;
+}
+
+// --------------------------- void* producer<RingT>(void*)
+// Pushes numbered items until stopped
+//
+template <typename RingT>
+void* producer(void* arg)
+{
+   pair<RingParam<RingT>*, int>* self = (pair<RingParam<RingT>*, int>*)arg;
+   RingParam<RingT>& param = *self->first;
+   uint64_t id = (uint64_t)self->second << kProducerShift;
+   uint64_t seq = 0;
+   while (!param.stop.load(memory_order_relaxed)) {
+      if (param.ring->tryPush(id | seq)) {
+         seq++;
+      }
+      else {
+         sched_yield();                                                    // Full: let a consumer run
+      }
+   }
+   param.pushed += seq;
+   return nullptr;
+}
+
+// --------------------------- void* consumer<RingT>(void*)
+// Pops items until the producers are done and the ring is empty
+//
+template <typename RingT>
+void* consumer(void* arg)
+{
+   RingParam<RingT>& param = *(RingParam<RingT>*)arg;
+   vector<uint64_t> last(param.num_producers, 0);
+   uint64_t popped = 0;
+   while (true) {
+      if (take(param, last)) {
+         popped++;
+      }
+      else if (param.drained.load(memory_order_acquire)) {               // Every push is published
+         break;
+      }
+      else {
+         sched_yield();                                                    // Empty: let a producer run
+      }
+   }
+   param.popped += popped;
+   return nullptr;
+}
+
+// --------------------------- double runConfig<RingT>(int, int, bool*)
+// Runs one configuration and reports its throughput
+//
+// pre: num_threads > 0
+// param: num_threads  Threads; half push and half pop, or one that does both
+// param: millis       Length of the run
+// param: ok           Set to false if an item was lost, duplicated or out of order
+// return: Items pushed and popped per second
+//
+template <typename RingT>
+static double runConfig(int num_threads, int millis, bool* ok)
+{
+   RingT ring(kRingSlots);
+   RingParam<RingT> param;
+   param.ring = &ring;
+   param.num_producers = (num_threads == 1) ? 1 : num_threads / 2;
+   param.stop = false;
+   param.drained = false;
+   param.pushed = 0;
+   param.popped = 0;
+   param.error = false;
+
+   uint64_t start_ns = nowNanos();
+   uint64_t stop_ns = start_ns + (uint64_t)millis * 1000000;
+   if (num_threads == 1) {                                                 // Push and pop in turn
+      vector<uint64_t> last(1, 0);
+      uint64_t seq = 0;
+      while (nowNanos() < stop_ns) {
+         for (int i = 0; i < 1000; i++) {
+            ring.tryPush(seq++);
+            take(param, last);
+         }
+      }
+      param.pushed = seq;
+      param.popped = seq;
+   }
+   else {
+      int num_consumers = num_threads - param.num_producers;
+      vector<pthread_t> producers(param.num_producers);
+      vector<pthread_t> consumers(num_consumers);
+      vector<pair<RingParam<RingT>*, int> > producer_args(param.num_producers);
+      for (int i = 0; i < num_consumers; i++) {
+         pthread_create(&consumers[i], NULL, consumer<RingT>, &param);
+      }
+      for (int i = 0; i < param.num_producers; i++) {
+         producer_args[i] = make_pair(&param, i);
+         pthread_create(&producers[i], NULL, producer<RingT>, &producer_args[i]);
+      }
+      sleepUntilNanos(stop_ns);
+      param.stop = true;
+      for (int i = 0; i < param.num_producers; i++) {
+         pthread_join(producers[i], NULL);
+      }
+      param.drained.store(true, memory_order_release);
+      for (int i = 0; i < num_consumers; i++) {
+         pthread_join(consumers[i], NULL);
+      }
+   }
+   double seconds = (nowNanos() - start_ns) / 1e9;
+
+   *ok = !param.error && param.pushed == param.popped;
+   return param.popped / seconds;
+}
+
+int main(int argc, char* argv[])
+{
+   int millis = (argc > 1) ? atoi(argv[1]) : 500;
+   if (millis < 1 || argc > 2) {
+      cout << "Usage: ringbench [millis_per_config]" << endl;
+      return -1;
+   }
+
+   static const int kThreads[] = { 1, 2, 4, 8, 16, 32, 64 };
+   bool all_ok = true;
+   for (size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); t++) {
+      bool ok;
+      double rate = runConfig<MpmcRing<uint64_t> >(kThreads[t], millis, &ok);
+      cout << "mpmc\t" << kThreads[t] << "\t" << (long)rate << (ok ? "" : "\tFAILED") << endl;
+      all_ok = all_ok && ok;
+      rate = runConfig<LockedRing<uint64_t> >(kThreads[t], millis, &ok);
+      cout << "mutex\t" << kThreads[t] << "\t" << (long)rate << (ok ? "" : "\tFAILED") << endl;
+      all_ok = all_ok && ok;
+   }
+   return all_ok ? 0 : 1;
+}
@@ -0,0 +1,1462 @@
+/** @file stress.cpp
+ *
+ * stress.cpp file:
+ * Randomized stress and correctness test for the Shop monitor
+ * Each round runs many barber and customer threads against one Shop with
+ *   random delays injected before arrivals and during haircuts, records
+ *   every transition in an in-memory EventLog, and then replays the log
+ *   in sequence order to check the monitor's invariants:
+ *   - every customer arrives and leaves exactly once
+ *   - every customer is either dropped, or seated, served and paid
+ *     exactly once by the barber whose chair they sat in
+ *   - no service chair ever holds two customers
+ *   - no customer sits down to wait while the waiting chairs, or the
+ *     share of their class, are taken; after the waiting room shrinks
+ *     nobody is evicted and arrivals are turned away until it drained
+ *   - a customer only waits, or is turned away, while no barber with the
+ *     skill for their service is free, and is only seated by such a barber
+ *   - waiters of a class are called in first come, first served among the
+ *     services the barber can perform, and with strict priority only when
+ *     no higher class customer he could serve is waiting
+ *   - a customer is only turned away, or displaced, while no lower class
+ *     customer could have given up a waiting chair
+ *   - a customer only reneges while waiting, and not before their
+ *     patience ran out
+ *   - customers with an appointment are served by their barber, who calls
+ *     them in ahead of waiting customers once the slot is due and before
+ *     them only when nobody is waiting; they are only dropped for
+ *     arriving after the slot
+ *   - barbers are only hired while off, only retire while working and
+ *     only go home with an empty chair and nobody checked in; a retiring
+ *     barber only calls in his appointments, and waiters are only dropped
+ *     when the last barber with the skill for their service retires
+ *   - served + dropped + reneged == customers, and drops and reneges
+ *     match get_cust_drops() and get_reneged()
+ * Customers are VIPs, appointments or walk-ins at random; walk-ins may
+ *   only hold three quarters of the waiting chairs. With --patience-us
+ *   half of the customers give up waiting after a random patience. With
+ *   --book the appointment customers book a slot with a barber and arrive
+ *   around its start, some of them too late. With --skills N customers
+ *   ask for one of N services and barbers have random skill sets. With
+ *   --scale another thread keeps hiring and retiring barbers, with
+ *   --resize it keeps resizing the waiting room. With --metrics the shop
+ *   counts transitions in ShopMetrics; another thread keeps checking that
+ *   snapshots are consistent and the totals must match the round.
+ * With --batch N walk-in and VIP customers arrive in groups of N: the
+ *   first of each group admits all of them with visitShopBatch() and the
+ *   ones given a waiting chair wait in awaitVisit().
+ * With --async N walk-ins and VIPs have no thread of their own: N front
+ *   end threads start their visits with tryVisitShop(), at the same
+ *   random times, and poll a CompletionQueue for the rest; the visits must
+ *   complete in order (Seated only after queueing, then Done or Dropped).
+ * With --steal the rounds run against StealingShop instead, which has no
+ *   event log; they check that every customer is dropped or served by
+ *   exactly the barber visitShop() named, once, and that the drops and
+ *   the wait histogram match the shop's counts.
+ * Exits with 1 on the first violation. Run it from a Tsan build to also
+ *   catch data races.
+ *
+ * Assumptions:
+ * Shop logs every transition while holding its mutex, so sequence
+ *   numbers give the order the monitor saw them in
+ */
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <errno.h>
+#include <getopt.h>
+#include <iostream>
+#include <limits.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "Clock.h"
+#include "EventLog.h"
+#include "Metrics.h"
+#include "Shop.h"
+#include "StealingShop.h"
+#include "ThreadUtil.h"
+
+using namespace std;
+
+template <typename ShopT> void* barber(void*);
+template <typename ShopT> void* customer(void*);
+template <typename ShopT> void* scaler(void*);
+template <typename ShopT> void* frontEnd(void*);
+void* watchMetrics(void*);
+void* stealBarber(void*);
+void* stealCustomer(void*);
+
+// StressParam class
+// Shared by every thread of one round
+class StressParam
+{
+public:
+   StressParam(void* shop, int max_delay_us, unsigned seed) :
+      shop(shop),
+      max_delay_us(max_delay_us),
+      seed(seed),
+      start(false),
+      start_ns(0)
+   {
+      pthread_mutex_init(&mutex, NULL);
+      pthread_cond_init(&cond_start, NULL);
+   };
+   ~StressParam()
+   {
+      pthread_mutex_destroy(&mutex);
+      pthread_cond_destroy(&cond_start);
+   };
+   void* shop;                                                             // The round's ShopT
+   int max_delay_us;                                                       // Upper bound of injected delays
+   unsigned seed;                                                          // Threads derive their own seeds
+   bool start;                                                             // Customers wait for this
+   uint64_t start_ns;                                                      // When start was set
+   pthread_mutex_t mutex;
+   pthread_cond_t cond_start;
+};
+
+// ThreadArg struct
+// What one thread needs: the round and its own ID
+struct ThreadArg
+{
+   StressParam* param;
+   int id;
+   int custClass;                                                          // Customers: CustomerClass
+   int service;                                                            // Customers: service type
+   uint64_t patience_ns;                                                   // Customers: 0 = wait forever
+   int apptID;                                                             // Customers: booking or -1
+   Appointment appt;                                                       // Customers: the booked slot
+   void* batch;                                                            // Customers: BatchArg<ShopT> or NULL
+   int batch_index;                                                        // Customers: entry in the batch
+   bool async;                                                             // Customers: driven by a FrontArg
+   int delay_us;                                                           // Customers: arrival after start
+   uint64_t arrive_ns;                                                     // Customers: when to come, if booked
+   int result;                                                             // Customers: visitShop() result
+};
+
+// ScaleArg struct
+// What the scaler thread needs; it owns the threads of the barbers it hires
+struct ScaleArg
+{
+   StressParam* param;
+   bool hire;                                                              // Hire and retire barbers
+   bool resize;                                                            // Resize the waiting room
+   int max_barbers;                                                        // Barber IDs the shop has
+   int max_chairs;                                                         // Largest waiting room to try
+   int num_services;                                                       // Skills hired barbers get
+   bool stop;                                                              // Guarded by param->mutex
+   pthread_attr_t* attr;
+   vector<ThreadArg> barber_args;                                          // Indexed by barber ID
+   vector<pthread_t> barbers;                                              // Every barber thread started
+   int hired;
+   int retired;
+   int resized;
+};
+
+// BatchArg struct
+// A group of customers admitted by one visitShopBatch() call
+template <typename ShopT>
+struct BatchArg
+{
+   vector<int> ids;
+   vector<int> classes;
+   vector<int> services;
+   vector<uint64_t> patience_ns;
+   vector<int> results;                                                    // Set by the first customer
+   typename ShopT::WaitTicket* visits;
+   vector<typename ShopT::WaitTicket*> visit_ptrs;                         // visitShopBatch() takes pointers
+   bool admitted;                                                          // Guarded by param->mutex
+};
+
+// FrontArg struct
+// A front end thread and the customers whose visits it drives
+struct FrontArg
+{
+   StressParam* param;
+   vector<ThreadArg*> customers;                                           // In order of arrival
+   string error;                                                           // First misordered completion
+};
+
+// WatchArg struct
+// What the metrics watcher thread needs
+struct WatchArg
+{
+   StressParam* param;
+   const ShopMetrics* metrics;
+   int max_barbers;                                                        // Bound of the barber gauges
+   bool stop;                                                              // Guarded by param->mutex
+   int snapshots;                                                          // Snapshots checked
+   int exact;                                                              // Snapshots marked exact
+   string error;                                                           // First inconsistency
+};
+
+// StealArg struct
+// What a thread of a --steal round needs
+struct StealArg
+{
+   StressParam* param;
+   int id;
+   int result;                                                             // Customers: visitShop() result
+   vector<int> served;                                                     // Barbers: customers called in
+};
+
+// --------------------------- bool arrivesBefore(const ThreadArg*, const ThreadArg*)
+// pre: Both are async customers
+// return: Whether a is due to arrive before b
+//
+static bool arrivesBefore(const ThreadArg* a, const ThreadArg* b)
+{
+   return a->delay_us < b->delay_us;
+}
+
+// --------------------------- int delayUs(unsigned*, int)
+// pre: None
+// param: seed          rand_r() state of the calling thread
+// param: max_delay_us  Upper bound
+// return: A random delay in [0, max_delay_us], zero about half the time
+//   so that threads also collide without any delay
+//
+static int delayUs(unsigned* seed, int max_delay_us)
+{
+   if (max_delay_us == 0 || rand_r(seed) % 2 == 0) {
+      return 0;
+   }
+   return rand_r(seed) % (max_delay_us + 1);
+}
+
+// Waiters by service and class, oldest first
+typedef deque<int> WaitQueues[kMaxServices][kNumClasses];
+
+// --------------------------- bool lowerClassWaiting(const int*, int)
+// pre: None
+// param: class_waiting  Waiters of each CustomerClass
+// param: custClass      CustomerClass to compare with
+// return: true if a class below custClass has waiters
+//
+static bool lowerClassWaiting(const int* class_waiting, int custClass)
+{
+   for (int k = custClass + 1; k < kNumClasses; k++) {
+      if (class_waiting[k] > 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// --------------------------- bool qualifiedWaiting(const WaitQueues&, uint32_t, int)
+// pre: None
+// param: queue    Waiters by service and class
+// param: skills   Skill set of a barber
+// param: classes  Only classes before this one count
+// return: true if the barber could serve a waiter of those classes
+//
+static bool qualifiedWaiting(const WaitQueues& queue, uint32_t skills, int classes)
+{
+   for (int s = 0; s < kMaxServices; s++) {
+      for (int k = 0; (skills & (1u << s)) && k < classes; k++) {
+         if (!queue[s][k].empty()) {
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+// Where each barber is in his shift, as the log shows it
+enum { kShiftOff, kShiftOn, kShiftRetiring };
+
+// --------------------------- bool freeQualified(const vector<int>&, const vector<int>&, const vector<uint32_t>&, int)
+// pre: None
+// param: chair    Customer in each barber's chair, 0 if empty
+// param: shift    Shift state of each barber
+// param: skills   Skill set of each barber
+// param: service  Service type
+// return: true if a working barber with the skill for service has an empty chair
+//
+static bool freeQualified(const vector<int>& chair, const vector<int>& shift, const vector<uint32_t>& skills,
+                          int service)
+{
+   for (size_t b = 0; b < chair.size(); b++) {
+      if (chair[b] == 0 && shift[b] == kShiftOn && (skills[b] & (1u << service))) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// --------------------------- bool checkLog(...)
+// Replays the event log in sequence order and checks the invariants
+//
+// pre: No thread is logging into log anymore
+// param: log            Log of one round
+// param: num_barbers    Barber IDs in the round
+// param: working        Barbers working when the round starts
+// param: initial_chairs Waiting chairs when the round starts
+// param: initial_skills Skill set of each barber when the round starts
+// param: class_chairs   Waiting chairs each CustomerClass may hold
+// param: strict         Whether the shop used strict priority
+// param: args           Customer arguments, index = customer ID - 1
+// param: reported_drops Shop::get_cust_drops() at the end of the round
+// param: reported_reneged Shop::get_reneged() at the end of the round
+// param: error          Receives a description of the first violation
+// return: true if every invariant holds
+//
+static bool checkLog(const EventLog& log, int num_barbers, int working, int initial_chairs,
+                     const vector<uint32_t>& initial_skills, const int* class_chairs, bool strict, const vector<ThreadArg>& args, int reported_drops,
+                     int reported_reneged, string* error)
+{
+   int num_customers = (int)args.size();
+   stringstream out;
+
+   if (log.get_events_dropped() > 0) {
+      out << log.get_events_dropped() << " events did not fit in the log";
+      *error = out.str();
+      return false;
+   }
+
+   vector<ShopEvent> events(log.get_events_logged());
+   for (uint32_t s = 0; s < log.get_num_segments(); s++) {
+      const ShopEvent* segment = log.segment(s);
+      for (int i = 0; i < kEventSegmentEvents; i++) {
+         if (segment[i].type != kEventNone) {
+            events[segment[i].seq - 1] = segment[i];
+         }
+      }
+   }
+
+   // Per-customer progress: 0 = not arrived, then one bit per transition
+   enum { kArrived = 1, kWaited = 2, kSeated = 4, kStarted = 8, kDone = 16,
+          kPaid = 32, kDropped = 64, kLeft = 128, kReneged = 256, kCheckedIn = 512 };
+   vector<int> state(num_customers + 1, 0);
+   vector<uint64_t> wait_ns(num_customers + 1, 0);                         // When each waiter sat down
+   vector<uint64_t> wait_seq(num_customers + 1, 0);                        // Order they sat down in
+   vector<int> chair(num_barbers, 0);                                      // Customer in each chair
+   int num_chairs = initial_chairs;                                        // Waiting chairs right now
+   int waiting = 0;
+   int served = 0;
+   int dropped = 0;
+   int reneged = 0;
+   WaitQueues queue;                                                       // Waiters by service and class
+   int class_waiting[kNumClasses] = { 0 };                                 // Waiters of each class
+   int skill_barbers[kMaxServices] = { 0 };                                // Working barbers with each skill
+   vector<uint32_t> skills(initial_skills);                                // Skill set of each barber
+   vector<int> shift(num_barbers, kShiftOff);
+   for (int b = 0; b < working; b++) {
+      shift[b] = kShiftOn;
+      for (int s = 0; s < kMaxServices; s++) {
+         skill_barbers[s] += (skills[b] >> s) & 1;
+      }
+   }
+   vector<deque<int> > checked_in(num_barbers);                            // Checked-in appointments by due time
+   vector<uint64_t> next_ns(num_barbers, 0);                               // Time of each barber's last Next
+
+   for (size_t i = 0; i < events.size(); i++) {
+      const ShopEvent& ev = events[i];
+      int c = ev.customer;
+      int b = ev.barber;
+      out.str("");
+      out << "event " << ev.seq << " (" << formatEvent(ev) << ", type " << ev.type << "): ";
+
+      if (ev.type == kEventNone) {
+         out << "missing from the log";
+         *error = out.str();
+         return false;
+      }
+      if (c < 0 || c > num_customers || b < -1 || b >= num_barbers) {
+         out << "customer or barber out of range";
+         *error = out.str();
+         return false;
+      }
+
+      bool ok = true;
+      switch (ev.type) {
+      case kEventArrive:
+         ok = (state[c] == 0) && ev.arg == args[c - 1].custClass;
+         state[c] = kArrived;
+         break;
+      case kEventWait: {
+         const ThreadArg& arg = args[c - 1];
+         ok = (state[c] == kArrived) && !freeQualified(chair, shift, skills, arg.service);
+         state[c] |= kWaited;
+         wait_ns[c] = ev.time_ns;
+         wait_seq[c] = ev.seq;
+         waiting++;
+         queue[arg.service][arg.custClass].push_back(c);
+         int k_waiting = ++class_waiting[arg.custClass];
+         if (waiting > num_chairs || ev.arg != num_chairs - waiting
+             || k_waiting > class_chairs[arg.custClass]) {
+            out << waiting << " customers waiting for " << num_chairs << " chairs, "
+                << k_waiting << " of class " << arg.custClass;
+            *error = out.str();
+            return false;
+         }
+         break;
+      }
+      case kEventSeat: {
+         ok = (state[c] & (kSeated | kDropped)) == 0 && chair[b] == 0;
+         ok = ok && (shift[b] == kShiftOn || (state[c] & kCheckedIn));     // Retiring: appointments only
+         const ThreadArg& arg = args[c - 1];
+         bool appt_waiting = !checked_in[b].empty();
+         bool appt_due = appt_waiting && args[checked_in[b].front() - 1].appt.start_ns <= next_ns[b];
+         if (arg.apptID >= 0 && arg.appt.barbID != b && (state[c] & kWaited) == 0) {
+            ok = false;                                                    // Booked with someone else
+         }
+         if (state[c] & kCheckedIn) {
+            ok = ok && checked_in[b].front() == c;                         // Earliest appointment first
+            if (ok) {
+               checked_in[b].pop_front();
+            }
+            if (arg.appt.start_ns > ev.time_ns && shift[b] == kShiftOn) {  // Early: only if nobody he
+               for (int s = 0; s < kMaxServices; s++) {                    //   could serve waits
+                  for (int k = 0; k < kNumClasses; k++) {
+                     ok = ok && (!(skills[b] & (1u << s)) || queue[s][k].empty());
+                  }
+               }
+            }
+         }
+         else if (state[c] & kWaited) {
+            ok = ok && !appt_due;                                          // Due appointments go first
+            int k = arg.custClass;
+            deque<int>& q = queue[arg.service][k];
+            ok = ok && (skills[b] & (1u << arg.service)) && !q.empty() && q.front() == c;
+            for (int s = 0; s < kMaxServices; s++) {                       // First come, first served
+               if ((skills[b] & (1u << s)) && !queue[s][k].empty()) {
+                  ok = ok && wait_seq[queue[s][k].front()] >= wait_seq[c];
+               }
+            }
+            if (ok) {
+               q.pop_front();
+            }
+            ok = ok && !(strict && qualifiedWaiting(queue, skills[b], k)); // No higher class was waiting
+            class_waiting[k]--;
+            waiting--;
+         }
+         else {                                                            // Free chairs go to waiters first
+            ok = ok && !qualifiedWaiting(queue, skills[b], kNumClasses) && !appt_waiting;
+            ok = ok && (arg.apptID >= 0 || (skills[b] & (1u << arg.service)));
+         }
+         state[c] |= kSeated;
+         chair[b] = c;
+         break;
+      }
+      case kEventCheckIn: {
+         const ThreadArg& arg = args[c - 1];
+         ok = state[c] == kArrived && arg.apptID == ev.arg && arg.appt.barbID == b && chair[b] != 0;
+         deque<int>& q = checked_in[b];
+         deque<int>::iterator it = q.begin();
+         while (it != q.end() && args[*it - 1].appt.start_ns <= arg.appt.start_ns) {
+            ++it;
+         }
+         q.insert(it, c);
+         state[c] |= kCheckedIn;
+         break;
+      }
+      case kEventDrop: {
+         ok = (state[c] & (kSeated | kDropped)) == 0;
+         const ThreadArg& arg = args[c - 1];
+         int k = arg.custClass;
+         if (ev.arg == kDropNoSkill && (state[c] & kWaited)) {            // Their last barber retired
+            deque<int>& q = queue[arg.service][k];
+            deque<int>::iterator it = find(q.begin(), q.end(), c);
+            ok = ok && it != q.end() && skill_barbers[arg.service] == 0;
+            if (ok) {
+               q.erase(it);
+            }
+            class_waiting[k]--;
+         }
+         else if (ev.arg == kDropDisplaced) {
+            deque<int>& q = queue[arg.service][k];
+            ok = ok && (state[c] & kWaited) && !q.empty() && q.back() == c && waiting == num_chairs
+                 && !lowerClassWaiting(class_waiting, k);              // Newest of the lowest class
+            for (int s = 0; s < kMaxServices; s++) {
+               if (!queue[s][k].empty()) {
+                  ok = ok && wait_seq[queue[s][k].back()] <= wait_seq[c];
+               }
+            }
+            if (ok) {
+               q.pop_back();
+            }
+            class_waiting[k]--;
+         }
+         else if (ev.arg == kDropMissedAppointment) {
+            ok = ok && state[c] == kArrived && arg.apptID >= 0 && ev.time_ns >= arg.appt.end_ns;
+         }
+         else if (ev.arg == kDropBarberAway) {
+            ok = ok && state[c] == kArrived && arg.apptID >= 0 && shift[arg.appt.barbID] != kShiftOn
+                 && checked_in[arg.appt.barbID].empty();
+         }
+         else {                                                            // Turned away on arrival
+            ok = ok && state[c] == kArrived && !freeQualified(chair, shift, skills, arg.service);
+            if (ev.arg == kDropNoWaitingChair) {
+               ok = ok && waiting >= num_chairs                       // Full, or draining after a shrink
+                    && (waiting > num_chairs || !lowerClassWaiting(class_waiting, k));
+            }
+            else if (ev.arg == kDropClassFull) {
+               ok = ok && class_waiting[k] == class_chairs[k];
+            }
+            else if (ev.arg == kDropNoSkill) {
+               ok = ok && skill_barbers[arg.service] == 0;
+            }
+            else {
+               ok = ok && num_chairs == 0;
+            }
+         }
+         if (state[c] & kWaited) {
+            waiting--;
+         }
+         state[c] |= kDropped;
+         dropped++;
+         break;
+      }
+      case kEventRenege: {
+         const ThreadArg& arg = args[c - 1];
+         deque<int>& q = queue[arg.service][arg.custClass];
+         deque<int>::iterator it = find(q.begin(), q.end(), c);
+         ok = (state[c] & (kWaited | kSeated | kDropped | kReneged)) == kWaited && it != q.end()
+              && arg.patience_ns > 0 && ev.time_ns - wait_ns[c] >= arg.patience_ns;
+         if (ok) {
+            q.erase(it);
+         }
+         class_waiting[arg.custClass]--;
+         waiting--;
+         ok = ok && ev.arg == num_chairs - waiting;
+         state[c] |= kReneged;
+         reneged++;
+         break;
+      }
+      case kEventAwait:
+         ok = (state[c] & kSeated) && chair[b] == c;
+         break;
+      case kEventStart:
+         ok = chair[b] == c && (state[c] & (kSeated | kStarted)) == kSeated;
+         state[c] |= kStarted;
+         break;
+      case kEventDone:
+         ok = chair[b] == c && (state[c] & (kStarted | kDone)) == kStarted;
+         state[c] |= kDone;
+         break;
+      case kEventPay:
+         ok = chair[b] == c && (state[c] & (kDone | kPaid)) == kDone;
+         state[c] |= kPaid;
+         served++;
+         break;
+      case kEventLeave:
+         ok = (state[c] & kLeft) == 0 && (state[c] & (kPaid | kDropped | kReneged)) != 0;
+         state[c] |= kLeft;
+         break;
+      case kEventNext:
+         ok = chair[b] != 0 && (state[chair[b]] & kPaid);
+         chair[b] = 0;
+         next_ns[b] = ev.time_ns;
+         break;
+      case kEventSleep:
+         break;
+      case kEventHire:
+         ok = shift[b] == kShiftOff && chair[b] == 0 && checked_in[b].empty();
+         shift[b] = kShiftOn;
+         skills[b] = (uint32_t)ev.arg;
+         for (int s = 0; s < kMaxServices; s++) {
+            skill_barbers[s] += (skills[b] >> s) & 1;
+         }
+         break;
+      case kEventRetire:
+         ok = shift[b] == kShiftOn;
+         shift[b] = kShiftRetiring;
+         for (int s = 0; s < kMaxServices; s++) {
+            skill_barbers[s] -= (skills[b] >> s) & 1;
+         }
+         break;
+      case kEventResize:
+         ok = c == 0 && b == -1 && ev.arg >= 0;
+         num_chairs = ev.arg;
+         break;
+      case kEventOffShift:
+         ok = shift[b] == kShiftRetiring && chair[b] == 0 && checked_in[b].empty();
+         shift[b] = kShiftOff;
+         break;
+      default:
+         ok = false;
+         break;
+      }
+      if (!ok) {
+         out << "transition out of order (customer state " << state[c] << ")";
+         *error = out.str();
+         return false;
+      }
+   }
+
+   for (int c = 1; c <= num_customers; c++) {
+      bool was_served = (state[c] & kPaid) != 0;
+      if (!(state[c] & kLeft) || was_served != (args[c - 1].result != -1)) {
+         out.str("");
+         out << "customer[" << c << "] ended in state " << state[c]
+             << " but visitShop returned " << args[c - 1].result;
+         *error = out.str();
+         return false;
+      }
+   }
+   if (served + dropped + reneged != num_customers || dropped != reported_drops
+       || reneged != reported_reneged || waiting != 0) {
+      out.str("");
+      out << "served " << served << " + dropped " << dropped << " + reneged " << reneged
+          << " != " << num_customers << " customers (get_cust_drops() = " << reported_drops
+          << ", get_reneged() = " << reported_reneged << ", still waiting " << waiting << ")";
+      *error = out.str();
+      return false;
+   }
+   return true;
+}
+
+// --------------------------- int runRound<ShopT>(...)
+// Runs one round against a ShopT (any BasicShop) and checks its event log
+//
+// pre: attr is initialized; a fixed-size ShopT matches num_barbers and num_chairs
+// param: label          Name of the shop type, for the output
+// param: round          Round number, for the output
+// param: num_barbers    Barbers in the round
+// param: num_chairs     Waiting chairs in the round
+// param: num_customers  Customers in the round
+// param: max_delay_us   Upper bound of injected delays
+// param: max_patience_us Upper bound of customer patience, 0 for none
+// param: book           Appointment customers book a slot
+// param: num_services   Services customers ask for; barbers get random skills
+// param: round_seed     Seed the threads derive theirs from
+// param: weighted       Use weighted instead of strict priority
+// param: scale          Hire and retire barbers during the round, up to
+//   twice num_barbers
+// param: resize         Resize the waiting room during the round
+// param: watch          Count transitions in ShopMetrics and check them
+// param: batch          Admit walk-ins and VIPs in groups of batch, 0 for none
+// param: fronts         Front end threads driving walk-ins and VIPs, 0 for none
+// param: attr           Attributes for every thread
+// return: 0 if the invariants hold, 1 on a violation, -1 on a setup error
+//
+template <typename ShopT>
+static int runRound(const char* label, int round, int num_barbers, int num_chairs,
+                    int num_customers, int max_delay_us, int max_patience_us, bool book,
+                    int num_services, unsigned round_seed, bool weighted, bool scale, bool resize,
+                    bool watch, int batch, int fronts, pthread_attr_t* attr)
+{
+   int max_barbers = scale ? 2 * num_barbers : num_barbers;
+   uint64_t open_ns = nowNanos();
+   ShopT shop(num_barbers, num_chairs, max_barbers);
+   shop.set_print(false);
+   EventLog log;
+   uint32_t segments = (uint32_t)((uint64_t)num_customers * 10 / kEventSegmentEvents)
+                     + 2 * max_barbers + num_customers + 1;
+   if (!log.open("", segments)) {
+      cout << "Could not map event log: " << strerror(errno) << endl;
+      return -1;
+   }
+   shop.set_event_log(&log);
+   ShopMetrics metrics;
+   if (watch) {
+      shop.set_metrics(&metrics);
+   }
+
+   int class_chairs[kNumClasses] = { INT_MAX, INT_MAX, num_chairs - num_chairs / 4 };
+   shop.set_class_chairs(kClassWalkIn, class_chairs[kClassWalkIn]);
+   if (weighted) {
+      shop.set_class_weight(kClassVip, 3);
+      shop.set_class_weight(kClassAppointment, 2);
+      shop.set_class_weight(kClassWalkIn, 1);
+   }
+
+   vector<uint32_t> skills(max_barbers, 1);
+   unsigned skill_seed = round_seed * 13;
+   for (int b = 0; num_services > 1 && b < num_barbers; b++) {             // Own skill plus a third of the others
+      skills[b] = 1u << (b % num_services);
+      for (int s = 0; s < num_services; s++) {
+         if (rand_r(&skill_seed) % 3 == 0) {
+            skills[b] |= 1u << s;
+         }
+      }
+      shop.set_barber_skills(b, skills[b]);
+   }
+
+   StressParam param(&shop, max_delay_us, round_seed);
+   vector<ThreadArg> barber_args(num_barbers);
+   vector<ThreadArg> customer_args(num_customers);
+   vector<pthread_t> barbers(num_barbers);
+   vector<pthread_t> customers(num_customers);
+
+   for (int i = 0; i < num_barbers; i++) {
+      barber_args[i].param = &param;
+      barber_args[i].id = i;
+      pthread_create(&barbers[i], attr, barber<ShopT>, &barber_args[i]);
+   }
+   int num_created = 0;
+   unsigned class_seed = round_seed * 31;
+   vector<BatchArg<ShopT>*> batches;
+   vector<FrontArg> front_args(fronts);
+   for (int i = 0; i < num_customers; i++) {
+      int r = rand_r(&class_seed) % 10;                                    // 10% VIPs, 20% appointments
+      customer_args[i].param = &param;
+      customer_args[i].batch = NULL;
+      customer_args[i].async = false;
+      customer_args[i].id = i + 1;
+      customer_args[i].custClass = (r == 0) ? kClassVip : (r < 3) ? kClassAppointment : kClassWalkIn;
+      customer_args[i].service = (num_services > 1) ? rand_r(&class_seed) % num_services : 0;
+      customer_args[i].patience_ns = 0;
+      customer_args[i].apptID = -1;
+      if (max_patience_us > 0 && rand_r(&class_seed) % 2 == 0) {           // Half of them are impatient
+         customer_args[i].patience_ns = (uint64_t)(1 + rand_r(&class_seed) % max_patience_us) * 1000;
+      }
+      if (batch > 0 && customer_args[i].custClass != kClassAppointment) {  // Join the open group or start one
+         if (batches.empty() || (int)batches.back()->ids.size() == batch) {
+            batches.push_back(new BatchArg<ShopT>());
+            batches.back()->visits = new typename ShopT::WaitTicket[batch];
+            batches.back()->admitted = false;
+         }
+         BatchArg<ShopT>* group = batches.back();
+         customer_args[i].batch = group;
+         customer_args[i].batch_index = (int)group->ids.size();
+         group->ids.push_back(customer_args[i].id);
+         group->classes.push_back(customer_args[i].custClass);
+         group->services.push_back(customer_args[i].service);
+         group->patience_ns.push_back(customer_args[i].patience_ns);
+         group->results.push_back(-2);
+         group->visit_ptrs.push_back(&group->visits[customer_args[i].batch_index]);
+      }
+      customer_args[i].result = -2;
+      if (fronts > 0 && customer_args[i].custClass != kClassAppointment) { // No patience without a thread
+         customer_args[i].async = true;
+         customer_args[i].patience_ns = 0;
+         unsigned seed = round_seed * 104729 + customer_args[i].id;
+         customer_args[i].delay_us = delayUs(&seed, max_delay_us * 50);    // As a customer thread would
+         front_args[i % fronts].customers.push_back(&customer_args[i]);
+         num_created++;
+         continue;
+      }
+      if (pthread_create(&customers[i], attr, customer<ShopT>, &customer_args[i]) != 0) {
+         break;
+      }
+      num_created++;
+   }
+   vector<pthread_t> front_threads;
+   for (int f = 0; f < fronts && num_created == num_customers; f++) {
+      front_args[f].param = &param;
+      sort(front_args[f].customers.begin(), front_args[f].customers.end(), arrivesBefore);
+      pthread_t thread;
+      if (pthread_create(&thread, attr, frontEnd<ShopT>, &front_args[f]) != 0) {
+         break;
+      }
+      front_threads.push_back(thread);
+   }
+   ScaleArg scale_arg;
+   scale_arg.param = &param;
+   scale_arg.hire = scale;
+   scale_arg.resize = resize;
+   scale_arg.max_barbers = max_barbers;
+   scale_arg.max_chairs = 2 * max(num_chairs, 4);
+   scale_arg.num_services = num_services;
+   scale_arg.stop = false;
+   scale_arg.attr = attr;
+   scale_arg.barber_args.assign(max_barbers, barber_args[0]);
+   scale_arg.hired = 0;
+   scale_arg.retired = 0;
+   scale_arg.resized = 0;
+   pthread_t scale_thread;
+   bool scaling = scale || resize;
+   if (scaling && pthread_create(&scale_thread, attr, scaler<ShopT>, &scale_arg) != 0) {
+      scaling = false;
+   }
+
+   WatchArg watch_arg;
+   watch_arg.param = &param;
+   watch_arg.metrics = &metrics;
+   watch_arg.max_barbers = max_barbers;
+   watch_arg.stop = false;
+   watch_arg.snapshots = 0;
+   watch_arg.exact = 0;
+   pthread_t watch_thread;
+   if (watch && pthread_create(&watch_thread, attr, watchMetrics, &watch_arg) != 0) {
+      watch = false;
+   }
+
+   pthread_mutex_lock(&param.mutex);                                       // Release every customer at once
+   param.start_ns = nowNanos();
+   unsigned book_seed = round_seed * 17;
+   uint64_t slot_ns = (uint64_t)(max_delay_us + 1) * 2000;                 // About two haircuts
+   for (int i = 0, k = 0; book && i < num_created; i++) {                  // Book back to back slots,
+      ThreadArg& arg = customer_args[i];                                   //   some of them overlapping
+      if (arg.custClass != kClassAppointment) {
+         continue;
+      }
+      int barbID = k % num_barbers;
+      uint64_t start_ns = param.start_ns + (k++ / num_barbers) * slot_ns + rand_r(&book_seed) % (slot_ns / 2);
+      arg.apptID = shop.bookAppointment(barbID, start_ns, start_ns + slot_ns);
+      if (arg.apptID >= 0) {                                               // Else they walk in
+         arg.appt.barbID = barbID;
+         arg.appt.start_ns = start_ns;
+         arg.appt.end_ns = start_ns + slot_ns;
+         arg.arrive_ns = start_ns - slot_ns / 2 + rand_r(&book_seed) % (slot_ns * 3 / 2 + 1);
+      }
+   }
+   param.start = true;
+   pthread_cond_broadcast(&param.cond_start);
+   pthread_mutex_unlock(&param.mutex);
+
+   for (int i = 0; i < num_created; i++) {
+      if (!customer_args[i].async) {
+         pthread_join(customers[i], NULL);
+      }
+   }
+   for (size_t f = 0; f < front_threads.size(); f++) {
+      pthread_join(front_threads[f], NULL);
+   }
+   if (scaling) {
+      pthread_mutex_lock(&param.mutex);
+      scale_arg.stop = true;
+      pthread_mutex_unlock(&param.mutex);
+      pthread_join(scale_thread, NULL);
+   }
+   shop.closeShop();
+   for (int i = 0; i < num_barbers; i++) {
+      pthread_join(barbers[i], NULL);
+   }
+   for (size_t i = 0; i < scale_arg.barbers.size(); i++) {
+      pthread_join(scale_arg.barbers[i], NULL);
+   }
+   if (watch) {
+      pthread_mutex_lock(&param.mutex);
+      watch_arg.stop = true;
+      pthread_mutex_unlock(&param.mutex);
+      pthread_join(watch_thread, NULL);
+   }
+
+   for (size_t g = 0; g < batches.size(); g++) {
+      delete []batches[g]->visits;
+      delete batches[g];
+   }
+   if (num_created < num_customers || (int)front_threads.size() < fronts) {
+      cout << "round " << round << ": could only create " << num_created << " customers and "
+           << front_threads.size() << " front ends" << endl;
+      return 1;
+   }
+
+   string error;
+   for (int f = 0; f < fronts && error.empty(); f++) {
+      error = front_args[f].error;
+   }
+   bool ok = error.empty() && checkLog(log, max_barbers, num_barbers, num_chairs, skills, class_chairs, !weighted, customer_args,
+                      shop.get_cust_drops(), shop.get_reneged(), &error);
+   uint64_t serving_ns = 0;
+   uint64_t open_for_ns = nowNanos() - open_ns;
+   for (int b = 0; ok && b < max_barbers; b++) {                           // Every barber has left
+      BarberTime time;
+      shop.get_barber_time(b, &time);
+      serving_ns += time.serving_ns;
+      if (time.activity != kActivityAway || time.sleeping_ns + time.serving_ns + time.checkout_ns > open_for_ns) {
+         stringstream out;
+         out << "barber[" << b + 1 << "] time: activity = " << time.activity << ", sleeping = "
+             << time.sleeping_ns << " ns, serving = " << time.serving_ns << " ns, checkout = "
+             << time.checkout_ns << " ns, shop open " << open_for_ns << " ns";
+         error = out.str();
+         ok = false;
+      }
+   }
+   bool any_served = false;
+   for (int i = 0; i < num_customers; i++) {
+      any_served = any_served || customer_args[i].result != -1;
+   }
+   if (ok && (shop.get_sleeping_barbers() != 0 || (serving_ns > 0) != any_served)) {
+      error = "barbers still asleep, or serving time does not match the customers served";
+      ok = false;
+   }
+   if (ok && watch) {                                                      // Every thread is gone: exact totals
+      MetricsSnapshot snap;
+      metrics.snapshot(&snap);
+      uint64_t served = 0;
+      for (int i = 0; i < num_customers; i++) {
+         served += (customer_args[i].result != -1);
+      }
+      uint64_t hist[kWaitBuckets];
+      shop.get_wait_histogram(hist);
+      bool same_waits = true;
+      for (int b = 0; b < kWaitBuckets; b++) {
+         same_waits = same_waits && snap.wait_buckets[b] == hist[b];
+      }
+      stringstream out;
+      if (!watch_arg.error.empty()) {
+         out << "metrics: " << watch_arg.error;
+      }
+      else if (snap.arrivals != (uint64_t)num_customers || snap.served != served || snap.seated != served
+               || snap.dropped != (uint64_t)shop.get_cust_drops() || snap.reneged != (uint64_t)shop.get_reneged()
+               || snap.waiting != 0 || snap.busy != 0 || snap.sleeping != 0
+               || snap.working != shop.get_working_barbers() || !same_waits) {
+         out << "metrics after the round: arrivals = " << snap.arrivals << ", seated = " << snap.seated
+             << ", served = " << snap.served << " (" << served << "), dropped = " << snap.dropped
+             << ", reneged = " << snap.reneged << ", waiting = " << snap.waiting << ", busy = " << snap.busy
+             << ", sleeping = " << snap.sleeping << ", working = " << snap.working
+             << (same_waits ? "" : ", wait histogram differs from the shop's");
+      }
+      error = out.str();
+      ok = error.empty();
+   }
+   cout << "round " << round << ": sync = " << label << ", barbers = " << num_barbers
+        << ", chairs = " << num_chairs << ", customers = " << num_customers << ", dropped = " << shop.get_cust_drops()
+        << ", reneged = " << shop.get_reneged();
+   if (scale) {
+      cout << ", hired = " << scale_arg.hired << ", retired = " << scale_arg.retired;
+   }
+   if (resize) {
+      cout << ", resized = " << scale_arg.resized;
+   }
+   if (watch) {
+      cout << ", snapshots = " << watch_arg.snapshots << " (" << watch_arg.exact << " exact)";
+   }
+   if (batch > 0) {
+      cout << ", batches = " << batches.size();
+   }
+   if (fronts > 0) {
+      cout << ", front ends = " << fronts;
+   }
+   cout
+        << ", events = " << log.get_events_logged() << (ok ? " OK" : " FAILED") << endl;
+   if (!ok) {
+      cout << "  " << error << endl;
+      return 1;
+   }
+   return 0;
+}
+
+// --------------------------- int runStealRound(int, int, int, int, int, unsigned, pthread_attr_t*)
+// Runs one round against a StealingShop and checks who served whom
+//
+// pre: num_barbers > 0, num_chairs >= 0, num_customers > 0
+// param: round          Round number, for the report
+// param: num_barbers    Barber threads
+// param: num_chairs     Waiting chairs
+// param: num_customers  Customer threads, one visit each
+// param: max_delay_us   Longest injected delay
+// param: round_seed     Seed of the round's random choices
+// param: attr           Attributes for every thread
+// return: 0 if the invariants hold, 1 on a violation
+//
+static int runStealRound(int round, int num_barbers, int num_chairs, int num_customers, int max_delay_us,
+                         unsigned round_seed, pthread_attr_t* attr)
+{
+   StealingShop shop(num_barbers, num_chairs);
+   StressParam param(&shop, max_delay_us, round_seed);
+   vector<StealArg> barber_args(num_barbers);
+   vector<StealArg> customer_args(num_customers);
+   vector<pthread_t> barbers(num_barbers);
+   vector<pthread_t> customers(num_customers);
+
+   for (int i = 0; i < num_barbers; i++) {
+      barber_args[i].param = &param;
+      barber_args[i].id = i;
+      pthread_create(&barbers[i], attr, stealBarber, &barber_args[i]);
+   }
+   int num_created = 0;
+   for (int i = 0; i < num_customers; i++) {
+      customer_args[i].param = &param;
+      customer_args[i].id = i + 1;
+      customer_args[i].result = -2;
+      if (pthread_create(&customers[i], attr, stealCustomer, &customer_args[i]) != 0) {
+         break;
+      }
+      num_created++;
+   }
+   pthread_mutex_lock(&param.mutex);
+   param.start_ns = nowNanos();
+   param.start = true;
+   pthread_cond_broadcast(&param.cond_start);
+   pthread_mutex_unlock(&param.mutex);
+
+   for (int i = 0; i < num_created; i++) {
+      pthread_join(customers[i], NULL);
+   }
+   shop.closeShop();
+   for (int i = 0; i < num_barbers; i++) {
+      pthread_join(barbers[i], NULL);
+   }
+   if (num_created < num_customers) {
+      cout << "round " << round << ": could only create " << num_created << " customers" << endl;
+      return 1;
+   }
+
+   stringstream error;
+   vector<int> served_by(num_customers + 1, -1);
+   for (int b = 0; b < num_barbers && error.str().empty(); b++) {
+      for (size_t k = 0; k < barber_args[b].served.size(); k++) {
+         int custID = barber_args[b].served[k];
+         if (custID < 1 || custID > num_customers || served_by[custID] != -1) {
+            error << "barber[" << b + 1 << "] called in customer[" << custID << "], who is unknown or was"
+                  << " already called in";
+            break;
+         }
+         served_by[custID] = b;
+      }
+   }
+   int served = 0;
+   int dropped = 0;
+   for (int i = 0; i < num_customers && error.str().empty(); i++) {
+      int custID = customer_args[i].id;
+      if (customer_args[i].result != served_by[custID]) {
+         error << "customer[" << custID << "] was told barber[" << customer_args[i].result + 1
+               << "] but was called in by barber[" << served_by[custID] + 1 << "]";
+      }
+      served += (customer_args[i].result != -1);
+      dropped += (customer_args[i].result == -1);
+   }
+   uint64_t hist[kWaitBuckets];
+   shop.get_wait_histogram(hist);
+   uint64_t waits = 0;
+   for (int b = 0; b < kWaitBuckets; b++) {
+      waits += hist[b];
+   }
+   if (error.str().empty() && (dropped != shop.get_cust_drops() || waits != (uint64_t)served
+                               || shop.get_steals() > served)) {
+      error << "dropped = " << dropped << " (shop: " << shop.get_cust_drops() << "), served = " << served
+            << " (waits recorded: " << waits << ", steals: " << shop.get_steals() << ")";
+   }
+   bool ok = error.str().empty();
+   cout << "round " << round << ": shop = steal, barbers = " << num_barbers << ", chairs = " << num_chairs
+        << ", customers = " << num_customers << ", dropped = " << dropped << ", steals = " << shop.get_steals()
+        << (ok ? " OK" : " FAILED") << endl;
+   if (!ok) {
+      cout << "  " << error.str() << endl;
+      return 1;
+   }
+   return 0;
+}
+
+static const struct option kLongOptions[] = {
+   { "rounds",    required_argument, NULL, 'r' },
+   { "barbers",   required_argument, NULL, 'b' },
+   { "chairs",    required_argument, NULL, 'c' },
+   { "customers", required_argument, NULL, 'n' },
+   { "delay-us",  required_argument, NULL, 'd' },
+   { "seed",      required_argument, NULL, 's' },
+   { "sync",      required_argument, NULL, 'y' },
+   { "fixed",     no_argument,       NULL, 'f' },
+   { "weighted",  no_argument,       NULL, 'w' },
+   { "patience-us", required_argument, NULL, 'p' },
+   { "book",      no_argument,       NULL, 'k' },
+   { "skills",    required_argument, NULL, 'K' },
+   { "scale",     no_argument,       NULL, 'a' },
+   { "resize",    no_argument,       NULL, 'z' },
+   { "metrics",   no_argument,       NULL, 'm' },
+   { "steal",     no_argument,       NULL, 'S' },
+   { "batch",     required_argument, NULL, 'B' },
+   { "async",     required_argument, NULL, 'A' },
+   { NULL, 0, NULL, 0 }
+};
+
+static void usage()
+{
+   cout << "Usage: shopstress [options]" << endl;
+   cout << "  --rounds N      rounds to run (default 10)" << endl;
+   cout << "  --barbers N     barbers per round (default random 1..64)" << endl;
+   cout << "  --chairs N      waiting chairs per round (default random 0..32)" << endl;
+   cout << "  --customers N   customers per round (default 2000)" << endl;
+   cout << "  --delay-us N    longest injected delay (default 200)" << endl;
+   cout << "  --seed N        random seed (default time based, printed)" << endl;
+   cout << "  --sync NAME     synchronization policy: pthread (default), std, spin," << endl;
+   cout << "                  ticket or futex" << endl;
+   cout << "  --fixed         use the compile-time sized FixedShop of this build" << endl;
+   cout << "                  (" << SHOP_FIXED_BARBERS << " barbers, " << SHOP_FIXED_CHAIRS
+        << " chairs; overrides the other shop options)" << endl;
+   cout << "  --weighted      weighted (3:2:1) instead of strict class priority" << endl;
+   cout << "  --patience-us N half of the customers renege after up to N us (default 0)" << endl;
+   cout << "  --book          appointment customers book a slot with a barber" << endl;
+   cout << "  --skills N      customers ask for one of N services (default 1)" << endl;
+   cout << "  --scale         hire and retire barbers at random during each round" << endl;
+   cout << "  --resize        resize the waiting room at random during each round" << endl;
+   cout << "  --metrics       count transitions in ShopMetrics and check its snapshots" << endl;
+   cout << "  --batch N       walk-ins and VIPs arrive in groups of N, admitted at once" << endl;
+   cout << "  --async N       walk-ins and VIPs are driven by N threads with tryVisitShop()" << endl;
+   cout << "                  (not with --batch; they have no patience)" << endl;
+   cout << "  --steal         use StealingShop (per-barber queues; only the shop options" << endl;
+   cout << "                  --barbers and --chairs apply)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+   int rounds = 10;
+   int fixed_barbers = -1;
+   int fixed_chairs = -1;
+   int num_customers = 2000;
+   int max_delay_us = 200;
+   int max_patience_us = 0;
+   unsigned seed = (unsigned)time(NULL);
+   int sync = kSyncPthread;
+   bool fixed = false;
+   bool weighted = false;
+   bool book = false;
+   int num_services = 1;
+   bool scale = false;
+   bool resize = false;
+   bool watch = false;
+   bool steal = false;
+   int batch = 0;
+   int fronts = 0;
+
+   int opt;
+   while ((opt = getopt_long(argc, argv, "", kLongOptions, NULL)) != -1) {
+      switch (opt) {
+      case 'r': rounds = atoi(optarg);                  break;
+      case 'b': fixed_barbers = atoi(optarg);           break;
+      case 'c': fixed_chairs = atoi(optarg);            break;
+      case 'n': num_customers = atoi(optarg);           break;
+      case 'd': max_delay_us = atoi(optarg);            break;
+      case 's': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'y': sync = syncKind(optarg);                break;
+      case 'f': fixed = true;                           break;
+      case 'w': weighted = true;                        break;
+      case 'p': max_patience_us = atoi(optarg);         break;
+      case 'k': book = true;                            break;
+      case 'K': num_services = atoi(optarg);            break;
+      case 'a': scale = true;                           break;
+      case 'z': resize = true;                          break;
+      case 'm': watch = true;                           break;
+      case 'S': steal = true;                           break;
+      case 'B': batch = atoi(optarg);                   break;
+      case 'A': fronts = atoi(optarg);                  break;
+      default:
+         usage();
+         return -1;
+      }
+   }
+   if (optind != argc || sync < 0 || rounds < 1 || fixed_barbers == 0 || num_customers < 1 || max_delay_us < 0
+       || max_patience_us < 0 || batch < 0 || fronts < 0 || (batch > 0 && fronts > 0) || num_services < 1 || num_services > kMaxServices) {
+      usage();
+      return -1;
+   }
+   if (fixed) {
+      fixed_barbers = SHOP_FIXED_BARBERS;
+      fixed_chairs = SHOP_FIXED_CHAIRS;
+   }
+   cout << "# seed = " << seed << endl;
+
+   pthread_attr_t attr;
+   initThreadAttr(&attr, kDefaultStackKB, kDefaultGuardKB);
+
+   for (int round = 1; round <= rounds; round++) {
+      unsigned round_seed = seed + round;
+      int num_barbers = (fixed_barbers > 0) ? fixed_barbers : 1 + rand_r(&round_seed) % 64;
+      int num_chairs = (fixed_chairs >= 0) ? fixed_chairs : rand_r(&round_seed) % 33;
+
+      int result;
+      if (steal) {
+         result = runStealRound(round, num_barbers, num_chairs, num_customers, max_delay_us, round_seed, &attr);
+      }
+      else if (fixed) {
+         result = runRound<FixedShop<SHOP_FIXED_BARBERS, SHOP_FIXED_CHAIRS> >(
+            "fixed", round, num_barbers, num_chairs, num_customers, max_delay_us, max_patience_us, book, num_services,
+            round_seed, weighted, scale, resize, watch, batch, fronts, &attr);
+      }
+      else if (sync == kSyncStd) {
+         result = runRound<BasicShop<StdSync> >(
+            "std", round, num_barbers, num_chairs, num_customers, max_delay_us, max_patience_us, book, num_services,
+            round_seed, weighted, scale, resize, watch, batch, fronts, &attr);
+      }
+      else if (sync == kSyncSpin) {
+         result = runRound<BasicShop<SpinSync> >(
+            "spin", round, num_barbers, num_chairs, num_customers, max_delay_us, max_patience_us, book, num_services,
+            round_seed, weighted, scale, resize, watch, batch, fronts, &attr);
+      }
+      else if (sync == kSyncTicket) {
+         result = runRound<BasicShop<TicketSync> >(
+            "ticket", round, num_barbers, num_chairs, num_customers, max_delay_us, max_patience_us, book, num_services,
+            round_seed, weighted, scale, resize, watch, batch, fronts, &attr);
+      }
+      else if (sync == kSyncFutex) {
+         result = runRound<BasicShop<FutexSync> >(
+            "futex", round, num_barbers, num_chairs, num_customers, max_delay_us, max_patience_us, book, num_services,
+            round_seed, weighted, scale, resize, watch, batch, fronts, &attr);
+      }
+      else {
+         result = runRound<BasicShop<PthreadSync> >(
+            "pthread", round, num_barbers, num_chairs, num_customers, max_delay_us, max_patience_us, book, num_services,
+            round_seed, weighted, scale, resize, watch, batch, fronts, &attr);
+      }
+      if (result != 0) {
+         return result;
+      }
+   }
+
+   pthread_attr_destroy(&attr);
+   return 0;
+}
+
+template <typename ShopT>
+void* barber(void* arg)
+{
+   ThreadArg* barber_arg = (ThreadArg*)arg;
+   StressParam& param = *barber_arg->param;
+   ShopT& shop = *(ShopT*)param.shop;
+   int barbID = barber_arg->id;
+   unsigned seed = param.seed * 7919 + barbID;
+
+   while (shop.helloCustomer(barbID) != 0) {                               // Wait for a customer
+      usleep(delayUs(&seed, param.max_delay_us));                          // Random haircut length
+      shop.byeCustomer(barbID);                                            // Receive payment & signal new customer
+   }
+   return nullptr;
+}
+
+template <typename ShopT>
+void* customer(void* arg)
+{
+   ThreadArg* customer_arg = (ThreadArg*)arg;
+   StressParam& param = *customer_arg->param;
+   ShopT& shop = *(ShopT*)param.shop;
+   int id = customer_arg->id;
+   unsigned seed = param.seed * 104729 + id;
+
+   pthread_mutex_lock(&param.mutex);
+   while (!param.start) {
+      pthread_cond_wait(&param.cond_start, &param.mutex);
+   }
+   pthread_mutex_unlock(&param.mutex);
+
+   int barbID;
+   if (customer_arg->apptID >= 0) {                                        // Come around the booked slot
+      uint64_t now = nowNanos();
+      if (customer_arg->arrive_ns > now) {
+         usleep((customer_arg->arrive_ns - now) / 1000);
+      }
+      barbID = shop.visitAppointment(id, customer_arg->apptID);
+   }
+   else if (customer_arg->batch != NULL) {                                 // Arrive with the group
+      BatchArg<ShopT>& group = *(BatchArg<ShopT>*)customer_arg->batch;
+      int k = customer_arg->batch_index;
+      if (k == 0) {
+         int delay = delayUs(&seed, param.max_delay_us * 50);
+         if (delay > 0) {
+            usleep(delay);
+         }
+         shop.visitShopBatch(&group.ids[0], (int)group.ids.size(), &group.results[0], &group.visit_ptrs[0],
+                             &group.classes[0], &group.services[0], &group.patience_ns[0]);
+         pthread_mutex_lock(&param.mutex);
+         group.admitted = true;
+         pthread_cond_broadcast(&param.cond_start);
+         pthread_mutex_unlock(&param.mutex);
+      }
+      pthread_mutex_lock(&param.mutex);
+      while (!group.admitted) {
+         pthread_cond_wait(&param.cond_start, &param.mutex);
+      }
+      pthread_mutex_unlock(&param.mutex);
+      barbID = group.results[k];
+      if (barbID == kVisitQueued) {
+         barbID = shop.awaitVisit(&group.visits[k]);
+      }
+   }
+   else {
+      int delay = delayUs(&seed, param.max_delay_us * 50);                 // Spread arrivals out
+      if (delay > 0) {
+         usleep(delay);
+      }
+      barbID = shop.visitShop(id, customer_arg->custClass, customer_arg->service, customer_arg->patience_ns);
+   }
+   if (barbID != -1) {
+      shop.leaveShop(id, barbID);
+   }
+   customer_arg->result = barbID;
+   return nullptr;
+}
+
+void* watchMetrics(void* arg)
+{
+   WatchArg* watch_arg = (WatchArg*)arg;
+   StressParam& param = *watch_arg->param;
+   MetricsSnapshot last = MetricsSnapshot();
+
+   pthread_mutex_lock(&param.mutex);
+   while (!watch_arg->stop && watch_arg->error.empty()) {
+      pthread_mutex_unlock(&param.mutex);
+      MetricsSnapshot snap;
+      watch_arg->metrics->snapshot(&snap);
+      stringstream out;
+      if (snap.waiting < 0 || snap.busy < 0 || snap.sleeping < 0) {
+         out << "gauge below zero";
+      }
+      else if (snap.exact && (snap.busy > watch_arg->max_barbers || snap.sleeping > watch_arg->max_barbers)) {
+         out << "more barbers busy or asleep than the shop has";
+      }
+      else if (snap.arrivals < snap.seated + snap.dropped + snap.reneged + snap.waiting
+               || snap.seated < snap.served) {
+         out << "later stage counted without the earlier one";
+      }
+      else if (snap.arrivals < last.arrivals || snap.waited < last.waited || snap.seated < last.seated
+               || snap.served < last.served || snap.dropped < last.dropped || snap.reneged < last.reneged) {
+         out << "counter went backwards";
+      }
+      if (!out.str().empty()) {
+         out << ": arrivals = " << snap.arrivals << ", waited = " << snap.waited << ", seated = " << snap.seated
+             << ", served = " << snap.served << ", dropped = " << snap.dropped << ", reneged = " << snap.reneged
+             << ", waiting = " << snap.waiting << ", busy = " << snap.busy << ", sleeping = " << snap.sleeping;
+      }
+      last = snap;
+      pthread_mutex_lock(&param.mutex);
+      watch_arg->snapshots++;
+      watch_arg->exact += snap.exact;
+      watch_arg->error = out.str();
+   }
+   pthread_mutex_unlock(&param.mutex);
+   return nullptr;
+}
+
+template <typename ShopT>
+void* scaler(void* arg)
+{
+   ScaleArg* scale_arg = (ScaleArg*)arg;
+   StressParam& param = *scale_arg->param;
+   ShopT& shop = *(ShopT*)param.shop;
+   unsigned seed = param.seed * 6151;
+
+   pthread_mutex_lock(&param.mutex);
+   while (!scale_arg->stop) {
+      pthread_mutex_unlock(&param.mutex);
+      usleep(delayUs(&seed, param.max_delay_us * 10));
+      int action = rand_r(&seed) % (scale_arg->resize ? 3 : 2);
+      if (!scale_arg->hire || action == 2) {                               // Resize, maybe below the waiters
+         if (shop.resizeWaitingRoom(rand_r(&seed) % (scale_arg->max_chairs + 1))) {
+            scale_arg->resized++;
+         }
+      }
+      else if (action == 0) {                                              // Hire someone with random skills
+         uint32_t skills = 1u << (rand_r(&seed) % scale_arg->num_services);
+         for (int s = 0; s < scale_arg->num_services; s++) {
+            if (rand_r(&seed) % 3 == 0) {
+               skills |= 1u << s;
+            }
+         }
+         int barbID = shop.addBarber(skills);
+         pthread_t thread;
+         if (barbID != -1) {                                               // A retired barber's thread is done with
+            scale_arg->barber_args[barbID].id = barbID;                    //   his ThreadArg before the ID comes back
+            pthread_create(&thread, scale_arg->attr, barber<ShopT>, &scale_arg->barber_args[barbID]);
+            scale_arg->barbers.push_back(thread);
+            scale_arg->hired++;
+         }
+      }
+      else if (shop.get_working_barbers() > 1                              // Keep someone working
+               && shop.retireBarber(rand_r(&seed) % scale_arg->max_barbers)) {
+         scale_arg->retired++;
+      }
+      pthread_mutex_lock(&param.mutex);
+   }
+   pthread_mutex_unlock(&param.mutex);
+   return nullptr;
+}
+
+void* stealBarber(void* arg)
+{
+   StealArg* barber_arg = (StealArg*)arg;
+   StressParam& param = *barber_arg->param;
+   StealingShop& shop = *(StealingShop*)param.shop;
+   unsigned seed = param.seed * 7919 + barber_arg->id;
+
+   int custID;
+   while ((custID = shop.helloCustomer(barber_arg->id)) != 0) {
+      barber_arg->served.push_back(custID);
+      usleep(delayUs(&seed, param.max_delay_us));
+      shop.byeCustomer(barber_arg->id);
+   }
+   return nullptr;
+}
+
+void* stealCustomer(void* arg)
+{
+   StealArg* customer_arg = (StealArg*)arg;
+   StressParam& param = *customer_arg->param;
+   StealingShop& shop = *(StealingShop*)param.shop;
+   int id = customer_arg->id;
+   unsigned seed = param.seed * 104729 + id;
+
+   pthread_mutex_lock(&param.mutex);
+   while (!param.start) {
+      pthread_cond_wait(&param.cond_start, &param.mutex);
+   }
+   pthread_mutex_unlock(&param.mutex);
+
+   int delay = delayUs(&seed, param.max_delay_us * 50);
+   if (delay > 0) {
+      usleep(delay);
+   }
+   int barbID = shop.visitShop(id);
+   if (barbID != -1) {
+      shop.leaveShop(id, barbID);
+   }
+   customer_arg->result = barbID;
+   return nullptr;
+}
+
+template <typename ShopT>
+void* frontEnd(void* arg)
+{
+   FrontArg& front = *(FrontArg*)arg;
+   StressParam& param = *front.param;
+   ShopT& shop = *(ShopT*)param.shop;
+   size_t n = front.customers.size();
+   CompletionQueue completions(2 * n + 1);                                 // Never full
+   typename ShopT::WaitTicket* visits = new typename ShopT::WaitTicket[n];
+   vector<int> seated(n, -2);                                              // Per visit: barber, kVisitQueued or -2
+   map<int, size_t> index;                                                 // custID -> visit
+   for (size_t k = 0; k < n; k++) {
+      index[front.customers[k]->id] = k;
+   }
+
+   pthread_mutex_lock(&param.mutex);
+   while (!param.start) {
+      pthread_cond_wait(&param.cond_start, &param.mutex);
+   }
+   pthread_mutex_unlock(&param.mutex);
+
+   size_t next = 0;
+   size_t open = 0;                                                        // Visits without Done or Dropped
+   while (next < n || open > 0) {
+      ShopCompletion done;
+      if (next < n && nowNanos() >= param.start_ns + (uint64_t)front.customers[next]->delay_us * 1000) {
+         ThreadArg& customer = *front.customers[next];
+         seated[next] = shop.tryVisitShop(customer.id, &visits[next], &completions, customer.custClass,
+                                          customer.service);
+         if (seated[next] == -1) {
+            customer.result = -1;
+         }
+         else {
+            open++;
+         }
+         next++;
+      }
+      else if (completions.tryPop(&done)) {
+         map<int, size_t>::iterator it = index.find(done.custID);
+         size_t k = (it != index.end()) ? it->second : n;
+         bool ok = k < n && (seated[k] >= 0 || seated[k] == kVisitQueued);
+         if (ok && done.kind == kVisitSeated) {
+            ok = seated[k] == kVisitQueued && done.barbID >= 0;
+            seated[k] = done.barbID;
+         }
+         else if (ok && done.kind == kVisitDone) {
+            ok = seated[k] == done.barbID && done.start_ns <= done.end_ns;
+            front.customers[k]->result = done.barbID;
+            open--;
+         }
+         else if (ok) {
+            ok = done.kind == kVisitDropped && seated[k] == kVisitQueued;
+            front.customers[k]->result = -1;
+            open--;
+         }
+         if (!ok && front.error.empty()) {
+            stringstream out;
+            out << "customer[" << done.custID << "]: completion " << done.kind << " with barber["
+                << done.barbID + 1 << "] out of order";
+            front.error = out.str();
+         }
+      }
+      else {
+         usleep(50);                                                       // Nothing due: poll again soon
+      }
+   }
+   delete []visits;
+   return nullptr;
+}